@@ -1,52 +1,79 @@
 #include "array.h"
 
 #include <stdlib.h>
-#include <stdio.h>
+#include <string.h>
 #include <stdint.h>
 
 
-#define PTRINC(p,i,s) ((void*)(((uint8_t*)(p)) + ((i)*(s))))
-#define PTRDEC(p,i,s) ((void*)(((uint8_t*)(p)) - ((i)*(s))))
+#define ES_ARRAY_MINCAP 8ull
 
 
 //*************************************************************************
-void es_array_construct(void **data, size_t *size, size_t *capacity, size_t stride)
+static int resize(es_allocator *alloc, void *inl, void **data, size_t *size, size_t *capacity, size_t stride, size_t newcap)
 {
-    *size     = 0ull;
-    *capacity = 16ull;
+    void *ptr;
+
+    if(inl && *data == inl)
+    {
+        // spill inline storage to the heap
+        ptr = es_malloc(alloc, newcap * stride);
+        if(!ptr) return 0;
+        memcpy(ptr, inl, *size * stride);
+    }
+    else
+    {
+        ptr = es_realloc(alloc, *data, *capacity * stride, newcap * stride);
+        if(!ptr && newcap) return 0;
+    }
 
-    *data = malloc(*capacity * stride);
+    *data = ptr;
+    *capacity = newcap;
+    return 1;
 }
 
 
 //*************************************************************************
-void es_array_destruct(void **data, size_t *size, size_t *capacity)
+void es_array_destruct(es_allocator *alloc, void *inl, void **data, size_t *size, size_t *capacity, size_t stride)
 {
-    free(*data);
+    if(!inl || *data != inl)
+        es_free(alloc, *data, *capacity * stride);
 
+    *data     = NULL;
     *size     = 0ull;
     *capacity = 0ull;
 }
 
 
 //*************************************************************************
-void *es_array_push(void **data, size_t *size, size_t *capacity, size_t stride)
+int es_array_reserve(es_allocator *alloc, void *inl, void **data, size_t *size, size_t *capacity, size_t stride, size_t n)
 {
-    if(*size + 1 > *capacity)
-    {
-        size_t newcap = *capacity + 16ull;
-        void* ptr = realloc(*data, newcap * stride);
-        if(!ptr) return NULL;
-        *data = ptr;
-        *capacity = newcap;
-        printf("arr realloc : %lli\n", newcap);
-    }
-    return PTRINC(*data, (*size)++, stride);
+    if(n <= *capacity) return 1;
+
+    return resize(alloc, inl, data, size, capacity, stride, n);
+}
+
+
+//*************************************************************************
+int es_array_shrink(es_allocator *alloc, void *inl, void **data, size_t *size, size_t *capacity, size_t stride)
+{
+    // inline storage can't shrink, a spilled small array stays on the heap
+    if((inl && *data == inl) || *size == *capacity) return 1;
+
+    return resize(alloc, NULL, data, size, capacity, stride, *size);
 }
 
 
 //*************************************************************************
-void *es_array_pop(void **data, size_t *size, size_t *capacity, size_t stride)
+int es_array_push(es_allocator *alloc, void *inl, void **data, size_t *size, size_t *capacity, size_t stride)
 {
-    return PTRINC(*data, --(*size), stride);
-}
\ No newline at end of file
+    if(*size + 1 > *capacity)
+    {
+        size_t newcap = *capacity ? *capacity * 2ull : ES_ARRAY_MINCAP;
+
+        if(!resize(alloc, inl, data, size, capacity, stride, newcap))
+            return 0;
+    }
+
+    *size += 1;
+    return 1;
+}
@@ -14,20 +14,45 @@
 #define ES_ARRAY_H
 
 
+#include "memory.h"
+
+
 // array template
+// 'inl' points at inline storage for small arrays, NULL otherwise
 #define es_array(T)           \
     typedef struct T##_arr_t  \
     {                         \
         size_t size;          \
         size_t capacity;      \
         T *data;              \
+        es_allocator *alloc;  \
+        T *inl;               \
     } T##_arr
 
 
-#define es_construct_array(T, a) (es_array_construct(&(a).data, &(a).size, &(a).capacity, sizeof(T)))
-#define es_destroy_array(T, a) (es_array_destruct(&(a).data, &(a).size, &(a).capacity))
-#define es_arrpushv(T,a,v) ((*(T*)es_array_push(&(a).data, &(a).size, &(a).capacity, sizeof(T))) = (v))
-#define es_arrpush(T,a) (es_array_push(&(a).data, &(a).size, &(a).capacity, sizeof(T)))
+// small array template, the first N elements live inside the struct
+// so it must not be moved or copied once constructed
+#define es_array_small(T, N)  \
+    typedef struct T##_sarr_t \
+    {                         \
+        size_t size;          \
+        size_t capacity;      \
+        T *data;              \
+        es_allocator *alloc;  \
+        T *inl;               \
+        T buf[N];             \
+    } T##_sarr
+
+
+// 'al' may be NULL to use the c runtime directly
+#define es_construct_array(T, a, al) ((a).data = NULL, (a).size = 0ull, (a).capacity = 0ull, (a).alloc = (al), (a).inl = NULL)
+#define es_construct_sarray(T, a, al) ((a).data = (a).buf, (a).size = 0ull, (a).capacity = sizeof((a).buf) / sizeof(T), (a).alloc = (al), (a).inl = (a).buf)
+#define es_destroy_array(T, a) (es_array_destruct((a).alloc, (a).inl, (void**)&(a).data, &(a).size, &(a).capacity, sizeof(T)))
+#define es_arrreserve(T,a,n) (es_array_reserve((a).alloc, (a).inl, (void**)&(a).data, &(a).size, &(a).capacity, sizeof(T), (n)))
+#define es_arrshrink(T,a) (es_array_shrink((a).alloc, (a).inl, (void**)&(a).data, &(a).size, &(a).capacity, sizeof(T)))
+// pushes return 0 when the array couldn't grow, it's left as it was and 'v' isn't evaluated
+#define es_arrpush(T,a) ((a).size < (a).capacity ? ((a).size++, 1) : es_array_push((a).alloc, (a).inl, (void**)&(a).data, &(a).size, &(a).capacity, sizeof(T)))
+#define es_arrpushv(T,a,v) (es_arrpush(T,a) ? (es_arrback(a) = (v), 1) : 0)
 #define es_arrpop(a) ((a).data[--((a).size)])
 #define es_arrpopn(a,n) ((a).size -= n)
 #define es_arrback(a) ((a).data[(a).size-1])
@@ -39,9 +64,10 @@
 
 
 // generic interface
-void  es_array_construct(void **data, size_t *size, size_t *capacity, size_t stride);
-void  es_array_destruct(void **data, size_t *size, size_t *capacity);
-void *es_array_push(void **data, size_t *size, size_t *capacity, size_t stride);
+void  es_array_destruct(es_allocator *alloc, void *inl, void **data, size_t *size, size_t *capacity, size_t stride);
+int   es_array_reserve(es_allocator *alloc, void *inl, void **data, size_t *size, size_t *capacity, size_t stride, size_t n);
+int   es_array_shrink(es_allocator *alloc, void *inl, void **data, size_t *size, size_t *capacity, size_t stride);
+int   es_array_push(es_allocator *alloc, void *inl, void **data, size_t *size, size_t *capacity, size_t stride);
 
 
 #endif
\ No newline at end of file
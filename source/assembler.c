@@ -1,5 +1,6 @@
 #include "assembler.h"
 #include "disassembly.h"
+#include "ir.h"
 
 #include <ctype.h>
 #include <string.h>
@@ -155,6 +156,9 @@ int32_t readarg(es_assembler_state* state, es_opargtype argt)
 {
     int64_t k;
     long double f;
+
+    if(argt == ARGT_U) return 0;
+
     readword(state);
 
     switch(argt)
@@ -257,6 +261,20 @@ int32_t readarg(es_assembler_state* state, es_opargtype argt)
 }
 
 
+//*************************************************************************
+static void checkarg(es_assembler_state* state, es_opargtype argt, int32_t v, int size)
+{
+    // MAKEARG would wrap it around into some other register or constant
+    if(argt == ARGT_U) return;
+    if(argt == ARGT_SI ? FITSSARG(v, size) : FITSARG(v, size)) return;
+
+    if(argt == ARGT_RK && ISK(v))
+        asmerr(state, "k%i out of range, use loadkx", v >> 1);
+    else
+        asmerr(state, "argument %i doesn't fit in %i bits", argt == ARGT_RK ? v >> 1 : v, size);
+}
+
+
 //*************************************************************************
 void label(es_assembler_state* state)
 {
@@ -365,14 +383,21 @@ void validateins(es_assembler_state* state)
 
     es_opsigniture opsig = OPSIG(opcode);
 
+    // unused args aren't written
     switch(opsig)
     {
     case SIG_ABC:
-        readword(state);
+        if(CTYPE(opcode) != ARGT_U) readword(state);
+        if(BTYPE(opcode) != ARGT_U) readword(state);
+        if(ATYPE(opcode) != ARGT_U) readword(state);
+        break;
     case SIG_AY:
-        readword(state);
+        if(YTYPE(opcode) != ARGT_U) readword(state);
+        if(ATYPE(opcode) != ARGT_U) readword(state);
+        break;
     case SIG_X:
-        readword(state);
+        if(XTYPE(opcode) != ARGT_U) readword(state);
+        break;
     }
 
     state->ipos++;
@@ -395,6 +420,9 @@ void instruction(es_assembler_state* state)
         int32_t a = readarg(state, ATYPE(opcode));
         int32_t b = readarg(state, BTYPE(opcode));
         int32_t c = readarg(state, CTYPE(opcode));
+        checkarg(state, ATYPE(opcode), a, ASIZE);
+        checkarg(state, BTYPE(opcode), b, BSIZE);
+        checkarg(state, CTYPE(opcode), c, CSIZE);
         if(state->diagcode) return;
         writeins(state, INS_OABC(opcode,a,b,c));
         return;
@@ -404,6 +432,8 @@ void instruction(es_assembler_state* state)
     {
         int32_t a = readarg(state, ATYPE(opcode));
         int32_t y = readarg(state, YTYPE(opcode));
+        checkarg(state, ATYPE(opcode), a, ASIZE);
+        checkarg(state, YTYPE(opcode), y, YSIZE);
         if(state->diagcode) return;
         writeins(state, INS_OAY(opcode,a,y));
         return;
@@ -412,6 +442,7 @@ void instruction(es_assembler_state* state)
     case SIG_X:
     {
         int32_t x = readarg(state, XTYPE(opcode));
+        checkarg(state, XTYPE(opcode), x, XSIZE);
         if(state->diagcode) return;
         writeins(state, INS_OX(opcode,x));
     }
@@ -507,7 +538,7 @@ int es_assemble(es_state* es, const char* source, size_t size)
     }
 
     state.pcapacity = state.ipos;
-    state.program = (es_instruction*) malloc(state.pcapacity * sizeof(es_instruction));
+    state.program = (es_instruction*) es_malloc(&es->alloc, state.pcapacity * sizeof(es_instruction));
 
     if(!state.program)
     {
@@ -562,17 +593,27 @@ int es_assemble(es_state* es, const char* source, size_t size)
     if(state.errcount > 0)
     {
         printf("Assembly failed with %i errors\n", state.errcount);
-        free(state.program);
+        es_free(&es->alloc, state.program, state.pcapacity * sizeof(es_instruction));
         return state.errcount;
     }
 
     // shrink to fit
-    state.program = realloc(state.program, state.psize * sizeof(es_instruction));
+    state.program = es_realloc(&es->alloc, state.program,
+        state.pcapacity * sizeof(es_instruction),
+        state.psize * sizeof(es_instruction));
+
+    if(!es_arrpush(es_code, state.es->codechunks))
+    {
+        printf("Assembly failed, out of memory\n");
+        es_free(&es->alloc, state.program, state.psize * sizeof(es_instruction));
+        return 1;
+    }
 
-    es_arrpush(es_code, state.es->codechunks);
     es_arrback(state.es->codechunks).instructions = state.program;
     es_arrback(state.es->codechunks).size = state.psize;
 
+    es_peephole(es, &es_arrback(state.es->codechunks), &es->peepstats);
+
     return 0;
 }
 
@@ -0,0 +1,294 @@
+#include "builtins.h"
+#include "estring.h"
+#include "numarray.h"
+#include "map.h"
+#include "kernels.h"
+
+
+//*************************************************************************
+static int checkint(es_value *v, i64 *i)
+{
+    if(v->tid != ES_INT) return 0;
+    *i = v->i;
+    return 1;
+}
+
+
+//*************************************************************************
+// substr(s, start, count) : view into 's', no characters are copied
+static int es_substr(es_state *es, es_value *args)
+{
+    i64 start, count;
+
+    if(args[0].tid != ES_STRING || !checkint(args + 1, &start) || !checkint(args + 2, &count))
+        return -1;
+
+    if(start < 0) start = 0;
+    if(count < 0) count = 0;
+
+    es_string *str = (es_string*) ES_ALLOCATE_OBJ(&es->alloc, es_string, ES_STRING);
+    if(!str) return -1;
+
+    es_construct_substring(str, AS_STRING(args), (size_t) start, (size_t) count);
+
+    es_destroy_value(args);
+    args->tid = ES_STRING;
+    args->obj = &str->obj;
+
+    return 1;
+}
+
+
+//*************************************************************************
+// len(s) : size of string 's' in bytes, element count of array 's' or key count of map 's'
+static int es_len(es_state *es, es_value *args)
+{
+    (void) es;
+
+    i64 size;
+
+    if(args[0].tid == ES_STRING)     size = (i64) AS_STRING(args)->size;
+    else if(args[0].tid == ES_ARRAY) size = (i64) AS_NUMARRAY(args)->size;
+    else if(args[0].tid == ES_MAP)   size = (i64) AS_MAP(args)->map.size;
+    else return -1;
+
+    es_destroy_value(args);
+    args->tid = ES_INT;
+    args->i   = size;
+
+    return 1;
+}
+
+
+// [[[[[[[[[[[[[[[[[[[[[[[[[[[[[[[[[[[ Arrays ]]]]]]]]]]]]]]]]]]]]]]]]]]]]]]]]]]]
+
+
+//*************************************************************************
+static es_numarray *checkarray(es_value *v, int elem)
+{
+    if(v->tid != ES_ARRAY) return NULL;
+    if(elem >= 0 && AS_NUMARRAY(v)->elem != elem) return NULL;
+    return AS_NUMARRAY(v);
+}
+
+
+//*************************************************************************
+static int checknumber(es_value *v, f64 *f)
+{
+    if(v->tid == ES_FLOAT)    *f = v->f;
+    else if(v->tid == ES_INT) *f = (f64) v->i;
+    else return 0;
+    return 1;
+}
+
+
+//*************************************************************************
+static es_numarray *newarray(es_state *es, es_value *result, es_elemtype elem, size_t size)
+{
+    es_numarray *arr = (es_numarray*) ES_ALLOCATE_OBJ(&es->alloc, es_numarray, ES_ARRAY);
+    if(!arr) return NULL;
+
+    if(!es_construct_numarray(arr, elem, size))
+        return NULL;
+
+    es_destroy_value(result);
+    result->tid = ES_ARRAY;
+    result->obj = &arr->obj;
+
+    return arr;
+}
+
+
+//*************************************************************************
+static int construct(es_state *es, es_value *args, es_elemtype elem)
+{
+    i64 size;
+
+    if(!checkint(args, &size) || size < 0)
+        return -1;
+
+    return newarray(es, args, elem, (size_t) size) ? 1 : -1;
+}
+
+
+//*************************************************************************
+// ints(n), floats(n), bytes(n) : zero filled arrays of 'n' elements
+static int es_ints(es_state *es, es_value *args)   { return construct(es, args, ES_ELEM_INT); }
+static int es_floats(es_state *es, es_value *args) { return construct(es, args, ES_ELEM_FLOAT); }
+static int es_bytes(es_state *es, es_value *args)  { return construct(es, args, ES_ELEM_BYTE); }
+
+
+//*************************************************************************
+// sum(a) : int for int and byte arrays, float for float arrays
+static int es_sum(es_state *es, es_value *args)
+{
+    (void) es;
+
+    es_numarray *a = checkarray(args, -1);
+    if(!a) return -1;
+
+    const es_kernels *k = es_get_kernels();
+
+    switch(a->elem)
+    {
+    case ES_ELEM_FLOAT:
+        args->f   = k->sumf(a->data.f, a->size);
+        args->tid = ES_FLOAT;
+        break;
+    case ES_ELEM_INT:
+        args->i   = k->sumi(a->data.i, a->size);
+        args->tid = ES_INT;
+        break;
+    case ES_ELEM_BYTE:
+        args->i   = (i64) k->sumb(a->data.b, a->size);
+        args->tid = ES_INT;
+        break;
+    }
+
+    return 1;
+}
+
+
+//*************************************************************************
+static int minmax(es_value *args, int max)
+{
+    es_numarray *a = checkarray(args, -1);
+    if(!a || a->size == 0) return -1;
+
+    const es_kernels *k = es_get_kernels();
+
+    if(a->elem == ES_ELEM_FLOAT)
+    {
+        args->f   = max ? k->maxf(a->data.f, a->size) : k->minf(a->data.f, a->size);
+        args->tid = ES_FLOAT;
+        return 1;
+    }
+
+    i64 m = a->elem == ES_ELEM_INT ? a->data.i[0] : a->data.b[0];
+
+    for(size_t i = 1; i < a->size; ++i)
+    {
+        i64 v = a->elem == ES_ELEM_INT ? a->data.i[i] : a->data.b[i];
+        if(max ? v > m : v < m) m = v;
+    }
+
+    args->i   = m;
+    args->tid = ES_INT;
+
+    return 1;
+}
+
+
+//*************************************************************************
+// min(a), max(a) : smallest / largest element, 'a' must not be empty
+static int es_min(es_state *es, es_value *args) { (void) es; return minmax(args, 0); }
+static int es_max(es_state *es, es_value *args) { (void) es; return minmax(args, 1); }
+
+
+//*************************************************************************
+// dot(a, b) : float arrays of equal size
+static int es_dot(es_state *es, es_value *args)
+{
+    (void) es;
+
+    es_numarray *a = checkarray(args, ES_ELEM_FLOAT);
+    es_numarray *b = checkarray(args + 1, ES_ELEM_FLOAT);
+
+    if(!a || !b || a->size != b->size) return -1;
+
+    f64 r = es_get_kernels()->dotf(a->data.f, b->data.f, a->size);
+
+    es_destroy_value(args);
+    args->f   = r;
+    args->tid = ES_FLOAT;
+
+    return 1;
+}
+
+
+//*************************************************************************
+// scale(a, k) : a[i] *= k in place for float arrays, returns 'a'
+static int es_scale(es_state *es, es_value *args)
+{
+    (void) es;
+
+    es_numarray *a = checkarray(args, ES_ELEM_FLOAT);
+    f64 k;
+
+    if(!a || !checknumber(args + 1, &k)) return -1;
+
+    es_get_kernels()->scalef(a->data.f, k, a->size);
+
+    return 1;
+}
+
+
+//*************************************************************************
+// accum(a, b) : a[i] += b[i] in place, same element type and size, returns 'a'
+static int es_accum(es_state *es, es_value *args)
+{
+    (void) es;
+
+    es_numarray *a = checkarray(args, -1);
+    es_numarray *b = checkarray(args + 1, -1);
+
+    if(!a || !b || a->elem != b->elem || a->size != b->size) return -1;
+
+    const es_kernels *k = es_get_kernels();
+
+    switch(a->elem)
+    {
+    case ES_ELEM_FLOAT: k->addf(a->data.f, b->data.f, a->size); break;
+    case ES_ELEM_INT:   k->addi(a->data.i, b->data.i, a->size); break;
+    case ES_ELEM_BYTE:
+        for(size_t i = 0; i < a->size; ++i) a->data.b[i] += b->data.b[i];
+        break;
+    }
+
+    return 1;
+}
+
+
+//*************************************************************************
+// mask(a, x) : byte array with 1 where a[i] < x, 0 elsewhere
+static int es_mask(es_state *es, es_value *args)
+{
+    es_numarray *a = checkarray(args, -1);
+    f64 x;
+
+    if(!a || !checknumber(args + 1, &x)) return -1;
+
+    // the result replaces args[1], 'a' stays reachable until it's written
+    es_numarray *m = newarray(es, args + 1, ES_ELEM_BYTE, a->size);
+    if(!m) return -1;
+
+    if(a->elem == ES_ELEM_FLOAT)
+        es_get_kernels()->maskf(m->data.b, a->data.f, x, a->size);
+    else if(a->elem == ES_ELEM_INT)
+        for(size_t i = 0; i < a->size; ++i) m->data.b[i] = (f64) a->data.i[i] < x;
+    else
+        for(size_t i = 0; i < a->size; ++i) m->data.b[i] = (f64) a->data.b[i] < x;
+
+    args[0] = args[1];
+
+    return 1;
+}
+
+
+//*************************************************************************
+void es_open_builtins(es_state *es)
+{
+    es_register_cfunc(es, "substr", es_substr, 3, 1);
+    es_register_cfunc(es, "len",    es_len,    1, 1);
+
+    es_register_cfunc(es, "ints",   es_ints,   1, 1);
+    es_register_cfunc(es, "floats", es_floats, 1, 1);
+    es_register_cfunc(es, "bytes",  es_bytes,  1, 1);
+    es_register_cfunc(es, "sum",    es_sum,    1, 1);
+    es_register_cfunc(es, "min",    es_min,    1, 1);
+    es_register_cfunc(es, "max",    es_max,    1, 1);
+    es_register_cfunc(es, "dot",    es_dot,    2, 1);
+    es_register_cfunc(es, "scale",  es_scale,  2, 1);
+    es_register_cfunc(es, "accum",  es_accum,  2, 1);
+    es_register_cfunc(es, "mask",   es_mask,   2, 1);
+}
@@ -0,0 +1,23 @@
+/********************************************************************************
+ * \file builtins.h
+ * \author Patrick Torgeson (torgersonpatricks@gmail.com)
+ * \brief
+ * \version 0.1
+ * \date 2022-01-16
+ *
+ * @copyright Copyright (c) 2022
+ *
+ ********************************************************************************/
+
+
+#ifndef ES_BUILTINS_H
+#define ES_BUILTINS_H
+
+
+#include "vm.h"
+
+
+void es_open_builtins(es_state *es);
+
+
+#endif
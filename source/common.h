@@ -35,4 +35,11 @@ typedef float f32;
 typedef double f64;
 
 
+// the bounds checked calls msvc has, elsewhere the plain ones
+#ifndef _MSC_VER
+#define sprintf_s snprintf
+#define memcpy_s(d,ds,s,n) memcpy(d,s,n)
+#endif
+
+
 #endif
\ No newline at end of file
@@ -2,6 +2,8 @@
 #include "vm.h"
 #include "lex.h"
 #include "disassembly.h"
+#include "estring.h"
+#include "ir.h"
 
 #include <ctype.h>
 #include <string.h>
@@ -11,10 +13,13 @@
 
 
 typedef struct { const char *c; size_t s; } str;
+typedef struct { str name; u32 k; } kname;
 
 es_array(u32);
+es_array_small(u32, 32);
 es_array(u64);
 es_array(str);
+es_array(kname);
 es_array(es_instruction);
 
 
@@ -25,20 +30,28 @@ typedef struct cstate_t
 
     es_instruction_arr program;
     u64_arr func_offsets;
+    size_t funcstart; // first function of this chunk, func_offsets[0]
 
     es_lexeme_arr lexemes;
 
-    u32_arr indent_stack;
+    u32_sarr indent_stack;
 
     es_lexeme *cl;  //  current lexeme
     es_lexeme *pl;  //  previous lexeme
 
-    u32_arr operand_stack;
+    u32_sarr operand_stack;
     u32 *top;
 
     u32 next_register;
 
+    // registers the function being compiled has used, its frame size
+    u32 maxregs;
+
     str_arr locals;
+    kname_arr consts;
+
+    // field access sites of the function being compiled
+    es_fieldcache_arr fieldcaches;
 
     int errcount;
     int panic;
@@ -120,7 +133,11 @@ static void error(cstate* cs, const char *fmt, ...)
 //*************************************************************************
 static void writeins(cstate* cs, u32 ins)
 {
-    es_arrpushv(es_instruction, cs->program, ins);
+    if(!es_arrpushv(es_instruction, cs->program, ins))
+    {
+        error(cs, "out of memory");
+        return;
+    }
 
     char buffer[50];
     es_disassemble_ins(ins, buffer, 50);
@@ -128,6 +145,226 @@ static void writeins(cstate* cs, u32 ins)
 }
 
 
+//*************************************************************************
+static void checkarg(cstate *cs, int type, i64 v, int size)
+{
+    // nothing gets masked off in silence, what doesn't fit is an error
+
+    if(type == ARGT_U) return;
+    if(type == ARGT_SI ? FITSSARG(v, size) : FITSARG(v, size)) return;
+
+    if(type == ARGT_R || type == ARGT_OR)
+        error(cs, "out of registers, a function can use %i", 1 << size);
+    else if(type == ARGT_RK && !ISK(v))
+        error(cs, "out of registers, a function can use %i", 1 << (size - 1));
+    else
+        error(cs, "operand %lli doesn't fit in %i bits", v, size);
+}
+
+
+//*************************************************************************
+static void usereg(cstate *cs, int type, u32 v)
+{
+    // grows the frame to cover register args
+
+    if(type == ARGT_RK && !ISK(v)) v >>= 1;
+    else if(type == ARGT_OR && v > 0) v -= 1;
+    else if(type != ARGT_R) return;
+
+    if(v + 1 > cs->maxregs) cs->maxregs = v + 1;
+}
+
+
+//*************************************************************************
+static void emitay(cstate *cs, es_opcode op, u32 a, u32 y);
+
+
+//*************************************************************************
+static void retarget(cstate *cs, u32 reg)
+{
+    // puts the last expression's value in 'reg'. a temporary is produced
+    // there by its instruction, calls and news read their operands from
+    // where a is, so they and everything else are moved
+    u32 operand = es_arrback(cs->operand_stack);
+
+    if(operand == reg << 1) return;
+
+    es_instruction *last = cs->program.size ? &es_arrback(cs->program) : NULL;
+    int op = last ? (int) O(*last) : -1;
+
+    if(!ISK(operand) && (operand >> 1) >= cs->locals.size && last && A(*last) == (operand >> 1) && ATYPE(op) == ARGT_R &&
+       op != OP_CALL && op != OP_NEWS && op != OP_WRITES && op != OP_WRITEA && op != OP_WRITEM && op != OP_SETG)
+    {
+        checkarg(cs, ARGT_R, reg, ASIZE);
+        usereg(cs, ARGT_R, reg);
+        SETA(*last, reg);
+    }
+    else
+        emitay(cs, OP_MOV, reg, operand);
+}
+
+
+//*************************************************************************
+static es_value *kvalue(cstate *cs, u32 operand)
+{
+    // the constant an operand names, NULL for registers. a constant that
+    // couldn't be added stands in as k0, which may not exist
+    if(!ISK(operand) || (operand >> 1) >= cs->es->kst.size) return NULL;
+    return cs->es->kst.data + (operand >> 1);
+}
+
+
+//*************************************************************************
+static int smallint(cstate *cs, u32 operand, int size, i64 *v)
+{
+    // an int constant that fits a signed 'size' bit field
+    es_value *k = kvalue(cs, operand);
+    if(!k || k->tid != ES_INT || !FITSSARG(k->i, size)) return 0;
+
+    *v = k->i;
+    return 1;
+}
+
+
+//*************************************************************************
+static es_opcode immediateform(cstate *cs, es_opcode op, u32 *b, u32 *c)
+{
+    // a small int on either side moves into c, the register into b.
+    // returns 'op' if there's no such form
+    i64 v;
+    es_opcode imm = op;
+
+    if(!ISK(*b) && smallint(cs, *c, CSIZE, &v))
+    {
+        switch(op)
+        {
+        case OP_ADD: imm = OP_ADDI; break;
+        case OP_SUB: imm = OP_SUBI; break;
+        case OP_EQ:  imm = OP_EQI;  break;
+        case OP_NE:  imm = OP_NEI;  break;
+        case OP_LT:  imm = OP_LTI;  break;
+        case OP_LE:  imm = OP_LEI;  break;
+        default: break;
+        }
+    }
+    else if(!ISK(*c) && smallint(cs, *b, CSIZE, &v))
+    {
+        switch(op)
+        {
+        case OP_ADD: imm = OP_ADDI; break;
+        case OP_EQ:  imm = OP_EQI;  break;
+        case OP_NE:  imm = OP_NEI;  break;
+        case OP_LT:  imm = OP_GTI;  break;
+        case OP_LE:  imm = OP_GEI;  break;
+        default: break;
+        }
+
+        if(imm != op) *b = *c;
+    }
+
+    if(imm != op)
+    {
+        *b >>= 1;
+        *c = (u32) v;
+    }
+
+    return imm;
+}
+
+
+//*************************************************************************
+static void loadk(cstate *cs, u32 reg, size_t k)
+{
+    // mov reaches k131071, anything further comes through an extraarg.
+    // small ints are a movi wherever they are
+    i64 v;
+    if(FITSARG(ASK((u64)k), YSIZE) || smallint(cs, (u32)ASK(k), YSIZE, &v))
+    {
+        emitay(cs, OP_MOV, reg, (u32)ASK(k));
+        return;
+    }
+
+    checkarg(cs, ARGT_K, (i64)k, XSIZE);
+    writeins(cs, INS_OX(OP_EXTRAARG, k));
+    emitay(cs, OP_LOADKX, reg, 0);
+}
+
+
+//*************************************************************************
+static void emitabc(cstate *cs, es_opcode op, u32 a, u32 b, u32 c)
+{
+    op = immediateform(cs, op, &b, &c);
+
+    es_opinfo inf = es_get_opinfo(op);
+
+    // RK constants past k255 are loaded into registers above everything
+    // live, they only have to last until this instruction
+    u32 scratch = cs->next_register;
+
+    if(GETBTYPE(inf) == ARGT_RK && ISK(b) && !FITSARG(b, BSIZE))
+    {
+        loadk(cs, scratch, b >> 1);
+        b = scratch++ << 1;
+    }
+
+    if(GETCTYPE(inf) == ARGT_RK && ISK(c) && !FITSARG(c, CSIZE))
+    {
+        loadk(cs, scratch, c >> 1);
+        c = scratch++ << 1;
+    }
+
+    checkarg(cs, GETATYPE(inf), a, ASIZE);
+    checkarg(cs, GETBTYPE(inf), b, BSIZE);
+    checkarg(cs, GETCTYPE(inf), GETCTYPE(inf) == ARGT_SI ? (i64)(i32)c : (i64)c, CSIZE);
+
+    usereg(cs, GETATYPE(inf), a);
+    usereg(cs, GETBTYPE(inf), b);
+    usereg(cs, GETCTYPE(inf), c);
+
+    // a struct's fields are taken from a..a+c-1
+    if(op == OP_NEWS && c > 0) usereg(cs, ARGT_R, a + c - 1);
+
+    writeins(cs, INS_OABC(op, a, b, c));
+}
+
+
+//*************************************************************************
+static void emitay(cstate *cs, es_opcode op, u32 a, u32 y)
+{
+    i64 v;
+    if(op == OP_MOV && smallint(cs, y, YSIZE, &v))
+    {
+        op = OP_MOVI;
+        y  = (u32) v;
+    }
+
+    es_opinfo inf = es_get_opinfo(op);
+
+    if(op == OP_MOV && ISK(y) && !FITSARG(y, YSIZE))
+    {
+        loadk(cs, a, y >> 1);
+        return;
+    }
+
+    checkarg(cs, GETATYPE(inf), a, ASIZE);
+    checkarg(cs, GETYTYPE(inf), GETYTYPE(inf) == ARGT_SI ? (i64)(i32)y : (i64)y, YSIZE);
+
+    usereg(cs, GETATYPE(inf), a);
+    usereg(cs, GETYTYPE(inf), y);
+
+    writeins(cs, INS_OAY(op, a, y));
+}
+
+
+//*************************************************************************
+static void emitx(cstate *cs, es_opcode op, u32 x)
+{
+    checkarg(cs, GETXTYPE(es_get_opinfo(op)), x, XSIZE);
+
+    writeins(cs, INS_OX(op, x));
+}
+
+
 //*************************************************************************
 static void advance(cstate *cs)
 {
@@ -175,25 +412,36 @@ static es_lexeme *peek(cstate *cs)
 //*************************************************************************
 static void literal(cstate *cs);
 static void grouping(cstate *cs);
-static void binary(cstate *cs);
+static void binary(cstate *cs, es_lexeme *before);
 static void unary(cstate *cs);
 static void statement(cstate *cs);
 static void varaccess(cstate *cs);
 static void funccall(cstate *cs);
+static void subscript(cstate *cs);
+static void maplit(cstate *cs);
+static void field(cstate *cs);
+static void construct(cstate *cs);
 
 
 //*************************************************************************
 static void expression(cstate *cs, es_precedence p)
 {
+    // the lexeme before this expression, for operands it folds down
+    es_lexeme *before = cs->pl;
+
     if(cs->cl->catagory == LEXC_LITERAL)
         literal(cs);
     else if(cs->cl->catagory == LEXC_OPERATOR)
         unary(cs);
     else if(cs->cl->type == LEX_OPEN_PAREN)
         grouping(cs);
+    else if(cs->cl->type == LEX_OPEN_CURLY)
+        maplit(cs);
     else if(cs->cl->type == LEX_IDENTIFIER)
     {
-        if(peek(cs)->type == LEX_OPEN_PAREN)
+        if(peek(cs)->type == LEX_OPEN_PAREN && es_find_shape(cs->es, cs->cl->ptr, cs->cl->size))
+            construct(cs);
+        else if(peek(cs)->type == LEX_OPEN_PAREN)
             funccall(cs);
         else
             varaccess(cs);
@@ -205,21 +453,157 @@ static void expression(cstate *cs, es_precedence p)
         return;
     }
 
+    while(cs->cl->type == LEX_OPEN_SQUARE || cs->cl->type == LEX_DOT)
+    {
+        if(cs->cl->type == LEX_DOT)
+            field(cs);
+        else
+            subscript(cs);
+    }
+
     while(cs->cl->catagory == LEXC_OPERATOR && precedence[cs->cl->type] >= p)
-        binary(cs);
+        binary(cs, before);
 }
 
 
 //*************************************************************************
-static void literal(cstate *cs)
+static int isolatedspan(es_lexeme *before, es_lexeme *after)
+{
+    // an operand nothing else consumes directly needs its own register
+    if(after->catagory == LEXC_OPERATOR || before->catagory == LEXC_OPERATOR)
+        return 0;
+
+    if(after->type == LEX_OPEN_SQUARE || after->type == LEX_DOT)
+        return 0;
+
+    // map literal keys and values are used in place
+    if(after->type == LEX_COLON || before->type == LEX_COLON)
+        return 0;
+
+    return !(before->type == LEX_OPEN_SQUARE && after->type == LEX_CLOSE_SQUARE);
+}
+
+
+//*************************************************************************
+static int isolated(cstate *cs)
+{
+    return isolatedspan(cs->pl, peek(cs));
+}
+
+
+//*************************************************************************
+static size_t checkk(cstate *cs, size_t k)
 {
+    // a constant that couldn't be added compiles as the first one,
+    // the error keeps the result from ever running
+    if(k != ES_KNONE) return k;
+
+    error(cs, "out of memory");
+    return 0;
+}
+
+
+//*************************************************************************
+static void folded(cstate *cs, es_lexeme *before, size_t k)
+{
+    // a constant that replaced the operands from 'before' up to cl
+    k = checkk(cs, k);
+    es_arrpushv(u32, cs->operand_stack, (u32)ASK(k));
+
+    if(isolatedspan(before, cs->cl))
+    {
+        emitay(cs, OP_MOV, cs->next_register, ASK(k));
+        cs->next_register += 1;
+    }
+}
+
+
+//*************************************************************************
+static int fold(cstate *cs, int op, u32 lh, u32 rh, size_t *k)
+{
+    // evaluates op on two constants the way the vm would, returns 0 for
+    // anything that has to be left to run time, errors included
+
+    if(!ISK(lh) || !ISK(rh)) return 0;
+
+    // operands left by an earlier error
+    if((lh >> 1) >= cs->es->kst.size || (rh >> 1) >= cs->es->kst.size) return 0;
+
+    es_value l = es_arrat(cs->es->kst, lh >> 1);
+    es_value r = es_arrat(cs->es->kst, rh >> 1);
+
+    if(op == LEX_GREATER || op == LEX_GREATER_EQUAL)
+    {
+        es_value t = l;
+        l = r;
+        r = t;
+        op -= 2;
+    }
+
+    if(l.tid == ES_INT && r.tid == ES_INT)
+    {
+        // wraps like the hardware does instead of overflowing
+        switch(op)
+        {
+        case LEX_PLUS:  *k = es_addk_int(cs->es, (i64)((u64) l.i + (u64) r.i)); return 1;
+        case LEX_MINUS: *k = es_addk_int(cs->es, (i64)((u64) l.i - (u64) r.i)); return 1;
+        case LEX_STAR:  *k = es_addk_int(cs->es, (i64)((u64) l.i * (u64) r.i)); return 1;
+        case LEX_SLASH:
+            if(r.i == 0 || (r.i == -1 && l.i == INT64_MIN)) return 0;
+            *k = es_addk_int(cs->es, l.i / r.i);
+            return 1;
+        case LEX_EQUAL2:     *k = es_addk_bool(cs->es, l.i == r.i); return 1;
+        case LEX_BANG_EQUAL: *k = es_addk_bool(cs->es, l.i != r.i); return 1;
+        case LEX_LESS:       *k = es_addk_bool(cs->es, l.i <  r.i); return 1;
+        case LEX_LESS_EQUAL: *k = es_addk_bool(cs->es, l.i <= r.i); return 1;
+        }
+    }
+    else if(l.tid == ES_FLOAT && r.tid == ES_FLOAT)
+    {
+        switch(op)
+        {
+        case LEX_PLUS:       *k = es_addk_float(cs->es, l.f + r.f);  return 1;
+        case LEX_MINUS:      *k = es_addk_float(cs->es, l.f - r.f);  return 1;
+        case LEX_STAR:       *k = es_addk_float(cs->es, l.f * r.f);  return 1;
+        case LEX_SLASH:      *k = es_addk_float(cs->es, l.f / r.f);  return 1;
+        case LEX_EQUAL2:     *k = es_addk_bool(cs->es, l.f == r.f); return 1;
+        case LEX_BANG_EQUAL: *k = es_addk_bool(cs->es, l.f != r.f); return 1;
+        case LEX_LESS:       *k = es_addk_bool(cs->es, l.f <  r.f); return 1;
+        case LEX_LESS_EQUAL: *k = es_addk_bool(cs->es, l.f <= r.f); return 1;
+        }
+    }
+    else if(l.tid == ES_STRING && r.tid == ES_STRING && op == LEX_PLUS)
+    {
+        es_string *a = AS_STRING((&l));
+        es_string *b = AS_STRING((&r));
+
+        char *buffer = (char*) es_malloc(&cs->es->alloc, a->size + b->size + 1);
+        if(!buffer) return 0;
+
+        memcpy(buffer, a->data, a->size);
+        memcpy(buffer + a->size, b->data, b->size);
+
+        *k = es_addk_string(cs->es, buffer, a->size + b->size);
+
+        es_free(&cs->es->alloc, buffer, a->size + b->size + 1);
+        return 1;
+    }
+
+    return 0;
+}
+
+
+//*************************************************************************
+static size_t literalk(cstate *cs)
+{
+    // constant for the literal at cl, leaves cl on it
     str s = {cs->cl->ptr,cs->cl->size};
 
     if(cs->cl->type == LEX_MINUS) advance(cs);
 
     int type = cs->cl->type;
 
-    size_t k;
+    size_t k = 0;
     switch(type)
     {
         case LEX_INTEGER :
@@ -232,15 +616,36 @@ static void literal(cstate *cs)
             k = es_addk_string(cs->es, s.c, s.s);
             break;
         }
+        case LEX_TRUE :
+        case LEX_FALSE :
+        {
+            k = es_addk_bool(cs->es, type == LEX_TRUE);
+            break;
+        }
+        case LEX_NIL :
+        {
+            k = es_addk_nil(cs->es);
+            break;
+        }
         default: error(cs, "expected literal");
     }
 
+    return checkk(cs, k);
+}
+
+
+//*************************************************************************
+static void literal(cstate *cs)
+{
+    // a leading '-' is part of the literal, not what comes before it
+    es_lexeme *before = cs->pl;
+    size_t k = literalk(cs);
+
     es_arrpushv(u32, cs->operand_stack, (u32)ASK(k));
 
-    if(peek(cs)->catagory != LEXC_OPERATOR && cs->pl->catagory != LEXC_OPERATOR)
+    if(isolatedspan(before, peek(cs)))
     {
-        // TODO: use OP_MOVI if possible
-        writeins(cs, INS_OAY(OP_MOV,cs->next_register,ASK(k)));
+        emitay(cs, OP_MOV,cs->next_register,ASK(k));
         cs->next_register += 1;
     }
 
@@ -251,6 +656,8 @@ static void literal(cstate *cs)
 //*************************************************************************
 static void unary(cstate *cs)
 {
+    es_lexeme *before = cs->pl;
+
     if(cs->cl->type == LEX_MINUS && cs->cl[1].catagory == LEXC_LITERAL)
     {
         literal(cs);
@@ -259,11 +666,13 @@ static void unary(cstate *cs)
     {
         int op = cs->cl->type;
 
-        es_precedence p = precedence[op];
+        // '-' is only folded, nothing negates a register yet
+        es_precedence p = (op == LEX_MINUS) ? PREC_UNARY : precedence[op];
 
         if(p != PREC_UNARY)
         {
             error(cs, "expected unary operator");
+            es_arrpushv(u32, cs->operand_stack, 1); // 1 == k0
             advance(cs);
             return;
         }
@@ -273,6 +682,23 @@ static void unary(cstate *cs)
 
         u32 operand = es_arrpop(cs->operand_stack);
 
+        if(op == LEX_MINUS)
+        {
+            es_value *v = kvalue(cs, operand);
+
+            if(v && v->tid == ES_INT)
+                folded(cs, before, es_addk_int(cs->es, (i64)(0 - (u64) v->i)));
+            else if(v && v->tid == ES_FLOAT)
+                folded(cs, before, es_addk_float(cs->es, -v->f));
+            else
+            {
+                error(cs, "unary '-' needs a constant operand");
+                es_arrpushv(u32, cs->operand_stack, 1);
+            }
+
+            return;
+        }
+
         u32 dest;
         if(!ISK(operand) && operand >> 1 >= cs->locals.size - 1)
             dest = operand >> 1;
@@ -283,7 +709,7 @@ static void unary(cstate *cs)
 
         es_arrpushv(u32, cs->operand_stack, dest << 1);
 
-        writeins(cs, INS_OAY(op,dest,operand));
+        emitay(cs, op,dest,operand);
     }
 }
 
@@ -298,7 +724,55 @@ static void grouping(cstate *cs)
 
 
 //*************************************************************************
-static void binary(cstate *cs)
+static int isstringk(cstate *cs, u32 operand)
+{
+    es_value *k = kvalue(cs, operand);
+    return k && k->tid == ES_STRING;
+}
+
+
+//*************************************************************************
+static void place(cstate *cs, u32 operand, u32 reg)
+{
+    if(operand != reg << 1)
+        emitay(cs, OP_MOV, reg, operand);
+}
+
+
+//*************************************************************************
+static void concatenation(cstate *cs, u32 lh, u32 rh)
+{
+    // lowers a chain of '+' on strings into a single OP_CONCAT,
+    // operands are gathered into consecutive registers
+
+    u32 base = cs->next_register;
+
+    // reuse lh if it's the topmost temporary
+    if(!ISK(lh) && (lh >> 1) >= cs->locals.size && (lh >> 1) + 1 == cs->next_register)
+        base = lh >> 1;
+
+    u32 count = 0;
+
+    place(cs, lh, base + count++);
+    place(cs, rh, base + count++);
+
+    while(cs->cl->type == LEX_PLUS)
+    {
+        advance(cs);
+        cs->next_register = base + count;
+        expression(cs, PREC_TERM + 1);
+        place(cs, es_arrpop(cs->operand_stack), base + count++);
+    }
+
+    emitabc(cs, OP_CONCAT, base, base, base + count - 1);
+
+    cs->next_register = base + 1;
+    es_arrpushv(u32, cs->operand_stack, base << 1);
+}
+
+
+//*************************************************************************
+static void binary(cstate *cs, es_lexeme *before)
 {
     int op = cs->cl->type;
 
@@ -311,6 +785,20 @@ static void binary(cstate *cs)
 
     u32 rh = es_arrpop(cs->operand_stack);
 
+    size_t k;
+    if(fold(cs, op, lh, rh, &k))
+    {
+        folded(cs, before, k);
+        return;
+    }
+
+    // a single string '+' is an OP_ADD, longer chains are one OP_CONCAT
+    if(op == LEX_PLUS && cs->cl->type == LEX_PLUS && (isstringk(cs, lh) || isstringk(cs, rh)))
+    {
+        concatenation(cs, lh, rh);
+        return;
+    }
+
     if(op == LEX_GREATER || op == LEX_GREATER_EQUAL)
     {
         u32 t = lh;
@@ -327,54 +815,354 @@ static void binary(cstate *cs)
     else
         dest = cs->next_register;
 
-    cs->next_register = dest + 1;
+    cs->next_register = dest + 1;
+
+    es_arrpushv(u32, cs->operand_stack, dest << 1);
+
+    emitabc(cs, op,dest,lh,rh);
+}
+
+
+//*************************************************************************
+static int local_lookup(cstate *cs, const char* c, size_t s)
+{
+    // returns 0 if no such local exists, l+1
+    for(size_t l = 0; l < cs->locals.size; ++l)
+    {
+        if(es_arrat(cs->locals, l).s == s && strncmp(es_arrat(cs->locals, l).c, c, s) == 0)
+        {
+            return (int) l + 1;
+        }
+    }
+
+    return 0;
+}
+
+
+//*************************************************************************
+static int const_lookup(cstate *cs, const char* c, size_t s)
+{
+    // returns 0 if no such const exists, k+1, inner scopes are searched first
+    for(size_t n = cs->consts.size; n > 0; --n)
+    {
+        kname *kn = cs->consts.data + n - 1;
+
+        if(kn->name.s == s && strncmp(kn->name.c, c, s) == 0)
+            return (int) kn->k + 1;
+    }
+
+    return 0;
+}
+
+
+//*************************************************************************
+static void varaccess(cstate *cs)
+{
+    int l = local_lookup(cs, cs->cl->ptr, cs->cl->size);
+    int k = l ? 0 : const_lookup(cs, cs->cl->ptr, cs->cl->size);
+    i64 g;
+
+    if(l)
+    {
+        es_arrpushv(u32, cs->operand_stack, (l-1) << 1);
+
+        if(isolated(cs))
+        {
+            emitay(cs, OP_MOV,cs->next_register, (l-1) << 1);
+            cs->next_register += 1;
+        }
+
+        advance(cs);
+    }
+    else if(k)
+    {
+        // consts are used like the literal they stand for
+        es_arrpushv(u32, cs->operand_stack, (u32)ASK(k - 1));
+
+        if(isolated(cs))
+        {
+            emitay(cs, OP_MOV,cs->next_register, ASK(k - 1));
+            cs->next_register += 1;
+        }
+
+        advance(cs);
+    }
+    else if((g = es_find_global(cs->es, cs->cl->ptr, cs->cl->size)) >= 0)
+    {
+        // globals are always read into a register of their own
+        emitay(cs, OP_GETG, cs->next_register, g);
+        es_arrpushv(u32, cs->operand_stack, cs->next_register << 1);
+        cs->next_register += 1;
+
+        advance(cs);
+    }
+    else
+    {
+        error(cs, "variable '%.*s' not defined", cs->cl->size, cs->cl->ptr);
+        es_arrpushv(u32, cs->operand_stack, 1); // 1 == k0
+        advance(cs);
+    }
+}
+
+
+//*************************************************************************
+static int reglookup(cstate *cs, es_lexeme *id)
+{
+    // register holding a variable, globals are read into a new one,
+    // returns 0 if no such variable exists, r+1
+    int r = local_lookup(cs, id->ptr, id->size);
+    if(r) return r;
+
+    i64 g = es_find_global(cs->es, id->ptr, id->size);
+    if(g < 0) return 0;
+
+    emitay(cs, OP_GETG, cs->next_register, g);
+    return (int) cs->next_register++ + 1;
+}
+
+
+//*************************************************************************
+static int iskeyk(cstate *cs, u32 operand)
+{
+    // constant keys that can only index maps
+    es_value *k = kvalue(cs, operand);
+    return k && (k->tid == ES_STRING || k->tid == ES_FLOAT);
+}
+
+
+//*************************************************************************
+static void subscript(cstate *cs)
+{
+    // x[i] : element read from the operand on top of the stack
+
+    u32 arr = es_arrpop(cs->operand_stack);
+
+    consume(cs, LEX_OPEN_SQUARE);
+    expression(cs, PREC_OR);
+    consume(cs, LEX_CLOSE_SQUARE);
+
+    u32 index = es_arrpop(cs->operand_stack);
+
+    if(ISK(arr))
+    {
+        place(cs, arr, cs->next_register);
+        arr = cs->next_register++ << 1;
+    }
+
+    u32 dest;
+    if(!ISK(index) && (index >> 1) >= cs->locals.size)
+        dest = index >> 1;
+    else if((arr >> 1) >= cs->locals.size)
+        dest = arr >> 1;
+    else
+        dest = cs->next_register;
+
+    cs->next_register = dest + 1;
+
+    es_arrpushv(u32, cs->operand_stack, dest << 1);
+
+    emitabc(cs, iskeyk(cs, index) ? OP_READM : OP_READA, dest, arr >> 1, index);
+}
+
+
+//*************************************************************************
+static u32 fieldsite(cstate *cs, es_lexeme *name)
+{
+    // every access gets its own cache, reads and writes number them in 9 bits
+    if(cs->fieldcaches.size >= (1u << BSIZE))
+    {
+        error(cs, "too many field accesses in one function");
+        return 0;
+    }
+
+    if(!es_arrpush(es_fieldcache, cs->fieldcaches))
+    {
+        error(cs, "out of memory");
+        return 0;
+    }
+
+    es_arrback(cs->fieldcaches).shape = NULL;
+    es_arrback(cs->fieldcaches).slot  = 0;
+    es_arrback(cs->fieldcaches).name  = (u32) checkk(cs, es_addk_string(cs->es, name->ptr, name->size));
+
+    return (u32) cs->fieldcaches.size - 1;
+}
+
+
+//*************************************************************************
+static void field(cstate *cs)
+{
+    // x.f : field read from the operand on top of the stack
+
+    u32 obj = es_arrpop(cs->operand_stack);
+
+    consume(cs, LEX_DOT);
+
+    es_lexeme *name = cs->cl;
+    consume(cs, LEX_IDENTIFIER);
+
+    u32 site = fieldsite(cs, name);
+
+    if(ISK(obj))
+    {
+        place(cs, obj, cs->next_register);
+        obj = cs->next_register++ << 1;
+    }
+
+    u32 dest;
+    if((obj >> 1) >= cs->locals.size)
+        dest = obj >> 1;
+    else
+        dest = cs->next_register;
+
+    cs->next_register = dest + 1;
+
+    es_arrpushv(u32, cs->operand_stack, dest << 1);
+
+    emitabc(cs, OP_READS, dest, obj >> 1, site);
+}
+
+
+//*************************************************************************
+static void construct(cstate *cs)
+{
+    // Name(a, b, ...) : a new struct, arguments fill its fields in order
+
+    es_shape *shape = es_find_shape(cs->es, cs->cl->ptr, cs->cl->size);
+
+    consume(cs, LEX_IDENTIFIER);
+    consume(cs, LEX_OPEN_PAREN);
+
+    u32 r = cs->next_register;
+    u32 count = 0;
+
+    if(cs->cl->type != LEX_CLOSE_PAREN)
+        while(true)
+        {
+            expression(cs, PREC_OR);
+            ++count;
+            if(cs->cl->type == LEX_COMMA)
+            {
+                advance(cs);
+                continue;
+            }
+            else break;
+        }
+
+    consume(cs, LEX_CLOSE_PAREN);
+
+    if(count > shape->size)
+        error(cs, "'%s' has %u fields, given %u", shape->name, shape->size, count);
+
+    emitabc(cs, OP_NEWS, r, shape->id, count);
+
+    cs->next_register = r + 1;
+    es_arrpushv(u32, cs->operand_stack, r << 1);
+}
+
+
+//*************************************************************************
+static void maplit(cstate *cs)
+{
+    // {k : v, ...} : a new map filled one key at a time
+
+    u32 dest = cs->next_register++;
+
+    size_t newm = cs->program.size;
+    emitay(cs, OP_NEWM, dest, 0);
+
+    consume(cs, LEX_OPEN_CURLY);
+
+    u32 count = 0;
+
+    while(cs->cl->type != LEX_CLOSE_CURLY && cs->cl->type != LEX_EOF)
+    {
+        cs->next_register = dest + 1;
+
+        expression(cs, PREC_OR);
+        u32 key = es_arrpop(cs->operand_stack);
+
+        consume(cs, LEX_COLON);
+
+        expression(cs, PREC_OR);
+        u32 value = es_arrpop(cs->operand_stack);
+
+        emitabc(cs, OP_WRITEM, dest, key, value);
+        ++count;
+
+        if(cs->cl->type != LEX_COMMA) break;
+        advance(cs);
+    }
+
+    consume(cs, LEX_CLOSE_CURLY);
+
+    checkarg(cs, ARGT_I, count, YSIZE);
+    cs->program.data[newm] = INS_OAY(OP_NEWM, dest, count);
+
+    cs->next_register = dest + 1;
+    es_arrpushv(u32, cs->operand_stack, dest << 1);
+}
+
+
+//*************************************************************************
+static void elemassignment(cstate *cs)
+{
+    // x[i] = v
+    int r = reglookup(cs, cs->cl);
+
+    if(!r) error(cs, "variable '%.*s' not defined", cs->cl->size, cs->cl->ptr);
+
+    consume(cs, LEX_IDENTIFIER);
+    consume(cs, LEX_OPEN_SQUARE);
+    expression(cs, PREC_OR);
+    consume(cs, LEX_CLOSE_SQUARE);
 
-    es_arrpushv(u32, cs->operand_stack, dest << 1);
+    u32 index = es_arrpop(cs->operand_stack);
+
+    consume(cs, LEX_EQUAL);
+    expression(cs, PREC_OR);
+
+    u32 value = es_arrpop(cs->operand_stack);
 
-    writeins(cs, INS_OABC(op,dest,lh,rh));
+    emitabc(cs, iskeyk(cs, index) ? OP_WRITEM : OP_WRITEA, r - 1, index, value);
 }
 
 
 //*************************************************************************
-static int local_lookup(cstate *cs, const char* c, size_t s)
+static void fieldassignment(cstate *cs)
 {
-    // returns 0 if no such local exists, l+1
-    for(size_t l = 0; l < cs->locals.size; ++l)
-    {
-        if(es_arrat(cs->locals, l).s == s && strncmp(es_arrat(cs->locals, l).c, c, s) == 0)
-        {
-            return (int) l + 1;
-        }
-    }
+    // x.f = v, x.f.g = v reads through to the last field
+    int r = reglookup(cs, cs->cl);
 
-    return 0;
-}
+    if(!r) error(cs, "variable '%.*s' not defined", cs->cl->size, cs->cl->ptr);
 
+    consume(cs, LEX_IDENTIFIER);
 
-//*************************************************************************
-static void varaccess(cstate *cs)
-{
-    int l = local_lookup(cs, cs->cl->ptr, cs->cl->size);
+    u32 obj = r - 1;
+    es_lexeme *name;
 
-    if(l)
+    for(;;)
     {
-        es_arrpushv(u32, cs->operand_stack, (l-1) << 1);
+        consume(cs, LEX_DOT);
 
-        if(peek(cs)->catagory != LEXC_OPERATOR && cs->pl->catagory != LEXC_OPERATOR)
-        {
-            // TODO: use OP_MOVI if possible
-            writeins(cs, INS_OAY(OP_MOV,cs->next_register, (l-1) << 1));
-            cs->next_register += 1;
-        }
+        name = cs->cl;
+        consume(cs, LEX_IDENTIFIER);
 
-        advance(cs);
-    }
-    else
-    {
-        error(cs, "variable '%.*s' not defined", cs->cl->size, cs->cl->ptr);
-        es_arrpushv(u32, cs->operand_stack, 1); // 1 == k0
-        advance(cs);
+        if(cs->cl->type != LEX_DOT) break;
+
+        u32 dest = cs->next_register++;
+        emitabc(cs, OP_READS, dest, obj, fieldsite(cs, name));
+        obj = dest;
     }
+
+    u32 site = fieldsite(cs, name);
+
+    consume(cs, LEX_EQUAL);
+    expression(cs, PREC_OR);
+
+    u32 value = es_arrpop(cs->operand_stack);
+
+    emitabc(cs, OP_WRITES, obj, site, value);
 }
 
 
@@ -400,6 +1188,7 @@ static void block(cstate *cs)
     }
 
     size_t l = cs->locals.size;
+    size_t c = cs->consts.size;
 
     while(true)
     {
@@ -426,6 +1215,7 @@ static void block(cstate *cs)
         error(cs, "unexpected indent");
 
     cs->locals.size = l;
+    cs->consts.size = c;
     es_arrpop(cs->indent_stack);
 }
 
@@ -445,17 +1235,40 @@ static void assignment(cstate *cs)
     for(;; ++ids)
     {
         int r = local_lookup(cs, ids->ptr, ids->size);
+        i64 g = r ? -1 : es_find_global(cs->es, ids->ptr, ids->size);
 
-        if(!r) error(cs, "variable '%.*s' not defined", ids->size, ids->ptr);
+        if(!r && const_lookup(cs, ids->ptr, ids->size))
+            error(cs, "can't assign to const '%.*s'", ids->size, ids->ptr);
+        else if(!r && g < 0)
+            error(cs, "variable '%.*s' not defined", ids->size, ids->ptr);
+
+        // register the value ended up in, r+1
+        int v = r;
 
         if(r1 >= 0) // single expression
         {
-            writeins(cs, INS_OAY(OP_MOV, r - 1, (r1 - 1) << 1));
+            if(r) emitay(cs, OP_MOV, r - 1, (r1 - 1) << 1);
+            else  emitay(cs, OP_SETG, r1 - 1, g);
+        }
+        else if(r)
+        {
+            expression(cs, PREC_OR);
+            retarget(cs, r - 1);
         }
         else
         {
             expression(cs, PREC_OR);
-            SETA(es_arrback(cs->program), r - 1);
+
+            u32 operand = es_arrpop(cs->operand_stack);
+
+            if(ISK(operand))
+            {
+                place(cs, operand, cs->next_register);
+                operand = cs->next_register++ << 1;
+            }
+
+            v = (int)(operand >> 1) + 1;
+            emitay(cs, OP_SETG, operand >> 1, g);
         }
 
         ids += 1;
@@ -463,7 +1276,7 @@ static void assignment(cstate *cs)
         if((r1 >= 0 && ids->type == LEX_COMMA) || (first && ids->type == LEX_COMMA && cs->cl->type != LEX_COMMA))
         {
             first = 0;
-            r1 = r;
+            if(r1 < 0) r1 = v;
             continue;
         }
         else if(r1 < 0 && cs->cl->type == LEX_COMMA && ids->type == LEX_COMMA)
@@ -497,13 +1310,16 @@ static int localvar(cstate *cs, bool gen)
 
     for(;;++ids)
     {
-        if(cs->panic || local_lookup(cs, ids->ptr, ids->size))
+        if(cs->panic || local_lookup(cs, ids->ptr, ids->size) || const_lookup(cs, ids->ptr, ids->size))
         {
             error(cs, "variable '%.*s' redeclaration", ids->size, ids->ptr);
         }
+        else if(!es_arrpush(str, cs->locals))
+        {
+            error(cs, "out of memory");
+        }
         else
         {
-            es_arrpush(str, cs->locals);
             es_arrback(cs->locals).c = ids->ptr;
             es_arrback(cs->locals).s = ids->size;
             newvars++;
@@ -523,13 +1339,163 @@ static int localvar(cstate *cs, bool gen)
         while(cs->cl != ids) advance(cs);
         if(!gen) return newvars;
         for(;newvars > 0 ; --newvars)
-            writeins(cs, INS_OAY(OP_MOVI, cs->locals.size - newvars, 0));
+            emitay(cs, OP_MOVI, cs->locals.size - newvars, 0);
     }
 
     return newvars;
 }
 
 
+//*************************************************************************
+static void constdecl(cstate *cs)
+{
+    // const a, b = 1, a * 2 : names for values known at compile time, uses
+    // become the constant itself, nothing is stored or run
+
+    consume(cs, LEX_CONST);
+
+    es_lexeme *ids = cs->cl;
+    size_t count = 0;
+
+    for(;;)
+    {
+        consume(cs, LEX_IDENTIFIER);
+        ++count;
+
+        if(cs->cl->type != LEX_COMMA) break;
+        advance(cs);
+    }
+
+    consume(cs, LEX_EQUAL);
+
+    for(size_t n = 0;; ++n)
+    {
+        // anything emitted evaluating it goes, only the folded value is kept
+        size_t size = cs->program.size;
+        u32 next = cs->next_register;
+
+        expression(cs, PREC_OR);
+
+        u32 value = es_arrpop(cs->operand_stack);
+
+        cs->program.size = size;
+        cs->next_register = next;
+
+        if(n >= count)
+        {
+            error(cs, "assignment has too many expressions");
+            break;
+        }
+
+        es_lexeme *id = ids + 2 * n;
+
+        if(!ISK(value))
+            error(cs, "const '%.*s' must be a constant expression", id->size, id->ptr);
+        else if(local_lookup(cs, id->ptr, id->size) || const_lookup(cs, id->ptr, id->size) || es_find_global(cs->es, id->ptr, id->size) >= 0)
+            error(cs, "const '%.*s' redeclaration", id->size, id->ptr);
+        else if(!es_arrpush(kname, cs->consts))
+            error(cs, "out of memory");
+        else
+        {
+            es_arrback(cs->consts).name.c = id->ptr;
+            es_arrback(cs->consts).name.s = id->size;
+            es_arrback(cs->consts).k      = value >> 1;
+        }
+
+        if(cs->cl->type != LEX_COMMA)
+        {
+            if(n + 1 < count) error(cs, "assignment has too few expressions");
+            break;
+        }
+
+        advance(cs);
+    }
+}
+
+
+//*************************************************************************
+static u32 rebase(int type, u32 v, u32 r)
+{
+    // an operand of an inlined instruction, registers move up to where
+    // the call's frame would have started
+    if(type == ARGT_R)  return v + r;
+    if(type == ARGT_OR) return v ? v + r : 0;
+    if(type == ARGT_RK && !ISK(v)) return v + (r << 1);
+    return v;
+}
+
+
+//*************************************************************************
+static int inlined(cstate *cs, u64 f, u32 r, int args)
+{
+    // a short function that calls nothing and doesn't branch is copied
+    // in place of the call. its registers start at r like its frame would
+    // so the values it returns end up where ret leaves them, returns 0 if
+    // it has to be called instead
+
+    const size_t limit = 8;
+
+    es_function *fn = cs->es->funcs.data + f;
+
+    if(fn->cfunc || args != fn->params) return 0;
+    if(r + fn->maxregs > (1u << ASIZE)) return 0;
+    if(cs->fieldcaches.size + fn->fieldcount > (1u << BSIZE)) return 0;
+
+    // functions of this chunk have no ip yet, the last one is still
+    // being compiled
+    const es_instruction *code = fn->ip;
+    if(!code && f >= cs->funcstart && f + 1 < cs->es->funcs.size)
+        code = cs->program.data + cs->func_offsets.data[f - cs->funcstart];
+    if(!code) return 0;
+
+    size_t n = 0;
+    for(; n < fn->size && O(code[n]) != OP_RET; ++n)
+    {
+        es_opcode op = (es_opcode) O(code[n]);
+        if(n == limit || op == OP_CALL || op == OP_JMP || !es_get_opinfo(op)) return 0;
+    }
+
+    // a mismatched ret is a runtime error, the call keeps it
+    if(n == fn->size || X(code[n]) != (u64) fn->returns) return 0;
+
+    // reads and writes bring their caches along
+    u32 caches = (u32) cs->fieldcaches.size;
+    for(size_t i = 0; i < fn->fieldcount; ++i)
+    {
+        if(!es_arrpush(es_fieldcache, cs->fieldcaches))
+        {
+            error(cs, "out of memory");
+            return 0;
+        }
+
+        es_arrback(cs->fieldcaches).shape = NULL;
+        es_arrback(cs->fieldcaches).slot  = 0;
+        es_arrback(cs->fieldcaches).name  = fn->fieldcaches[i].name;
+    }
+
+    for(size_t i = 0; i < n; ++i)
+    {
+        es_instruction in = code[i];
+        es_opcode op = (es_opcode) O(in);
+
+        if(OPSIG(op) == SIG_ABC)
+        {
+            u32 b = (u32) B(in) + (op == OP_WRITES ? caches : 0);
+            u32 c = (u32) C(in) + (op == OP_READS ? caches : 0);
+            writeins(cs, INS_OABC(op, rebase(ATYPE(op), A(in), r), rebase(BTYPE(op), b, r), rebase(CTYPE(op), c, r)));
+        }
+        else if(OPSIG(op) == SIG_AY)
+            writeins(cs, INS_OAY(op, rebase(ATYPE(op), A(in), r), rebase(YTYPE(op), Y(in), r)));
+        else
+            writeins(cs, in);
+    }
+
+    if(fn->maxregs > 0) usereg(cs, ARGT_R, r + fn->maxregs - 1);
+
+    return 1;
+}
+
+
 //*************************************************************************
 static void funccall(cstate *cs)
 {
@@ -539,12 +1505,14 @@ static void funccall(cstate *cs)
     consume(cs, LEX_OPEN_PAREN);
 
     u32 r = cs->next_register;
+    int args = 0;
 
     // push params
     if(cs->cl->type != LEX_CLOSE_PAREN)
         while(true)
         {
             expression(cs, PREC_OR);
+            ++args;
             if(cs->cl->type == LEX_COMMA)
             {
                 advance(cs);
@@ -569,7 +1537,10 @@ static void funccall(cstate *cs)
     if(f == -1)
         error(cs, "function does not exist, '%.*s'", fname->size, fname->ptr);
 
-    writeins(cs, INS_OAY(OP_CALL, r, f));
+    // arguments have to be in r, r+1, ... for the callee's registers to
+    // line up with them
+    if(f == -1 || cs->next_register != r + args || !inlined(cs, f, r, args))
+        emitay(cs, OP_CALL, r, f);
     es_arrpushv(u32, cs->operand_stack, r << 1);
     cs->next_register = r + 1;
 }
@@ -589,7 +1560,7 @@ static void return_stmt(cstate *cs)
     else for(;;)
     {
         expression(cs, PREC_OR);
-        SETA(es_arrback(cs->program), r);
+        retarget(cs, r);
         ++r;
 
         if(cs->cl->type == LEX_COMMA)
@@ -600,7 +1571,7 @@ static void return_stmt(cstate *cs)
         else break;
     }
 
-    writeins(cs, INS_OX(OP_RET, r));
+    emitx(cs, OP_RET, r);
     es_arrback(cs->es->funcs).returns = r;
 }
 
@@ -615,6 +1586,14 @@ static void if_stmt(cstate *cs)
     //if(!cs->boolean)
         //error(cs, "if condition must evaluate to bool");
 
+    // the jmp tests a register
+    u32 cond = es_arrpop(cs->operand_stack);
+    if(ISK(cond))
+    {
+        place(cs, cond, cs->next_register);
+        cond = cs->next_register++ << 1;
+    }
+
     size_t jmp = cs->program.size;
     writeins(cs,0);
 
@@ -626,7 +1605,9 @@ static void if_stmt(cstate *cs)
 
     // else if 's
 
-    cs->program.data[jmp] = INS_OAY(OP_JMP, false, cs->program.size - jmp - 1);
+    checkarg(cs, ARGT_OR, (cond >> 1) + 1, ASIZE);
+    checkarg(cs, ARGT_SI, (i64)(cs->program.size - jmp - 1), YSIZE);
+    cs->program.data[jmp] = INS_OAY(OP_JMP, (cond >> 1) + 1, cs->program.size - jmp - 1);
 }
 
 
@@ -670,10 +1651,18 @@ static void statement(cstate *cs)
         localvar(cs, true);
         break;
 
+    case LEX_CONST:
+        constdecl(cs);
+        break;
+
     case LEX_IDENTIFIER:
         // assignment or function call
         if(peek(cs)->type == LEX_OPEN_PAREN)
             funccall(cs);
+        else if(peek(cs)->type == LEX_OPEN_SQUARE)
+            elemassignment(cs);
+        else if(peek(cs)->type == LEX_DOT)
+            fieldassignment(cs);
         else
             assignment(cs);
         break;
@@ -703,6 +1692,22 @@ static void statement(cstate *cs)
 }
 
 
+//*************************************************************************
+static void optimize(cstate *cs, size_t start)
+{
+    // the function's code from 'start', through the ir and back
+    es_irfunc ir;
+
+    if(es_ir_build(&ir, cs->es, cs->program.data + start, cs->program.size - start))
+    {
+        if(es_ir_optimize(&ir) > 0)
+            cs->program.size = start + es_ir_lower(&ir, cs->program.data + start);
+    }
+
+    es_ir_destroy(&ir);
+}
+
+
 //*************************************************************************
 static void funcdecl(cstate *cs)
 {
@@ -713,6 +1718,7 @@ static void funcdecl(cstate *cs)
     consume(cs, LEX_IDENTIFIER);
 
     es_arrclear(cs->locals);
+    es_arrclear(cs->fieldcaches);
 
     //int params = funcparamlist(cs);
     consume(cs, LEX_OPEN_PAREN);
@@ -725,24 +1731,202 @@ static void funcdecl(cstate *cs)
 
     consume(cs, LEX_CLOSE_PAREN);
 
+    cs->maxregs = (u32) cs->locals.size;
+
     //es_add_func(cs->es, fname->ptr, fname->size, 0, cs->program.data + cs->program.size);
-    es_arrpushv(u64, cs->func_offsets, cs->program.size);
+    char *name = (char*) es_malloc(&cs->es->alloc, fname->size + 1);
+
+    if(!name || !es_arrpushv(u64, cs->func_offsets, cs->program.size) || !es_arrpush(es_function, cs->es->funcs))
+    {
+        es_free(&cs->es->alloc, name, fname->size + 1);
+        error(cs, "out of memory");
+        return;
+    }
 
-    es_arrpush(es_function, cs->es->funcs);
     es_arrback(cs->es->funcs).ip       = NULL;
-    es_arrback(cs->es->funcs).name     = malloc(fname->size + 1);
+    es_arrback(cs->es->funcs).name     = name;
     es_arrback(cs->es->funcs).params   = params;
     es_arrback(cs->es->funcs).returns  = 0;
     es_arrback(cs->es->funcs).size     = cs->program.size;
+    es_arrback(cs->es->funcs).cfunc    = NULL;
+    es_arrback(cs->es->funcs).maxregs  = 0;
+    es_arrback(cs->es->funcs).fieldcaches = NULL;
+    es_arrback(cs->es->funcs).fieldcount  = 0;
 
     memcpy(es_arrback(cs->es->funcs).name, fname->ptr, fname->size);
     es_arrback(cs->es->funcs).name[fname->size] = '\0';
 
     block(cs);
 
-    writeins(cs, INS_OX(OP_RET, 0));
+    emitx(cs, OP_RET, 0);
+
+    es_function *f = &es_arrback(cs->es->funcs);
+
+    // calls to itself need the frame size
+    f->maxregs = cs->maxregs;
+
+    if(cs->errcount == 0)
+        optimize(cs, f->size);
+
+    f->size = cs->program.size - f->size;
+
+    // parameters and locals end with the body, module scope has none
+    es_arrclear(cs->locals);
+
+    if(cs->fieldcaches.size > 0)
+    {
+        size_t bytes = cs->fieldcaches.size * sizeof(es_fieldcache);
+
+        f->fieldcaches = (es_fieldcache*) es_malloc(&cs->es->alloc, bytes);
+        if(!f->fieldcaches)
+        {
+            error(cs, "out of memory");
+            return;
+        }
+
+        memcpy(f->fieldcaches, cs->fieldcaches.data, bytes);
+        f->fieldcount = cs->fieldcaches.size;
+    }
+}
+
+
+//*************************************************************************
+static void globaldecl(cstate *cs)
+{
+    // var a, b = 1, K * 2 : slots are given out here, initializers must
+    // fold to constants and are stored as they're compiled, the rest start nil
+
+    consume(cs, LEX_VAR);
+
+    u32_arr slots;
+    es_construct_array(u32, slots, &cs->es->alloc);
+
+    for(;;)
+    {
+        if(es_find_global(cs->es, cs->cl->ptr, cs->cl->size) >= 0 || const_lookup(cs, cs->cl->ptr, cs->cl->size))
+            error(cs, "global '%.*s' redeclaration", cs->cl->size, cs->cl->ptr);
+        else if(cs->es->globals.size >= (1u << YSIZE))
+            error(cs, "too many globals");
+        else if(cs->cl->type == LEX_IDENTIFIER)
+        {
+            i64 g = es_register_global(cs->es, cs->cl->ptr, cs->cl->size);
+
+            if(g < 0 || !es_arrpushv(u32, slots, (u32) g))
+                error(cs, "out of memory");
+        }
+
+        consume(cs, LEX_IDENTIFIER);
+
+        if(cs->cl->type != LEX_COMMA) break;
+        advance(cs);
+    }
+
+    if(cs->cl->type == LEX_EQUAL)
+    {
+        advance(cs);
+
+        size_t n = 0;
+
+        for(;;)
+        {
+            // folded like a const, anything emitted on the way goes
+            size_t size = cs->program.size;
+            u32 next = cs->next_register;
+
+            expression(cs, PREC_OR);
+
+            u32 value = es_arrpop(cs->operand_stack);
+
+            cs->program.size = size;
+            cs->next_register = next;
+
+            es_value *k = kvalue(cs, value);
+
+            if(!k)
+                error(cs, "global initializer must be a constant");
+            else if(n < slots.size)
+                es_copy_value(cs->es->globals.data + slots.data[n], k);
+
+            ++n;
+
+            if(cs->cl->type != LEX_COMMA) break;
+            advance(cs);
+        }
+
+        if(n > slots.size)
+            error(cs, "assignment has too many expressions");
+        else if(n < slots.size)
+            error(cs, "assignment has too few expressions");
+    }
+
+    es_destroy_array(u32, slots);
+}
+
+
+//*************************************************************************
+static void structdecl(cstate *cs)
+{
+    // struct Name followed by its field names, on the same line or
+    // on the indented lines below, fields get slots in the order listed
+
+    int errcount = cs->errcount;
+
+    consume(cs, LEX_STRUCT);
+
+    es_lexeme *sname = cs->cl;
+
+    consume(cs, LEX_IDENTIFIER);
+
+    if(es_find_shape(cs->es, sname->ptr, sname->size))
+        error(cs, "struct '%.*s' redeclaration", sname->size, sname->ptr);
+
+    if(cs->es->shapes.size >= (1u << BSIZE))
+        error(cs, "too many struct types");
+
+    str_arr names;
+    es_construct_array(str, names, &cs->es->alloc);
+
+    for(;;)
+    {
+        if(cs->cl->type == LEX_COMMA || cs->cl->type == LEX_NEWLINE)
+        {
+            advance(cs);
+            continue;
+        }
+
+        if(cs->cl->type != LEX_IDENTIFIER) break;
+
+        // back at the enclosing indent, the next declaration
+        if(cs->cl->line != sname->line && cs->cl->indent <= es_arrback(cs->indent_stack))
+            break;
+
+        for(size_t n = 0; n < names.size; ++n)
+            if(names.data[n].s == cs->cl->size && strncmp(names.data[n].c, cs->cl->ptr, cs->cl->size) == 0)
+                error(cs, "field '%.*s' redeclaration", cs->cl->size, cs->cl->ptr);
+
+        if(!es_arrpush(str, names))
+            error(cs, "out of memory");
+        else
+        {
+            es_arrback(names).c = cs->cl->ptr;
+            es_arrback(names).s = cs->cl->size;
+        }
+
+        advance(cs);
+    }
 
-    es_arrback(cs->es->funcs).size = cs->program.size - es_arrback(cs->es->funcs).size;
+    u32_arr fields;
+    es_construct_array(u32, fields, &cs->es->alloc);
+
+    for(size_t n = 0; n < names.size; ++n)
+        if(!es_arrpushv(u32, fields, (u32) checkk(cs, es_addk_string(cs->es, names.data[n].c, names.data[n].s))))
+            error(cs, "out of memory");
+
+    if(cs->errcount == errcount && !es_register_shape(cs->es, sname->ptr, sname->size, fields.data, (u32) fields.size))
+        error(cs, "out of memory");
+
+    es_destroy_array(u32, fields);
+    es_destroy_array(str, names);
 }
 
 
@@ -758,16 +1942,16 @@ static void declaration(cstate *cs)
         return;
 
     case LEX_VAR:
-        error(cs, "globals not yet supported :(");
-        break;
+        globaldecl(cs);
+        return;
 
     case LEX_CONST:
-        error(cs, "consts not yet supported :(");
-        break;
+        constdecl(cs);
+        return;
 
     case LEX_STRUCT:
-        error(cs, "structs not yet supported :(");
-        break;
+        structdecl(cs);
+        return;
 
     default:
         error(cs, "expected declaration");
@@ -784,40 +1968,58 @@ int es_compile(es_state *es, const char *source, size_t ssize)
 {
     cstate cs;
 
-    es_construct_array(es_instruction, cs.program);
-    es_construct_array(es_lexeme, cs.lexemes);
-    es_construct_array(u32, cs.operand_stack);
-    es_construct_array(u32, cs.indent_stack);
-    es_construct_array(u64, cs.func_offsets);
-    es_construct_array(str, cs.locals);
+    es_construct_array(es_instruction, cs.program, &es->alloc);
+    es_construct_array(es_lexeme, cs.lexemes, &es->alloc);
+    es_construct_sarray(u32, cs.operand_stack, &es->alloc);
+    es_construct_sarray(u32, cs.indent_stack, &es->alloc);
+    es_construct_array(u64, cs.func_offsets, &es->alloc);
+    es_construct_array(str, cs.locals, &es->alloc);
+    es_construct_array(kname, cs.consts, &es->alloc);
+    es_construct_array(es_fieldcache, cs.fieldcaches, &es->alloc);
 
     size_t funcstart = es->funcs.size;
 
     cs.es = es;
     cs.next_register = 0;
+    cs.funcstart = funcstart;
 
     cs.errcount = 0;
     cs.panic = 0;
 
-    es_lex(source, ssize, &cs.lexemes);
-
-    es_arrpushv(u32, cs.indent_stack, cs.lexemes.data->indent);
-
-    for(cs.cl = cs.lexemes.data; cs.cl->type != LEX_EOF;)
+    // the operand and indent stacks never get deeper than there are
+    // lexemes, sized for that they don't have to grow while parsing.
+    // roughly one instruction per lexeme, trimmed once compiled, past
+    // that a failed write leaves the last instruction to retarget
+    if(es_lex(source, ssize, &cs.lexemes) != 0
+        || !es_arrreserve(u32, cs.operand_stack, cs.lexemes.size)
+        || !es_arrreserve(u32, cs.indent_stack, cs.lexemes.size + 1)
+        || !es_arrreserve(es_instruction, cs.program, cs.lexemes.size))
+    {
+        printf("es error : out of memory\n");
+        cs.errcount = 1;
+    }
+    else
     {
-        if(cs.cl->type == LEX_NEWLINE)
+        es_arrpushv(u32, cs.indent_stack, cs.lexemes.data->indent);
+
+        for(cs.cl = cs.lexemes.data; cs.cl->type != LEX_EOF;)
         {
-            advance(&cs);
-            continue;
-        }
+            if(cs.cl->type == LEX_NEWLINE)
+            {
+                advance(&cs);
+                continue;
+            }
 
-        declaration(&cs);
+            declaration(&cs);
+        }
     }
 
     es_destroy_array(es_lexeme, cs.lexemes);
     es_destroy_array(u32, cs.operand_stack);
     es_destroy_array(u32, cs.indent_stack);
     es_destroy_array(str, cs.locals);
+    es_destroy_array(kname, cs.consts);
+    es_destroy_array(es_fieldcache, cs.fieldcaches);
 
     if(cs.errcount > 0)
     {
@@ -827,8 +2029,15 @@ int es_compile(es_state *es, const char *source, size_t ssize)
         return cs.errcount;
     }
 
-    // shrink to fit
-    cs.program.data = realloc(cs.program.data, cs.program.size * sizeof(es_instruction));
+    es_arrshrink(es_instruction, cs.program);
+
+    if(!es_arrpush(es_code, cs.es->codechunks))
+    {
+        printf("es error : out of memory\n");
+        es_destroy_array(es_instruction, cs.program);
+        es_destroy_array(u64, cs.func_offsets);
+        return 1;
+    }
 
     for(size_t i = funcstart; i < es->funcs.size; ++i)
     {
@@ -837,9 +2046,10 @@ int es_compile(es_state *es, const char *source, size_t ssize)
 
     es_destroy_array(u64, cs.func_offsets);
 
-    es_arrpush(es_code, cs.es->codechunks);
     es_arrback(cs.es->codechunks).instructions = cs.program.data;
     es_arrback(cs.es->codechunks).size = cs.program.size;
 
+    es_peephole(cs.es, &es_arrback(cs.es->codechunks), &cs.es->peepstats);
+
     return cs.errcount;
 }
\ No newline at end of file
@@ -15,11 +15,11 @@
 #define writearg(a) \
     switch(GET##a##TYPE(inf))\
     {\
-    case ARGT_R:   write(" r%lli",  a##(i));                 pad break;\
-    case ARGT_K:   write(" k%lli",  a##(i));                 pad break;\
+    case ARGT_R:   write(" r%lli",  a(i));                 pad break;\
+    case ARGT_K:   write(" k%lli",  a(i));                 pad break;\
     case ARGT_OR:  write(" %s%lli", a##ORPRE(i), a##OR(i));  pad break;\
     case ARGT_RK:  write(" %s%lli", a##RKPRE(i), a##RK(i));  pad break;\
-    case ARGT_I:   write(" %lli",   a##(i));                 pad break;\
+    case ARGT_I:   write(" %lli",   a(i));                 pad break;\
     case ARGT_SI:  write(" %lli",   a##S(i));                pad break;\
     }
 
@@ -0,0 +1,192 @@
+#include "estring.h"
+#include "gc.h"
+
+
+//*************************************************************************
+int es_construct_string(es_string *str, const char *init, size_t size)
+{
+    str->capacity = size + 1;
+    str->size = size;
+    str->data = (char*) es_malloc(str->obj.alloc, str->capacity);
+    str->parent = NULL;
+
+    // left empty, still safe to destroy
+    if(!str->data)
+    {
+        str->capacity = 0;
+        str->size = 0;
+        return 0;
+    }
+
+    memcpy(str->data, init, size);
+    str->data[size] = '\0';
+    return 1;
+}
+
+
+//*************************************************************************
+void es_construct_substring(es_string *str, es_string *parent, size_t offset, size_t size)
+{
+    if(offset > parent->size) offset = parent->size;
+    if(size > parent->size - offset) size = parent->size - offset;
+
+    str->data = parent->data + offset;
+    str->size = size;
+    str->capacity = 0;
+
+    // always reference the string owning the buffer, which
+    // can no longer be appended to in place
+    str->parent = (parent->parent) ? parent->parent : parent;
+    str->parent->obj.shared = 1;
+    es_gc_barrier(&str->obj, &str->parent->obj);
+}
+
+
+//*************************************************************************
+void es_destroy_string(es_string *str)
+{
+    // substrings don't own their buffer, the parent is collected on its own
+    if(!str->parent) es_free(str->obj.alloc, str->data, str->capacity);
+
+    str->capacity = 0;
+    str->size = 0;
+    str->data = NULL;
+    str->parent = NULL;
+}
+
+
+//*************************************************************************
+static void materialize(es_string *str, size_t capacity)
+{
+    if(capacity < str->size + 1) capacity = str->size + 1;
+
+    char* ptr = (char*) es_malloc(str->obj.alloc, capacity);
+    if(!ptr) return;
+
+    memcpy(ptr, str->data, str->size);
+    ptr[str->size] = '\0';
+
+    str->parent = NULL;
+    str->data = ptr;
+    str->capacity = capacity;
+}
+
+
+//*************************************************************************
+const char *es_strcstr(es_string *str)
+{
+    if(str->parent) materialize(str, str->size + 1);
+    return str->data;
+}
+
+
+//*************************************************************************
+void es_copy_string(es_string *dest, es_string *src)
+{
+    if(dest == src) return;
+
+    dest->size = 0;
+    es_strappendn(dest, src->data, src->size);
+}
+
+
+//*************************************************************************
+int es_cmp_strings(es_string *l, es_string *r)
+{
+    // substrings aren't null terminated, compare by size
+    size_t size = (l->size < r->size) ? l->size : r->size;
+
+    int cmp = memcmp(l->data, r->data, size);
+
+    if(cmp == 0 && l->size != r->size)
+        return (l->size > r->size)*2 - 1;
+    else return cmp;
+}
+
+//*************************************************************************
+void es_strreserve(es_string *str, size_t capacity)
+{
+    if(str->parent)
+    {
+        materialize(str, capacity);
+        return;
+    }
+
+    if(capacity <= str->capacity) return;
+
+    size_t newcap = str->capacity * 2;
+    if(newcap < capacity) newcap = capacity;
+
+    char* ptr = es_realloc(str->obj.alloc, str->data, str->capacity, newcap);
+    if(!ptr) return;
+
+    str->data = ptr;
+    str->capacity = newcap;
+}
+
+
+//*************************************************************************
+void es_strappendn(es_string *str, const char *s, size_t size)
+{
+    // 's' may point into 'str', remember where before reallocating
+    size_t extent = (str->parent) ? str->size : str->capacity;
+    int alias = s >= str->data && s < str->data + extent;
+    size_t offset = alias ? (size_t)(s - str->data) : 0;
+
+    es_strreserve(str, str->size + size + 1);
+    if(str->size + size + 1 > str->capacity) return;
+
+    if(alias) s = str->data + offset;
+
+    memmove(str->data + str->size, s, size);
+    str->size += size;
+    str->data[str->size] = '\0';
+}
+
+
+//*************************************************************************
+void es_strappend(es_string *str, const es_string *other)
+{
+    es_strappendn(str, other->data, other->size);
+}
+
+
+//*************************************************************************
+es_string *es_strconcatn(es_allocator *alloc, const es_string **strs, size_t count)
+{
+    size_t size = 0;
+    for(size_t i = 0; i < count; ++i)
+        size += strs[i]->size;
+
+    es_string *str = (es_string*) ES_ALLOCATE_OBJ(alloc, es_string, ES_STRING);
+    if(!str) return NULL;
+
+    str->capacity = size + 1;
+    str->size = 0;
+    str->data = (char*) es_malloc(alloc, str->capacity);
+    str->parent = NULL;
+
+    // object is already known to the collector, leave it empty for it
+    if(!str->data)
+    {
+        str->capacity = 0;
+        return NULL;
+    }
+
+    for(size_t i = 0; i < count; ++i)
+    {
+        memcpy(str->data + str->size, strs[i]->data, strs[i]->size);
+        str->size += strs[i]->size;
+    }
+
+    str->data[size] = '\0';
+    return str;
+}
+
+
+//*************************************************************************
+es_string *es_strconcat(es_allocator *alloc, const es_string *l, const es_string *r)
+{
+    const es_string *strs[2] = {l, r};
+    return es_strconcatn(alloc, strs, 2);
+}
@@ -0,0 +1,59 @@
+/********************************************************************************
+ * \file estring.h
+ * \author Patrick Torgeson (torgersonpatricks@gmail.com)
+ * \brief
+ * \version 0.1
+ * \date 2022-01-05
+ *
+ * @copyright Copyright (c) 2022
+ *
+ ********************************************************************************/
+
+
+#ifndef ES_STRING_H
+#define ES_STRING_H
+
+
+#include "common.h"
+#include "object.h"
+
+
+typedef struct es_string_t
+{
+    es_object obj;
+
+    char* data;
+    size_t size;
+    size_t capacity;
+
+    // non NULL for substrings, data points into parent's
+    // buffer and is not null terminated, capacity is 0
+    struct es_string_t *parent;
+} es_string;
+
+
+#define AS_STRING(o) ((es_string*)(o->obj))
+
+
+// 0 when the buffer couldn't be allocated, 'str' is then empty
+int  es_construct_string(es_string *str, const char *init, size_t size);
+void es_construct_substring(es_string *str, es_string *parent, size_t offset, size_t size);
+void es_destroy_string(es_string *str);
+void es_copy_string(es_string *dest, es_string *src);
+
+// materializes substrings, returns a null terminated buffer
+const char *es_strcstr(es_string *str);
+
+int es_cmp_strings(es_string *l, es_string *r);
+
+// growth is geometric, repeated appends to the same string are amortized O(1)
+void es_strreserve(es_string *str, size_t capacity);
+void es_strappend(es_string *str, const es_string *other);
+void es_strappendn(es_string *str, const char *s, size_t size);
+
+// result is allocated once, sized to fit all operands exactly
+es_string *es_strconcat(es_allocator *alloc, const es_string *l, const es_string *r);
+es_string *es_strconcatn(es_allocator *alloc, const es_string **strs, size_t count);
+
+
+#endif
\ No newline at end of file
@@ -0,0 +1,301 @@
+#include "gc.h"
+#include "estring.h"
+#include "numarray.h"
+#include "map.h"
+#include "struct.h"
+
+
+#define GC_MINTHRESHOLD (64u * 1024u)
+
+#define otherwhite(gc) ((gc)->white ^ 1)
+#define iswhite(o)     ((o)->mark <= GC_WHITE1)
+
+
+//*************************************************************************
+void es_construct_gc(es_gc *gc, es_allocator *alloc, es_markroots_fn markroots, void *ud)
+{
+    gc->objects = NULL;
+    gc->sweep = NULL;
+    es_construct_array(es_objptr, gc->gray, alloc);
+
+    gc->white = GC_WHITE0;
+    gc->phase = GC_PAUSE;
+
+    gc->alloc = alloc;
+    gc->markroots = markroots;
+    gc->ud = ud;
+
+    gc->pause    = 200u;
+    gc->stepsize = 8u * 1024u;
+    gc->stepwork = 64u;
+
+    gc->threshold = GC_MINTHRESHOLD;
+    gc->nextstep  = gc->stepsize;
+    gc->debt      = 0;
+
+    memset(&gc->stats, 0, sizeof(es_gcstats));
+
+    alloc->gc = gc;
+}
+
+
+//*************************************************************************
+static size_t objsize(es_object *o)
+{
+    switch(o->type)
+    {
+    case ES_STRING: return sizeof(es_string);
+    case ES_ARRAY:  return sizeof(es_numarray);
+    case ES_MAP:    return sizeof(es_mapobject);
+    case ES_STRUCT: return ES_STRUCT_SIZE(((es_structobject*) o)->shape);
+    default:
+        printf("\n\n  >  gc unknown object type!\n\n");
+        exit(-1);
+    }
+
+    return 0;
+}
+
+
+//*************************************************************************
+static void freeobject(es_object *o)
+{
+    switch(o->type)
+    {
+    case ES_STRING:
+        es_destroy_string((es_string*) o);
+        break;
+    case ES_ARRAY:
+        es_destroy_numarray((es_numarray*) o);
+        break;
+    case ES_MAP:
+        es_destroy_map(&((es_mapobject*) o)->map);
+        break;
+    }
+
+    es_free_object(o, objsize(o));
+}
+
+
+//*************************************************************************
+void es_destroy_gc(es_gc *gc)
+{
+    while(gc->objects)
+    {
+        es_object *next = gc->objects->next;
+        freeobject(gc->objects);
+        gc->objects = next;
+    }
+
+    es_destroy_array(es_objptr, gc->gray);
+    gc->alloc->gc = NULL;
+}
+
+
+//*************************************************************************
+es_object *es_allocate_object(es_allocator *alloc, size_t size, u8 type)
+{
+    es_gc *gc = alloc->gc;
+
+    // step before allocating, the new object is colored for the phase
+    // the collector is left in and can't be swept before it's rooted
+    if(gc && (alloc->live >= gc->nextstep || gc->debt * 2 >= gc->stepwork))
+        es_gc_step(gc);
+
+    es_object *obj = (es_object*) es_pool_alloc(alloc, size);
+    if(!obj) return NULL;
+
+    obj->alloc = alloc;
+    obj->type = type;
+    obj->shared = 0;
+    obj->next = NULL;
+    obj->mark = GC_WHITE0;
+
+    if(gc)
+    {
+        gc->debt += 1;
+        obj->mark = (gc->phase == GC_PROPAGATE) ? GC_BLACK : gc->white;
+        obj->next = gc->objects;
+        gc->objects = obj;
+    }
+
+    return obj;
+}
+
+
+//*************************************************************************
+void es_free_object(es_object *obj, size_t size)
+{
+    es_pool_free(obj->alloc, obj, size);
+}
+
+
+//*************************************************************************
+static void traverse(es_gc *gc, es_object *o);
+
+
+//*************************************************************************
+void es_gc_markobject(es_gc *gc, es_object *o)
+{
+    if(!iswhite(o)) return;
+
+    // without room on the gray list it's traversed right away
+    o->mark = GC_GRAY;
+    if(!es_arrpushv(es_objptr, gc->gray, o))
+        traverse(gc, o);
+}
+
+
+//*************************************************************************
+void es_gc_markvalue(es_gc *gc, es_value *v)
+{
+    if(v->tid >= ES_STRUCT && v->obj)
+        es_gc_markobject(gc, v->obj);
+}
+
+
+//*************************************************************************
+void es_gc_barrier(es_object *container, es_object *child)
+{
+    es_gc *gc = container->alloc->gc;
+
+    // backward barrier, container is traversed again
+    if(gc && gc->phase == GC_PROPAGATE && container->mark == GC_BLACK && iswhite(child))
+    {
+        container->mark = GC_GRAY;
+        if(!es_arrpushv(es_objptr, gc->gray, container))
+            traverse(gc, container);
+    }
+}
+
+
+//*************************************************************************
+static void traverse(es_gc *gc, es_object *o)
+{
+    o->mark = GC_BLACK;
+    gc->stats.marked += 1;
+
+    switch(o->type)
+    {
+    case ES_STRING:
+        if(((es_string*) o)->parent)
+            es_gc_markobject(gc, &((es_string*) o)->parent->obj);
+        break;
+    case ES_MAP:
+    {
+        es_map *map = &((es_mapobject*) o)->map;
+        es_value key, *value;
+        for(size_t i = 0; (value = es_mapnext(map, &i, &key)); )
+        {
+            es_gc_markvalue(gc, &key);
+            es_gc_markvalue(gc, value);
+        }
+        break;
+    }
+    case ES_STRUCT:
+    {
+        es_structobject *s = (es_structobject*) o;
+        for(u32 i = 0; i < s->shape->size; ++i)
+            es_gc_markvalue(gc, s->slots + i);
+        break;
+    }
+    }
+}
+
+
+//*************************************************************************
+static void atomic(es_gc *gc)
+{
+    // registers change without barriers, mark them again
+    gc->markroots(gc, gc->ud);
+
+    while(gc->gray.size > 0)
+        traverse(gc, es_arrpop(gc->gray));
+
+    gc->white = otherwhite(gc);
+    gc->sweep = &gc->objects;
+    gc->phase = GC_SWEEP;
+}
+
+
+//*************************************************************************
+static void sweep(es_gc *gc)
+{
+    const u8 dead = otherwhite(gc);
+
+    for(size_t n = 0; n < gc->stepwork; ++n)
+    {
+        es_object *o = *gc->sweep;
+
+        if(!o)
+        {
+            gc->phase = GC_PAUSE;
+            gc->threshold = (gc->alloc->live / 100u) * gc->pause;
+            if(gc->threshold < GC_MINTHRESHOLD) gc->threshold = GC_MINTHRESHOLD;
+            gc->stats.cycles += 1;
+            return;
+        }
+
+        if(o->mark == dead)
+        {
+            *gc->sweep = o->next;
+            freeobject(o);
+            gc->stats.freed += 1;
+        }
+        else
+        {
+            o->mark = gc->white;
+            gc->sweep = &o->next;
+        }
+    }
+}
+
+
+//*************************************************************************
+void es_gc_step(es_gc *gc)
+{
+    clock_t start = clock();
+
+    switch(gc->phase)
+    {
+    case GC_PAUSE:
+        if(gc->alloc->live < gc->threshold) break;
+        gc->markroots(gc, gc->ud);
+        gc->phase = GC_PROPAGATE;
+        break;
+
+    case GC_PROPAGATE:
+        for(size_t n = 0; n < gc->stepwork && gc->gray.size > 0; ++n)
+            traverse(gc, es_arrpop(gc->gray));
+        if(gc->gray.size == 0)
+            atomic(gc);
+        break;
+
+    case GC_SWEEP:
+        sweep(gc);
+        break;
+    }
+
+    clock_t elapsed = clock() - start;
+
+    gc->stats.steps += 1;
+    gc->stats.total += elapsed;
+    if(elapsed > gc->stats.maxstep) gc->stats.maxstep = elapsed;
+
+    gc->nextstep = gc->alloc->live + gc->stepsize;
+    gc->debt = 0;
+}
+
+
+//*************************************************************************
+void es_gc_collect(es_gc *gc)
+{
+    // finish the cycle in progress, then run a complete one
+    while(gc->phase != GC_PAUSE)
+        es_gc_step(gc);
+
+    gc->threshold = 0;
+
+    do es_gc_step(gc);
+    while(gc->phase != GC_PAUSE);
+}
@@ -0,0 +1,113 @@
+/********************************************************************************
+ * \file gc.h
+ * \author Patrick Torgeson (torgersonpatricks@gmail.com)
+ * \brief
+ * \version 0.1
+ * \date 2022-01-18
+ *
+ * @copyright Copyright (c) 2022
+ *
+ ********************************************************************************/
+
+
+#ifndef ES_GC_H
+#define ES_GC_H
+
+
+#include <time.h>
+
+#include "common.h"
+#include "value.h"
+
+
+// incremental tri-color mark & sweep
+//
+//   pause     : waiting for live bytes to cross the threshold
+//   propagate : a bounded number of gray objects are traversed per step
+//   atomic    : roots are rescanned and the gray list drained, the only
+//               unbounded part of a cycle, proportional to the root set
+//   sweep     : a bounded number of objects are visited per step
+//
+// registers and constants are roots and need no barrier,
+// containers must call es_gc_barrier when storing an object
+
+
+typedef enum es_gcphase
+{
+    GC_PAUSE,
+    GC_PROPAGATE,
+    GC_SWEEP,
+} es_gcphase;
+
+
+// mark values, there are two whites that swap each cycle so
+// objects allocated durring a sweep aren't collected by it
+#define GC_WHITE0  0
+#define GC_WHITE1  1
+#define GC_GRAY    2
+#define GC_BLACK   3
+
+
+typedef es_object* es_objptr;
+es_array(es_objptr);
+
+
+typedef struct es_gcstats_t
+{
+    size_t cycles;
+    size_t steps;
+    size_t marked;     // objects traversed
+    size_t freed;      // objects collected
+    clock_t maxstep;   // longest single step
+    clock_t total;     // time spent in the collector
+} es_gcstats;
+
+
+struct es_gc_t;
+typedef void (*es_markroots_fn)(struct es_gc_t *gc, void *ud);
+
+
+typedef struct es_gc_t
+{
+    es_object *objects;
+    es_object **sweep;
+    es_objptr_arr gray;
+
+    u8 white;
+    u8 phase;
+
+    es_allocator *alloc;
+
+    es_markroots_fn markroots;
+    void *ud;
+
+    // tuning
+    size_t pause;      // percent of post-collection live bytes allowed before the next cycle
+    size_t stepsize;   // bytes allocated between steps
+    size_t stepwork;   // objects traversed or swept per step, a step is also
+                       // taken every stepwork/2 allocations to stay ahead
+
+    size_t threshold;
+    size_t nextstep;
+    size_t debt;       // objects allocated since the last step
+
+    es_gcstats stats;
+} es_gc;
+
+
+void es_construct_gc(es_gc *gc, es_allocator *alloc, es_markroots_fn markroots, void *ud);
+void es_destroy_gc(es_gc *gc);
+
+void es_gc_step(es_gc *gc);
+void es_gc_collect(es_gc *gc);
+
+void es_gc_markvalue(es_gc *gc, es_value *v);
+void es_gc_markobject(es_gc *gc, es_object *o);
+
+// call after storing a reference to 'child' in 'container'
+void es_gc_barrier(es_object *container, es_object *child);
+
+#define es_gc_barrierv(c,v) if((v)->tid >= ES_STRUCT && (v)->obj) es_gc_barrier((c),(v)->obj)
+
+
+#endif
@@ -0,0 +1,535 @@
+#include "hamt.h"
+#include "hash.h"
+#include "map.h"
+
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+
+
+// the node layout is champ, entries then children, each found by counting
+// the bits below its own in 'datamap' or 'nodemap'. nodes past the last
+// level have neither map and just 'count' entries that all share a hash
+
+struct es_hamt_node_t
+{
+    i32 refs;
+    u32 datamap;
+    u32 nodemap;
+    u32 count;
+};
+
+
+#define BITS     5u
+#define FRAG(h,s) ((u32)((h) >> (s)) & 31u)
+#define LEAF(s)  ((s) >= 64u)
+
+#define HASH(t,k) es_hash_value((k), (t)->seed)
+
+#if defined(_MSC_VER)
+#define RETAIN(n) _InterlockedIncrement((long volatile*) &(n)->refs)
+#define DROP(n)   _InterlockedDecrement((long volatile*) &(n)->refs)
+#else
+#define RETAIN(n) __atomic_add_fetch(&(n)->refs, 1, __ATOMIC_RELAXED)
+#define DROP(n)   __atomic_sub_fetch(&(n)->refs, 1, __ATOMIC_ACQ_REL)
+#endif
+
+
+// [[[[[[[[[[[[[[[[[[[[[[[[[[[[[[[[[[[ Nodes ]]]]]]]]]]]]]]]]]]]]]]]]]]]]]]]]]]]
+
+
+//*************************************************************************
+static u32 popcount(u32 x)
+{
+#if defined(_MSC_VER)
+    return __popcnt(x);
+#else
+    return (u32) __builtin_popcount(x);
+#endif
+}
+
+
+//*************************************************************************
+static u32 nchildren(es_hamt_node *n)
+{
+    return popcount(n->nodemap);
+}
+
+
+//*************************************************************************
+static es_map_node *entries(es_hamt_node *n)
+{
+    return (es_map_node*)(n + 1);
+}
+
+
+//*************************************************************************
+static es_hamt_node **children(es_hamt_node *n)
+{
+    return (es_hamt_node**)(entries(n) + n->count);
+}
+
+
+//*************************************************************************
+static size_t nodesize(u32 count, u32 nchild)
+{
+    return sizeof(es_hamt_node) + count * sizeof(es_map_node) + nchild * sizeof(es_hamt_node*);
+}
+
+
+//*************************************************************************
+static u32 below(u32 map, u32 bit)
+{
+    // the index of 'bit' among the set bits of 'map'
+    return popcount(map & (bit - 1));
+}
+
+
+//*************************************************************************
+static int keyequal(es_value *a, es_value *b)
+{
+    if(a->tid != b->tid) return 0;
+    if(a->u == b->u)     return 1;
+    if(a->tid != ES_STRING) return 0;
+    return es_cmp_strings(AS_STRING(a), AS_STRING(b)) == 0;
+}
+
+
+//*************************************************************************
+static es_hamt_node *newnode(es_allocator *alloc, u32 datamap, u32 nodemap, u32 count)
+{
+    es_hamt_node *n = es_malloc(alloc, nodesize(count, popcount(nodemap)));
+    if(!n) return NULL;
+
+    n->refs    = 1;
+    n->datamap = datamap;
+    n->nodemap = nodemap;
+    n->count   = count;
+
+    return n;
+}
+
+
+//*************************************************************************
+static void release(es_allocator *alloc, es_hamt_node *n)
+{
+    if(!n || DROP(n) != 0) return;
+
+    u32 nc = nchildren(n);
+    for(u32 i = 0; i < nc; ++i)
+        release(alloc, children(n)[i]);
+
+    es_free(alloc, n, nodesize(n->count, nc));
+}
+
+
+//*************************************************************************
+static void retainchildren(es_hamt_node *n, u32 skip)
+{
+    // the copy shares every child of 'n' except index 'skip'
+    u32 nc = nchildren(n);
+    for(u32 i = 0; i < nc; ++i)
+        if(i != skip) RETAIN(children(n)[i]);
+}
+
+
+//*************************************************************************
+static es_hamt_node *pair(es_hamt *t, es_map_node *a, u64 ha, es_map_node *b, u64 hb, u32 shift)
+{
+    // a subtrie holding two entries whose hashes agree below 'shift'
+
+    if(LEAF(shift))
+    {
+        es_hamt_node *n = newnode(t->alloc, 0, 0, 2);
+        if(!n) return NULL;
+        entries(n)[0] = *a;
+        entries(n)[1] = *b;
+        return n;
+    }
+
+    u32 fa = FRAG(ha, shift), fb = FRAG(hb, shift);
+
+    if(fa == fb)
+    {
+        es_hamt_node *child = pair(t, a, ha, b, hb, shift + BITS);
+        if(!child) return NULL;
+
+        es_hamt_node *n = newnode(t->alloc, 0, 1u << fa, 0);
+        if(!n) { release(t->alloc, child); return NULL; }
+
+        children(n)[0] = child;
+        return n;
+    }
+
+    es_hamt_node *n = newnode(t->alloc, (1u << fa) | (1u << fb), 0, 2);
+    if(!n) return NULL;
+
+    entries(n)[fa > fb] = *a;
+    entries(n)[fa < fb] = *b;
+    return n;
+}
+
+
+// [[[[[[[[[[[[[[[[[[[[[[[[[[[[[[[[[[[ Update ]]]]]]]]]]]]]]]]]]]]]]]]]]]]]]]]]]]
+
+
+//*************************************************************************
+static es_hamt_node *set(es_hamt *t, es_hamt_node *n, es_value *key, es_value *value,
+                         u64 hash, u32 shift, int *added)
+{
+    // returns a new reference to the changed copy of 'n', copying only
+    // the path down to the key
+
+    if(!n)
+    {
+        es_hamt_node *r = newnode(t->alloc, 1u << FRAG(hash, shift), 0, 1);
+        if(!r) return NULL;
+        es_copy_value(&entries(r)[0].k, key);
+        es_copy_value(&entries(r)[0].v, value);
+        *added = 1;
+        return r;
+    }
+
+    if(LEAF(shift))
+    {
+        u32 i = 0;
+        while(i < n->count && !keyequal(&entries(n)[i].k, key)) ++i;
+
+        *added = i == n->count;
+
+        es_hamt_node *r = newnode(t->alloc, 0, 0, n->count + *added);
+        if(!r) return NULL;
+
+        memcpy(entries(r), entries(n), n->count * sizeof(es_map_node));
+        es_copy_value(&entries(r)[i].k, key);
+        es_copy_value(&entries(r)[i].v, value);
+        return r;
+    }
+
+    u32 bit = 1u << FRAG(hash, shift);
+
+    if(n->datamap & bit)
+    {
+        u32 i = below(n->datamap, bit);
+        es_map_node *e = entries(n) + i;
+
+        if(keyequal(&e->k, key))
+        {
+            es_hamt_node *r = newnode(t->alloc, n->datamap, n->nodemap, n->count);
+            if(!r) return NULL;
+
+            memcpy(entries(r), entries(n), nodesize(n->count, nchildren(n)) - sizeof(es_hamt_node));
+            retainchildren(n, (u32) -1);
+            es_copy_value(&entries(r)[i].v, value);
+            *added = 0;
+            return r;
+        }
+
+        // two keys on one fragment, push both a level down
+        es_map_node fresh;
+        es_copy_value(&fresh.k, key);
+        es_copy_value(&fresh.v, value);
+
+        es_hamt_node *child = pair(t, e, HASH(t, &e->k), &fresh, hash, shift + BITS);
+        if(!child) return NULL;
+
+        es_hamt_node *r = newnode(t->alloc, n->datamap & ~bit, n->nodemap | bit, n->count - 1);
+        if(!r) { release(t->alloc, child); return NULL; }
+
+        u32 j = below(n->nodemap, bit);
+        u32 nc = nchildren(n);
+
+        memcpy(entries(r), entries(n), i * sizeof(es_map_node));
+        memcpy(entries(r) + i, entries(n) + i + 1, (n->count - i - 1) * sizeof(es_map_node));
+        memcpy(children(r), children(n), j * sizeof(es_hamt_node*));
+        children(r)[j] = child;
+        memcpy(children(r) + j + 1, children(n) + j, (nc - j) * sizeof(es_hamt_node*));
+        retainchildren(n, (u32) -1);
+
+        *added = 1;
+        return r;
+    }
+
+    if(n->nodemap & bit)
+    {
+        u32 j = below(n->nodemap, bit);
+
+        es_hamt_node *child = set(t, children(n)[j], key, value, hash, shift + BITS, added);
+        if(!child) return NULL;
+
+        es_hamt_node *r = newnode(t->alloc, n->datamap, n->nodemap, n->count);
+        if(!r) { release(t->alloc, child); return NULL; }
+
+        memcpy(entries(r), entries(n), nodesize(n->count, nchildren(n)) - sizeof(es_hamt_node));
+        retainchildren(n, j);
+        children(r)[j] = child;
+        return r;
+    }
+
+    es_hamt_node *r = newnode(t->alloc, n->datamap | bit, n->nodemap, n->count + 1);
+    if(!r) return NULL;
+
+    u32 i = below(n->datamap, bit);
+
+    memcpy(entries(r), entries(n), i * sizeof(es_map_node));
+    es_copy_value(&entries(r)[i].k, key);
+    es_copy_value(&entries(r)[i].v, value);
+    memcpy(entries(r) + i + 1, entries(n) + i, (n->count - i) * sizeof(es_map_node));
+    memcpy(children(r), children(n), nchildren(n) * sizeof(es_hamt_node*));
+    retainchildren(n, (u32) -1);
+
+    *added = 1;
+    return r;
+}
+
+
+//*************************************************************************
+static int single(es_hamt_node *n)
+{
+    // a node that is only one entry gets folded into its parent
+    return n->count == 1 && n->nodemap == 0;
+}
+
+
+//*************************************************************************
+static es_hamt_node *erase(es_hamt *t, es_hamt_node *n, es_value *key, u64 hash, u32 shift,
+                           int *removed, int *failed)
+{
+    // returns a new reference to the copy of 'n' without the key, NULL
+    // when that leaves it empty, or 'n' itself when the key isn't there
+
+    if(LEAF(shift))
+    {
+        u32 i = 0;
+        while(i < n->count && !keyequal(&entries(n)[i].k, key)) ++i;
+
+        if(i == n->count) { RETAIN(n); return n; }
+
+        *removed = 1;
+        if(n->count == 1) return NULL;
+
+        es_hamt_node *r = newnode(t->alloc, 0, 0, n->count - 1);
+        if(!r) { *failed = 1; return NULL; }
+
+        memcpy(entries(r), entries(n), i * sizeof(es_map_node));
+        memcpy(entries(r) + i, entries(n) + i + 1, (n->count - i - 1) * sizeof(es_map_node));
+        return r;
+    }
+
+    u32 bit = 1u << FRAG(hash, shift);
+
+    if(n->datamap & bit)
+    {
+        u32 i = below(n->datamap, bit);
+
+        if(!keyequal(&entries(n)[i].k, key)) { RETAIN(n); return n; }
+
+        *removed = 1;
+        if(single(n)) return NULL;
+
+        es_hamt_node *r = newnode(t->alloc, n->datamap & ~bit, n->nodemap, n->count - 1);
+        if(!r) { *failed = 1; return NULL; }
+
+        memcpy(entries(r), entries(n), i * sizeof(es_map_node));
+        memcpy(entries(r) + i, entries(n) + i + 1, (n->count - i - 1) * sizeof(es_map_node));
+        memcpy(children(r), children(n), nchildren(n) * sizeof(es_hamt_node*));
+        retainchildren(n, (u32) -1);
+        return r;
+    }
+
+    if(!(n->nodemap & bit)) { RETAIN(n); return n; }
+
+    u32 j = below(n->nodemap, bit);
+    es_hamt_node *old = children(n)[j];
+
+    es_hamt_node *child = erase(t, old, key, hash, shift + BITS, removed, failed);
+    if(*failed) return NULL;
+    if(child == old) { release(t->alloc, child); RETAIN(n); return n; }
+
+    u32 nc = nchildren(n);
+    es_hamt_node *r;
+
+    if(!child || single(child))
+    {
+        // what's left of the child moves up into this node's entries
+        if(!child && n->count == 0 && nc == 1) return NULL;
+
+        if(child && n->count == 0 && nc == 1 && shift > 0)
+        {
+            // and this node would only hold it too, so pass it further up
+            return child;
+        }
+
+        u32 datamap = child ? n->datamap | bit : n->datamap;
+
+        r = newnode(t->alloc, datamap, n->nodemap & ~bit, n->count + (child != NULL));
+        if(!r) { release(t->alloc, child); *failed = 1; return NULL; }
+
+        u32 i = below(n->datamap, bit);
+
+        memcpy(entries(r), entries(n), i * sizeof(es_map_node));
+        if(child) entries(r)[i] = entries(child)[0];
+        memcpy(entries(r) + i + (child != NULL), entries(n) + i, (n->count - i) * sizeof(es_map_node));
+        memcpy(children(r), children(n), j * sizeof(es_hamt_node*));
+        memcpy(children(r) + j, children(n) + j + 1, (nc - j - 1) * sizeof(es_hamt_node*));
+        retainchildren(n, j);
+        release(t->alloc, child);
+        return r;
+    }
+
+    r = newnode(t->alloc, n->datamap, n->nodemap, n->count);
+    if(!r) { release(t->alloc, child); *failed = 1; return NULL; }
+
+    memcpy(entries(r), entries(n), nodesize(n->count, nc) - sizeof(es_hamt_node));
+    retainchildren(n, j);
+    children(r)[j] = child;
+    return r;
+}
+
+
+// [[[[[[[[[[[[[[[[[[[[[[[[[[[[[[[[[[[ Hamt ]]]]]]]]]]]]]]]]]]]]]]]]]]]]]]]]]]]
+
+
+//*************************************************************************
+void es_construct_hamt(es_hamt *hamt, es_allocator *alloc)
+{
+    hamt->root  = NULL;
+    hamt->size  = 0;
+    hamt->seed  = es_hash_seed();
+    hamt->alloc = alloc;
+}
+
+
+//*************************************************************************
+void es_destroy_hamt(es_hamt *hamt)
+{
+    release(hamt->alloc, hamt->root);
+    hamt->root = NULL;
+    hamt->size = 0;
+}
+
+
+//*************************************************************************
+es_hamt es_hamtcopy(const es_hamt *hamt)
+{
+    if(hamt->root) RETAIN(hamt->root);
+    return *hamt;
+}
+
+
+//*************************************************************************
+es_value *es_hamtget(const es_hamt *hamt, es_value *key)
+{
+    es_hamt_node *n = hamt->root;
+    u64 hash = HASH(hamt, key);
+
+    for(u32 shift = 0; n; shift += BITS)
+    {
+        if(LEAF(shift))
+        {
+            for(u32 i = 0; i < n->count; ++i)
+                if(keyequal(&entries(n)[i].k, key))
+                    return &entries(n)[i].v;
+            return NULL;
+        }
+
+        u32 bit = 1u << FRAG(hash, shift);
+
+        if(n->datamap & bit)
+        {
+            es_map_node *e = entries(n) + below(n->datamap, bit);
+            return keyequal(&e->k, key) ? &e->v : NULL;
+        }
+
+        if(!(n->nodemap & bit))
+            return NULL;
+
+        n = children(n)[below(n->nodemap, bit)];
+    }
+
+    return NULL;
+}
+
+
+//*************************************************************************
+int es_hamtset(es_hamt *out, const es_hamt *hamt, es_value *key, es_value *value)
+{
+    es_hamt next = *hamt;
+    int added = 0;
+
+    next.root = set(&next, hamt->root, key, value, HASH(hamt, key), 0, &added);
+    if(!next.root) return 0;
+
+    next.size += added;
+
+    if(out == hamt) es_destroy_hamt(out);
+    *out = next;
+
+    return 1;
+}
+
+
+//*************************************************************************
+int es_hamterase(es_hamt *out, const es_hamt *hamt, es_value *key)
+{
+    es_hamt next = *hamt;
+    int removed = 0, failed = 0;
+
+    if(!hamt->root)
+    {
+        *out = next;
+        return 1;
+    }
+
+    next.root = erase(&next, hamt->root, key, HASH(hamt, key), 0, &removed, &failed);
+    if(failed) return 0;
+
+    next.size -= removed;
+
+    if(out == hamt) es_destroy_hamt(out);
+    *out = next;
+
+    return 1;
+}
+
+
+//*************************************************************************
+es_value *es_hamtnext(const es_hamt *hamt, es_hamt_iter *iter, es_value *key)
+{
+    // depth first, 0 is a fresh iterator and -1 a finished one
+
+    if(iter->depth == 0)
+    {
+        if(!hamt->root) { iter->depth = -1; return NULL; }
+
+        iter->node[1] = hamt->root;
+        iter->pos[1]  = 0;
+        iter->depth   = 1;
+    }
+
+    while(iter->depth > 0)
+    {
+        i32 d = iter->depth;
+        es_hamt_node *n = iter->node[d];
+
+        if(iter->pos[d] < n->count)
+        {
+            es_map_node *e = entries(n) + iter->pos[d]++;
+            *key = e->k;
+            return &e->v;
+        }
+
+        if(iter->pos[d] < n->count + nchildren(n))
+        {
+            iter->node[d + 1] = children(n)[iter->pos[d]++ - n->count];
+            iter->pos[d + 1]  = 0;
+            iter->depth       = d + 1;
+            continue;
+        }
+
+        --(iter->depth);
+    }
+
+    iter->depth = -1;
+    return NULL;
+}
@@ -0,0 +1,72 @@
+/********************************************************************************
+ * \file hamt.h
+ * \author Patrick Torgeson (torgersonpatricks@gmail.com)
+ * \brief persistent hash maps, every update makes a new version that shares
+ *        all it didn't touch with the old one
+ * \version 0.1
+ * \date 2022-01-22
+ *
+ * @copyright Copyright (c) 2022
+ *
+ ********************************************************************************/
+
+
+#ifndef ES_HAMT_H
+#define ES_HAMT_H
+
+
+#include "common.h"
+#include "value.h"
+#include "memory.h"
+
+
+// 5 bits of the hash per level, 64 bit hashes run out after 13 levels
+// and anything still colliding shares a flat node below that
+#define ES_HAMT_DEPTH 14
+
+
+typedef struct es_hamt_node_t es_hamt_node;
+
+
+// a version, a cheap handle to an immutable trie. nodes are reference
+// counted atomically so versions can be read, copied and dropped from any
+// thread, but the last one holding a node frees it through 'alloc'. an
+// es_allocator's counters and pools aren't locked, versions shared between
+// threads or states have to be built with a NULL 'alloc'
+typedef struct es_hamt_t
+{
+    es_hamt_node *root;
+    size_t size;
+    u64 seed;
+    es_allocator *alloc;
+} es_hamt;
+
+
+// start with all zeroes
+typedef struct es_hamt_iter_t
+{
+    es_hamt_node *node[ES_HAMT_DEPTH + 1];
+    u32 pos[ES_HAMT_DEPTH + 1];
+    i32 depth;
+} es_hamt_iter;
+
+
+// 'alloc' may be NULL to use the c runtime directly, which any thread can
+void es_construct_hamt(es_hamt *hamt, es_allocator *alloc);
+void es_destroy_hamt(es_hamt *hamt);
+
+// another handle on the same version, O(1)
+es_hamt es_hamtcopy(const es_hamt *hamt);
+
+es_value *es_hamtget(const es_hamt *hamt, es_value *key);
+
+// write a new version to 'out', which must be empty or 'hamt' itself, in
+// which case the old version is released. 0 when out of memory and
+// nothing changes
+int es_hamtset(es_hamt *out, const es_hamt *hamt, es_value *key, es_value *value);
+int es_hamterase(es_hamt *out, const es_hamt *hamt, es_value *key);
+
+// copies the key out and returns the value, NULL at the end
+es_value *es_hamtnext(const es_hamt *hamt, es_hamt_iter *iter, es_value *key);
+
+#endif
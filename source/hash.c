@@ -0,0 +1,168 @@
+#include "hash.h"
+
+#include <time.h>
+
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+
+
+// wyhash constants and structure : https://github.com/wangyi-fudan/wyhash
+
+#define P0 0xa0761d6478bd642full
+#define P1 0xe7037ed1a0b428dbull
+#define P2 0x8ebc6af09c88c6e3ull
+#define P3 0x589965cc75374cc3ull
+
+
+//*************************************************************************
+static u64 mum(u64 a, u64 b)
+{
+    // 64x64 -> 128 multiply, folded
+#if defined(__SIZEOF_INT128__)
+    __uint128_t r = (__uint128_t) a * b;
+    return (u64) r ^ (u64)(r >> 64);
+#elif defined(_MSC_VER) && defined(_M_X64)
+    u64 hi;
+    u64 lo = _umul128(a, b, &hi);
+    return lo ^ hi;
+#else
+    u64 ha = a >> 32, la = (u32) a;
+    u64 hb = b >> 32, lb = (u32) b;
+    u64 rh = ha * hb, rm0 = ha * lb, rm1 = hb * la, rl = la * lb;
+    u64 t  = rl + (rm0 << 32);
+    u64 c  = t < rl;
+    u64 lo = t + (rm1 << 32);
+    c += lo < t;
+    u64 hi = rh + (rm0 >> 32) + (rm1 >> 32) + c;
+    return lo ^ hi;
+#endif
+}
+
+
+//*************************************************************************
+static u64 read8(const u8 *p) { u64 v; memcpy(&v, p, 8); return v; }
+static u64 read4(const u8 *p) { u32 v; memcpy(&v, p, 4); return v; }
+
+
+//*************************************************************************
+u64 es_hash_word(u64 x, u64 seed)
+{
+    return mum(mum(x ^ P0, seed ^ P1) ^ P2, P3);
+}
+
+
+//*************************************************************************
+u64 es_hash_bytes(const void *data, size_t size, u64 seed)
+{
+    const u8 *p = (const u8*) data;
+    u64 a, b;
+
+    seed ^= P0;
+
+    if(size <= 16)
+    {
+        if(size >= 4)
+        {
+            // two overlapping reads cover 4..16 bytes
+            size_t d = (size >> 3) << 2;
+            a = (read4(p) << 32) | read4(p + d);
+            b = (read4(p + size - 4) << 32) | read4(p + size - 4 - d);
+        }
+        else if(size > 0)
+        {
+            a = ((u64) p[0] << 16) | ((u64) p[size >> 1] << 8) | p[size - 1];
+            b = 0;
+        }
+        else a = b = 0;
+    }
+    else
+    {
+        size_t i = size;
+
+        if(i > 48)
+        {
+            u64 s1 = seed, s2 = seed;
+            do
+            {
+                seed = mum(read8(p)      ^ P1, read8(p + 8)  ^ seed);
+                s1   = mum(read8(p + 16) ^ P2, read8(p + 24) ^ s1);
+                s2   = mum(read8(p + 32) ^ P3, read8(p + 40) ^ s2);
+                p += 48;
+                i -= 48;
+            }
+            while(i > 48);
+            seed ^= s1 ^ s2;
+        }
+
+        while(i > 16)
+        {
+            seed = mum(read8(p) ^ P1, read8(p + 8) ^ seed);
+            p += 16;
+            i -= 16;
+        }
+
+        // last 16 bytes, may overlap what was already hashed
+        a = read8(p + i - 16);
+        b = read8(p + i - 8);
+    }
+
+    return mum(P1 ^ size, mum(a ^ P1, b ^ seed));
+}
+
+
+//*************************************************************************
+u64 es_hash_value(const es_value *v, u64 seed)
+{
+    switch(v->tid)
+    {
+    case ES_STRING:
+    {
+        const es_string *str = (const es_string*) v->obj;
+        return es_hash_bytes(str->data, str->size, seed);
+    }
+
+    // only the payload, whatever the rest of the union holds is ignored
+    default:
+        return es_hash_word(v->u, seed ^ v->tid);
+    }
+}
+
+
+//*************************************************************************
+u64 es_hash_seed(void)
+{
+    // secret is set once, every call after that gets a distinct seed. any
+    // thread may ask, the first secret stored is the one everyone uses
+    static volatile i64 secret  = 0;
+    static volatile long counter = 0;
+
+#if defined(_MSC_VER)
+    u64 s = (u64) _InterlockedCompareExchange64(&secret, 0, 0);
+#else
+    u64 s = (u64) __atomic_load_n(&secret, __ATOMIC_ACQUIRE);
+#endif
+
+    if(!s)
+    {
+        u64 entropy = (u64) time(NULL) ^ ((u64) clock() << 32) ^ (u64)(uintptr_t) &counter;
+        i64 mine = (i64)(es_hash_word(entropy, P0) | 1);
+
+#if defined(_MSC_VER)
+        i64 was = _InterlockedCompareExchange64(&secret, mine, 0);
+#else
+        i64 was = 0;
+        __atomic_compare_exchange_n(&secret, &was, mine, false, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE);
+#endif
+
+        s = (u64)(was ? was : mine);
+    }
+
+#if defined(_MSC_VER)
+    u64 n = (u64)(unsigned long) _InterlockedIncrement(&counter);
+#else
+    u64 n = (u64)(unsigned long) __atomic_add_fetch(&counter, 1, __ATOMIC_RELAXED);
+#endif
+
+    return es_hash_word(n, s);
+}
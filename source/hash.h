@@ -0,0 +1,34 @@
+/********************************************************************************
+ * \file hash.h
+ * \author Patrick Torgeson (torgersonpatricks@gmail.com)
+ * \brief non cryptographic hashing for values, seeded per table
+ * \version 0.1
+ * \date 2022-01-20
+ *
+ * @copyright Copyright (c) 2022
+ *
+ ********************************************************************************/
+
+
+#ifndef ES_HASH_H
+#define ES_HASH_H
+
+
+#include "common.h"
+#include "value.h"
+
+
+// mixes a single 64 bit word
+u64 es_hash_word(u64 x, u64 seed);
+
+// reads 8 bytes at a time, 'size' bytes are hashed and no more
+u64 es_hash_bytes(const void *data, size_t size, u64 seed);
+
+// hashes by type, strings by contents, everything else by payload
+u64 es_hash_value(const es_value *v, u64 seed);
+
+// a fresh seed for each table, derived from a process wide secret
+u64 es_hash_seed(void);
+
+
+#endif
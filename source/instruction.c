@@ -29,6 +29,27 @@ const char* es_opnames[] =
     "call",
     "ret",
     "",
+    "concat",
+    "reads",
+    "writes",
+    "news",
+    "reada",
+    "writea",
+    "readm",
+    "writem",
+    "newm",
+    "getg",
+    "setg",
+    "loadkx",
+    "extraarg",
+    "addi",
+    "subi",
+    "eqi",
+    "nei",
+    "lti",
+    "lei",
+    "gti",
+    "gei",
 };
 
 
@@ -46,10 +67,31 @@ es_opinfo es_opinfos[] =
     /* le    */ ABCINF(ARGT_R, ARGT_RK, ARGT_RK),
     /* mov   */ AYINF(ARGT_R, ARGT_RK),
     /* movi  */ AYINF(ARGT_R, ARGT_SI),
-    /* jmp   */ AYINF(ARGT_I, ARGT_SI),
+    /* jmp   */ AYINF(ARGT_OR, ARGT_SI),
     /* call  */ AYINF(ARGT_R, ARGT_I),
     /* ret   */ XINF(ARGT_I),
     0,
+    /* concat*/ ABCINF(ARGT_R, ARGT_R, ARGT_R),
+    /* reads */ ABCINF(ARGT_R, ARGT_R, ARGT_I),
+    /* writes*/ ABCINF(ARGT_R, ARGT_I, ARGT_RK),
+    /* news  */ ABCINF(ARGT_R, ARGT_I, ARGT_I),
+    /* reada */ ABCINF(ARGT_R, ARGT_R, ARGT_RK),
+    /* writea*/ ABCINF(ARGT_R, ARGT_RK, ARGT_RK),
+    /* readm */ ABCINF(ARGT_R, ARGT_R, ARGT_RK),
+    /* writem*/ ABCINF(ARGT_R, ARGT_RK, ARGT_RK),
+    /* newm  */ AYINF(ARGT_R, ARGT_I),
+    /* getg  */ AYINF(ARGT_R, ARGT_I),
+    /* setg  */ AYINF(ARGT_R, ARGT_I),
+    /* loadkx*/ AYINF(ARGT_R, ARGT_U),
+    /* extra */ XINF(ARGT_K),
+    /* addi  */ ABCINF(ARGT_R, ARGT_R, ARGT_SI),
+    /* subi  */ ABCINF(ARGT_R, ARGT_R, ARGT_SI),
+    /* eqi   */ ABCINF(ARGT_R, ARGT_R, ARGT_SI),
+    /* nei   */ ABCINF(ARGT_R, ARGT_R, ARGT_SI),
+    /* lti   */ ABCINF(ARGT_R, ARGT_R, ARGT_SI),
+    /* lei   */ ABCINF(ARGT_R, ARGT_R, ARGT_SI),
+    /* gti   */ ABCINF(ARGT_R, ARGT_R, ARGT_SI),
+    /* gei   */ ABCINF(ARGT_R, ARGT_R, ARGT_SI),
 };
 
 
@@ -135,6 +135,12 @@ typedef uint32_t es_instruction;
 
 #define ASK(k) (((k) << 1) | 1)
 
+// whether 'v' fits an unsigned / signed field of 's' bits, MAKEARG masks
+// off whatever doesn't so anything emitting has to check first. negative
+// values wrap around past the limit for FITSARG
+#define FITSARG(v,s)  ((uint64_t)(v) < MASK1(1,s))
+#define FITSSARG(v,s) ((int64_t)(v) >= -(int64_t)SIGNBIT(s) && (int64_t)(v) < (int64_t)SIGNBIT(s))
+
 // Instruction reflection
 #define GETOPSIG(inf) GETARG(inf,OSIGPOS,OSIGSIZE)
 #define GETATYPE(inf) GETARG(inf,AINFPOS,INFSIZE)
@@ -213,22 +219,44 @@ typedef enum es_opcode
 
     OP_MOV,   // mov  R(a) RK(y)         ; a = y
     OP_MOVI,  // movi R(a) SI(y)         ; a = y
-    OP_JMP,   // jmp  I(a) SI(y)         ; ip += y * (result == a || a >= 2)
-    OP_CALL,  // call R(a) I(y)          ; y(a+1,a+2,...)
+    OP_JMP,   // jmp  OR(a) SI(y)        ; ip += y unless a is given and true
+    OP_CALL,  // call R(a) I(y)          ; a, a+1, ... = y(a,a+1,...)
     OP_RET,   // ret  I(X)               ; returns x values
 
     OP_NEG,
 
-    // OP_TEST,
-
-    // OP_READS,
-    // OP_WRITES,
+    OP_CONCAT, // concat R(a) R(b) R(c)   ; a = b .. b+1 .. ... .. c
 
-    // OP_READA,
-    // OP_WRITEA,
+    // OP_TEST,
 
-    // OP_READM,
-    // OP_WRITEM,
+    OP_READS,  // reads  R(a) R(b) I(c)   ; a = b.field, c is the function's field cache
+    OP_WRITES, // writes R(a) I(b) RK(c)  ; a.field = c, b is the function's field cache
+    OP_NEWS,   // news   R(a) I(b) I(c)   ; a = struct of shape b, first c fields from a..a+c-1
+
+    OP_READA,  // reada  R(a) R(b) RK(c)  ; a = b[c]
+    OP_WRITEA, // writea R(a) RK(b) RK(c) ; a[b] = c
+
+    OP_READM,  // readm  R(a) R(b) RK(c)  ; a = b[c]
+    OP_WRITEM, // writem R(a) RK(b) RK(c) ; a[b] = c
+    OP_NEWM,   // newm   R(a) I(y)        ; a = map with room for y entries
+
+    OP_GETG,   // getg   R(a) I(y)        ; a = globals[y]
+    OP_SETG,   // setg   R(a) I(y)        ; globals[y] = a
+
+    // constants past what RK operands reach, RK(b) and RK(c) end at k255
+    // and RK(y) at k131071. the index goes in an extraarg right before
+    OP_LOADKX,   // loadkx   R(a)         ; a = kst[x of the previous instruction]
+    OP_EXTRAARG, // extraarg K(x)         ; operand of the next instruction, does nothing itself
+
+    // small int constants in the instruction itself, c is -256..255
+    OP_ADDI,   // addi   R(a) R(b) SI(c)  ; a = b + c
+    OP_SUBI,   // subi   R(a) R(b) SI(c)  ; a = b - c
+    OP_EQI,    // eqi    R(a) R(b) SI(c)  ; a = b == c
+    OP_NEI,    // nei    R(a) R(b) SI(c)  ; a = b != c
+    OP_LTI,    // lti    R(a) R(b) SI(c)  ; a = b <  c
+    OP_LEI,    // lei    R(a) R(b) SI(c)  ; a = b <= c
+    OP_GTI,    // gti    R(a) R(b) SI(c)  ; a = b >  c
+    OP_GEI,    // gei    R(a) R(b) SI(c)  ; a = b >= c
 
     OP_COUNT,
     OP_INVALID,
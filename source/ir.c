@@ -0,0 +1,1075 @@
+#include "ir.h"
+
+
+// one bit per register, B and C reach r511
+#define ES_IR_REGS 512
+
+
+//*************************************************************************
+typedef struct regset_t
+{
+    u64 w[ES_IR_REGS / 64];
+} regset;
+
+
+//*************************************************************************
+static void rsadd(regset *s, u64 r)
+{
+    if(r < ES_IR_REGS) s->w[r >> 6] |= 1ull << (r & 63);
+}
+
+
+//*************************************************************************
+static bool rshas(const regset *s, u64 r)
+{
+    return r < ES_IR_REGS && (s->w[r >> 6] >> (r & 63)) & 1;
+}
+
+
+//*************************************************************************
+static void rsrange(regset *s, u64 first, u64 count)
+{
+    for(u64 r = first; r < first + count && r < ES_IR_REGS; ++r)
+        rsadd(s, r);
+}
+
+
+//*************************************************************************
+static bool rsany(const regset *s, const regset *t)
+{
+    for(int i = 0; i < ES_IR_REGS / 64; ++i)
+        if(s->w[i] & t->w[i]) return true;
+    return false;
+}
+
+
+//*************************************************************************
+typedef struct effect_t
+{
+    regset use;
+    regset def;
+    bool opaque; // nothing known about it, reads everything
+} effect;
+
+
+//*************************************************************************
+static void userk(effect *e, u32 v)
+{
+    if(!ISK(v)) rsadd(&e->use, v >> 1);
+}
+
+
+//*************************************************************************
+static void effects(const es_irfunc *f, const es_irins *in, effect *e)
+{
+    memset(e, 0, sizeof(effect));
+
+    switch(in->op)
+    {
+    case OP_ADD: case OP_SUB: case OP_MUL: case OP_DIV:
+    case OP_EQ:  case OP_NE:  case OP_LT:  case OP_LE:
+        rsadd(&e->def, in->a);
+        userk(e, in->b);
+        userk(e, in->c);
+        break;
+
+    case OP_MOV:
+        rsadd(&e->def, in->a);
+        userk(e, in->b);
+        break;
+
+    case OP_ADDI: case OP_SUBI: case OP_EQI: case OP_NEI:
+    case OP_LTI:  case OP_LEI:  case OP_GTI: case OP_GEI:
+        rsadd(&e->def, in->a);
+        rsadd(&e->use, in->b);
+        break;
+
+    case OP_MOVI: case OP_LOADKX: case OP_GETG: case OP_NEWM:
+        rsadd(&e->def, in->a);
+        break;
+
+    case OP_SETG:
+        rsadd(&e->use, in->a);
+        break;
+
+    case OP_CONCAT:
+        rsadd(&e->def, in->a);
+        if(in->c >= in->b) rsrange(&e->use, in->b, in->c - in->b + 1);
+        break;
+
+    case OP_READS:
+        rsadd(&e->def, in->a);
+        rsadd(&e->use, in->b);
+        break;
+
+    case OP_WRITES:
+        rsadd(&e->use, in->a);
+        userk(e, in->c);
+        break;
+
+    case OP_NEWS:
+        rsadd(&e->def, in->a);
+        rsrange(&e->use, in->a, in->c);
+        break;
+
+    case OP_READA: case OP_READM:
+        rsadd(&e->def, in->a);
+        rsadd(&e->use, in->b);
+        userk(e, in->c);
+        break;
+
+    case OP_WRITEA: case OP_WRITEM:
+        rsadd(&e->use, in->a);
+        userk(e, in->b);
+        userk(e, in->c);
+        break;
+
+    case OP_JMP:
+        if(in->a) rsadd(&e->use, in->a - 1);
+        break;
+
+    case OP_CALL:
+        if(in->b >= f->es->funcs.size)
+        {
+            e->opaque = true;
+            memset(&e->use, 0xff, sizeof(regset));
+            break;
+        }
+
+        // the callee's frame starts at a, and on return the caller's
+        // registers past the results are nil, nothing from a on survives
+        rsrange(&e->use, in->a, f->es->funcs.data[in->b].params);
+        rsrange(&e->def, in->a, ES_IR_REGS - in->a);
+        break;
+
+    case OP_RET:
+        rsrange(&e->use, 0, in->b);
+        break;
+
+    default:
+        e->opaque = true;
+        memset(&e->use, 0xff, sizeof(regset));
+        break;
+    }
+}
+
+
+//*************************************************************************
+int es_ir_build(es_irfunc *f, es_state *es, const es_instruction *code, size_t size)
+{
+    f->es = es;
+    es_construct_array(es_irins, f->ins, &es->alloc);
+    es_construct_array(es_irblock, f->blocks, &es->alloc);
+
+    // where each instruction ended up, for resolving jumps
+    size_t *at = (size_t*) es_malloc(&es->alloc, (size + 1) * sizeof(size_t));
+    if(!at) return 0;
+
+    for(size_t n = 0; n < size; ++n)
+    {
+        es_instruction i = code[n];
+        es_opcode op = O(i);
+
+        at[n] = f->ins.size;
+
+        // an extraarg becomes part of the loadkx after it
+        if(op == OP_EXTRAARG && n + 1 < size && O(code[n + 1]) == OP_LOADKX)
+            continue;
+
+        if(!es_arrpush(es_irins, f->ins))
+        {
+            es_free(&es->alloc, at, (size + 1) * sizeof(size_t));
+            return 0;
+        }
+
+        es_irins *in = &es_arrback(f->ins);
+        in->op = op;
+        in->a = (u32) A(i);
+        in->b = (u32) B(i);
+        in->c = (u32) C(i);
+        in->target = -1;
+        in->at = 0;
+        in->dead = false;
+
+        if(op >= OP_COUNT || OPSIG(op) == SIG_AY)
+        {
+            in->b = (u32) Y(i);
+            in->c = 0;
+        }
+        else if(OPSIG(op) == SIG_X)
+        {
+            in->a = 0;
+            in->b = (u32) X(i);
+            in->c = 0;
+        }
+
+        if(op == OP_LOADKX)
+            in->b = (n > 0 && O(code[n - 1]) == OP_EXTRAARG) ? (u32) X(code[n - 1]) : 0;
+
+        if(op == OP_JMP)
+        {
+            i64 t = (i64) n + 1 + YS(i);
+            in->target = t;
+        }
+    }
+
+    at[size] = f->ins.size;
+
+    int ok = 1;
+
+    for(size_t n = 0; n < f->ins.size; ++n)
+    {
+        es_irins *in = f->ins.data + n;
+        if(in->op != OP_JMP) continue;
+
+        if(in->target < 0 || in->target > (i64) size) ok = 0;
+        else in->target = (i64) at[in->target];
+    }
+
+    es_free(&es->alloc, at, (size + 1) * sizeof(size_t));
+
+    return ok && es_ir_blocks(f);
+}
+
+
+//*************************************************************************
+void es_ir_destroy(es_irfunc *f)
+{
+    es_destroy_array(es_irins, f->ins);
+    es_destroy_array(es_irblock, f->blocks);
+}
+
+
+//*************************************************************************
+int es_ir_blocks(es_irfunc *f)
+{
+    size_t n = f->ins.size;
+
+    es_arrclear(f->blocks);
+
+    // a block starts at the top, at every jump target and after every
+    // jump or return. 'blockof' is the block each instruction is in
+    size_t *blockof = (size_t*) es_malloc(&f->es->alloc, (n + 1) * sizeof(size_t));
+    if(!blockof) return 0;
+
+    for(size_t i = 0; i <= n; ++i) blockof[i] = 0;
+
+    blockof[0] = 1;
+    for(size_t i = 0; i < n; ++i)
+    {
+        es_irins *in = f->ins.data + i;
+        if(in->dead) continue;
+
+        if(in->op == OP_JMP)
+        {
+            blockof[in->target] = 1;
+            blockof[i + 1] = 1;
+        }
+        else if(in->op == OP_RET)
+            blockof[i + 1] = 1;
+    }
+
+    for(size_t i = 0; i < n; ++i)
+    {
+        if(blockof[i])
+        {
+            if(!es_arrpush(es_irblock, f->blocks))
+            {
+                es_free(&f->es->alloc, blockof, (n + 1) * sizeof(size_t));
+                return 0;
+            }
+
+            es_irblock *b = &es_arrback(f->blocks);
+            b->first = i;
+            b->next = b->branch = (size_t) -1;
+        }
+
+        es_arrback(f->blocks).last = i + 1;
+        blockof[i] = f->blocks.size - 1;
+    }
+
+    blockof[n] = (size_t) -1;
+
+    for(size_t b = 0; b < f->blocks.size; ++b)
+    {
+        es_irblock *bl = f->blocks.data + b;
+
+        es_irins *end = f->ins.data + bl->last - 1;
+        while(end > f->ins.data + bl->first && end->dead) --end;
+
+        bool falls = true;
+
+        if(end->dead) { }
+        else if(end->op == OP_JMP)
+        {
+            bl->branch = blockof[end->target];
+            falls = end->a != 0;
+        }
+        else if(end->op == OP_RET)
+            falls = false;
+
+        if(falls && b + 1 < f->blocks.size)
+            bl->next = b + 1;
+    }
+
+    es_free(&f->es->alloc, blockof, (n + 1) * sizeof(size_t));
+    return 1;
+}
+
+
+//*************************************************************************
+size_t es_ir_lower(es_irfunc *f, es_instruction *code)
+{
+    size_t p = 0;
+
+    // a dead instruction's position is the next live one's, so jumps to
+    // it still land right
+    for(size_t i = 0; i < f->ins.size; ++i)
+    {
+        es_irins *in = f->ins.data + i;
+        in->at = p;
+        if(!in->dead) p += (in->op == OP_LOADKX) ? 2 : 1;
+    }
+
+    size_t end = p;
+    p = 0;
+
+    for(size_t i = 0; i < f->ins.size; ++i)
+    {
+        es_irins *in = f->ins.data + i;
+        if(in->dead) continue;
+
+        if(in->op == OP_JMP)
+        {
+            size_t to = in->target < (i64) f->ins.size ? f->ins.data[in->target].at : end;
+            code[p++] = INS_OAY(OP_JMP, in->a, (i64) to - (i64) in->at - 1);
+        }
+        else if(in->op == OP_LOADKX)
+        {
+            code[p++] = INS_OX(OP_EXTRAARG, in->b);
+            code[p++] = INS_OAY(OP_LOADKX, in->a, 0);
+        }
+        else if(in->op < OP_COUNT && OPSIG(in->op) == SIG_X)
+            code[p++] = INS_OX(in->op, in->b);
+        else if(in->op >= OP_COUNT || OPSIG(in->op) == SIG_AY)
+            code[p++] = INS_OAY(in->op, in->a, in->b);
+        else
+            code[p++] = INS_OABC(in->op, in->a, in->b, in->c);
+    }
+
+    return p;
+}
+
+
+
+// [[[[[[ passes ]]]]]]
+
+
+//*************************************************************************
+static bool fits(u32 v, bool y)
+{
+    // RK(y) is wider than RK(b) / RK(c)
+    return FITSARG(v, y ? YSIZE : BSIZE);
+}
+
+
+//*************************************************************************
+typedef struct operands_t
+{
+    u32 *rk[2]; // RK fields, a register or a constant can go there
+    u32 *r;     // R field a register can be swapped into
+    bool y;     // rk[0] is RK(y)
+} operands;
+
+
+//*************************************************************************
+static void getoperands(es_irins *in, operands *o)
+{
+    // the fields another source can be put in, ranges like a call's
+    // arguments are left out
+    o->rk[0] = o->rk[1] = NULL;
+    o->r = NULL;
+    o->y = false;
+
+    switch(in->op)
+    {
+    case OP_ADD: case OP_SUB: case OP_MUL: case OP_DIV:
+    case OP_EQ:  case OP_NE:  case OP_LT:  case OP_LE:
+        o->rk[0] = &in->b; o->rk[1] = &in->c; break;
+    case OP_MOV:
+        o->rk[0] = &in->b; o->y = true; break;
+    case OP_READS:
+    case OP_ADDI: case OP_SUBI: case OP_EQI: case OP_NEI:
+    case OP_LTI:  case OP_LEI:  case OP_GTI: case OP_GEI:
+        o->r = &in->b; break;
+    case OP_WRITES:
+        o->r = &in->a; o->rk[0] = &in->c; break;
+    case OP_READA: case OP_READM:
+        o->r = &in->b; o->rk[0] = &in->c; break;
+    case OP_WRITEA: case OP_WRITEM:
+        o->r = &in->a; o->rk[0] = &in->b; o->rk[1] = &in->c; break;
+    case OP_SETG:
+        o->r = &in->a; break;
+    default: break;
+    }
+}
+
+
+//*************************************************************************
+static size_t copyprop(es_irfunc *f)
+{
+    // after mov a, b later reads of a read b instead, for as long as
+    // neither changes. the mov is left for dce
+
+    size_t changes = 0;
+
+    // copy[r] is what r holds a copy of or -1, 'held' lists the r that do
+    i64 copy[ES_IR_REGS];
+    u32 held[ES_IR_REGS];
+    size_t nheld = 0;
+
+    for(int r = 0; r < ES_IR_REGS; ++r) copy[r] = -1;
+
+    for(size_t b = 0; b < f->blocks.size; ++b)
+    {
+        for(; nheld > 0; --nheld) copy[held[nheld - 1]] = -1;
+
+        es_irblock *bl = f->blocks.data + b;
+
+        for(size_t n = bl->first; n < bl->last; ++n)
+        {
+            es_irins *in = f->ins.data + n;
+            if(in->dead) continue;
+
+            operands o;
+            getoperands(in, &o);
+
+            for(int k = 0; k < 2; ++k)
+            {
+                if(!o.rk[k] || ISK(*o.rk[k])) continue;
+
+                i64 src = copy[*o.rk[k] >> 1];
+                if(src < 0 || !fits((u32) src, o.y)) continue;
+
+                *o.rk[k] = (u32) src;
+                changes += 1;
+            }
+
+            if(o.r && copy[*o.r] >= 0 && !ISK(copy[*o.r]) && (copy[*o.r] >> 1) < (1 << ASIZE))
+            {
+                *o.r = (u32)(copy[*o.r] >> 1);
+                changes += 1;
+            }
+
+            // forget whatever the instruction overwrites
+            effect e;
+            effects(f, in, &e);
+
+            for(size_t h = 0; h < nheld;)
+            {
+                u32 x = held[h];
+
+                if(e.opaque || rshas(&e.def, x) || (!ISK(copy[x]) && rshas(&e.def, copy[x] >> 1)))
+                {
+                    copy[x] = -1;
+                    held[h] = held[--nheld];
+                }
+                else ++h;
+            }
+
+            if(in->op == OP_MOV && in->b != in->a << 1 && in->a < ES_IR_REGS)
+            {
+                copy[in->a] = in->b;
+                held[nheld++] = in->a;
+            }
+        }
+    }
+
+    return changes;
+}
+
+
+//*************************************************************************
+static bool pure(es_opcode op)
+{
+    // same operands, same result, and no other effect
+    switch(op)
+    {
+    case OP_ADD: case OP_SUB: case OP_MUL: case OP_DIV:
+    case OP_EQ:  case OP_NE:  case OP_LT:  case OP_LE:
+    case OP_ADDI: case OP_SUBI: case OP_EQI: case OP_NEI:
+    case OP_LTI:  case OP_LEI:  case OP_GTI: case OP_GEI:
+    case OP_GETG: case OP_LOADKX:
+        return true;
+    default:
+        return false;
+    }
+}
+
+
+//*************************************************************************
+typedef struct avail_t
+{
+    es_opcode op;
+    u32 b;
+    u32 c;
+    u32 dest;
+} avail;
+
+#define ES_IR_AVAIL 64
+
+
+//*************************************************************************
+static size_t cse(es_irfunc *f)
+{
+    // a value computed again in the same block is moved from where it
+    // already is, as long as nothing it came from has changed since
+
+    size_t changes = 0;
+    avail table[ES_IR_AVAIL];
+
+    for(size_t b = 0; b < f->blocks.size; ++b)
+    {
+        size_t count = 0;
+        es_irblock *bl = f->blocks.data + b;
+
+        for(size_t n = bl->first; n < bl->last; ++n)
+        {
+            es_irins *in = f->ins.data + n;
+            if(in->dead) continue;
+
+            bool found = false;
+
+            if(pure(in->op))
+            {
+                for(size_t t = 0; t < count; ++t)
+                {
+                    if(table[t].op != in->op || table[t].b != in->b || table[t].c != in->c) continue;
+
+                    if(table[t].dest == in->a)
+                        in->dead = true;
+                    else
+                    {
+                        in->op = OP_MOV;
+                        in->b  = table[t].dest << 1;
+                        in->c  = 0;
+                    }
+
+                    found = true;
+                    changes += 1;
+                    break;
+                }
+            }
+
+            if(in->dead) continue;
+
+            effect e;
+            effects(f, in, &e);
+
+            for(size_t t = 0; t < count;)
+            {
+                avail *v = table + t;
+
+                // immediate forms read the register b, the rest RK b and c
+                bool imm = v->op >= OP_ADDI && v->op <= OP_GEI;
+                bool rk  = !imm && v->op != OP_GETG && v->op != OP_LOADKX;
+
+                bool stale = e.opaque || rshas(&e.def, v->dest)
+                    || (imm && rshas(&e.def, v->b))
+                    || (rk && !ISK(v->b) && rshas(&e.def, v->b >> 1))
+                    || (rk && !ISK(v->c) && rshas(&e.def, v->c >> 1))
+                    || (v->op == OP_GETG && (in->op == OP_CALL || (in->op == OP_SETG && in->b == v->b)));
+
+
+                if(stale) table[t] = table[--count];
+                else ++t;
+            }
+
+            // a = a + 1 changes its own operand
+            if(pure(in->op) && !found && count < ES_IR_AVAIL && !rshas(&e.use, in->a))
+            {
+                table[count].op   = in->op;
+                table[count].b    = in->b;
+                table[count].c    = in->c;
+                table[count].dest = in->a;
+                ++count;
+            }
+        }
+    }
+
+    return changes;
+}
+
+
+//*************************************************************************
+static bool removable(es_opcode op)
+{
+    // dropping it can't change what the program does, it only writes a
+    switch(op)
+    {
+    case OP_MOV: case OP_MOVI: case OP_LOADKX: case OP_GETG:
+    case OP_EQ:  case OP_NE:   case OP_NEWM:   case OP_NEWS:
+    case OP_EQI: case OP_NEI:
+        return true;
+    default:
+        return false;
+    }
+}
+
+
+//*************************************************************************
+static void transfer(const es_irfunc *f, const es_irblock *bl, regset *live)
+{
+    // live before the block from live after it
+    for(size_t n = bl->last; n > bl->first; --n)
+    {
+        const es_irins *in = f->ins.data + n - 1;
+        if(in->dead) continue;
+
+        effect e;
+        effects(f, in, &e);
+
+        for(int i = 0; i < ES_IR_REGS / 64; ++i)
+            live->w[i] = (live->w[i] & ~e.def.w[i]) | e.use.w[i];
+    }
+}
+
+
+//*************************************************************************
+static size_t dce(es_irfunc *f)
+{
+    // drops writes nothing reads before the register is written again
+
+    size_t nb = f->blocks.size;
+    size_t changes = 0;
+
+    regset *in = (regset*) es_malloc(&f->es->alloc, nb * sizeof(regset));
+    if(!in) return 0;
+
+    memset(in, 0, nb * sizeof(regset));
+
+    // live on entry to each block, until nothing changes
+    for(bool again = true; again;)
+    {
+        again = false;
+
+        for(size_t b = nb; b > 0; --b)
+        {
+            es_irblock *bl = f->blocks.data + b - 1;
+
+            regset live;
+            memset(&live, 0, sizeof(regset));
+
+            for(int i = 0; i < ES_IR_REGS / 64; ++i)
+            {
+                if(bl->next   != (size_t) -1) live.w[i] |= in[bl->next].w[i];
+                if(bl->branch != (size_t) -1) live.w[i] |= in[bl->branch].w[i];
+            }
+
+            transfer(f, bl, &live);
+
+            if(memcmp(&live, in + b - 1, sizeof(regset)) != 0)
+            {
+                in[b - 1] = live;
+                again = true;
+            }
+        }
+    }
+
+    for(size_t b = 0; b < nb; ++b)
+    {
+        es_irblock *bl = f->blocks.data + b;
+
+        regset live;
+        memset(&live, 0, sizeof(regset));
+
+        for(int i = 0; i < ES_IR_REGS / 64; ++i)
+        {
+            if(bl->next   != (size_t) -1) live.w[i] |= in[bl->next].w[i];
+            if(bl->branch != (size_t) -1) live.w[i] |= in[bl->branch].w[i];
+        }
+
+        for(size_t n = bl->last; n > bl->first; --n)
+        {
+            es_irins *ins = f->ins.data + n - 1;
+            if(ins->dead) continue;
+
+            effect e;
+            effects(f, ins, &e);
+
+            bool self = ins->op == OP_MOV && ins->b == ins->a << 1;
+
+            if(self || (removable(ins->op) && !rsany(&e.def, &live)))
+            {
+                ins->dead = true;
+                changes += 1;
+                continue;
+            }
+
+            for(int i = 0; i < ES_IR_REGS / 64; ++i)
+                live.w[i] = (live.w[i] & ~e.def.w[i]) | e.use.w[i];
+        }
+    }
+
+    es_free(&f->es->alloc, in, nb * sizeof(regset));
+    return changes;
+}
+
+
+//*************************************************************************
+typedef size_t (*es_irpass)(es_irfunc *f);
+
+static const es_irpass passes[] = { cse, copyprop, dce };
+
+#define ES_IR_PASSES (sizeof passes / sizeof *passes)
+
+
+//*************************************************************************
+size_t es_ir_optimize(es_irfunc *f)
+{
+    // each pass opens things up for the others, stop once none finds more
+    for(int round = 0; round < 8; ++round)
+    {
+        size_t changes = 0;
+
+        for(size_t p = 0; p < ES_IR_PASSES; ++p)
+            changes += passes[p](f);
+
+        if(changes == 0) break;
+    }
+
+    size_t removed = 0;
+    for(size_t n = 0; n < f->ins.size; ++n)
+        removed += f->ins.data[n].dead;
+
+    return removed;
+}
+
+
+
+// [[[[[[ peephole ]]]]]]
+
+
+//*************************************************************************
+static es_irins *nextlive(es_irfunc *f, size_t n)
+{
+    for(; n < f->ins.size; ++n)
+        if(!f->ins.data[n].dead) return f->ins.data + n;
+    return NULL;
+}
+
+
+//*************************************************************************
+static size_t substitute(es_irins *in, u32 reg, u32 src)
+{
+    // reads of 'reg' read 'src' instead where the field can hold it
+    size_t n = 0;
+    operands o;
+    getoperands(in, &o);
+
+    for(int k = 0; k < 2; ++k)
+    {
+        if(!o.rk[k] || *o.rk[k] != reg << 1 || !fits(src, o.y)) continue;
+        *o.rk[k] = src;
+        ++n;
+    }
+
+    if(o.r && *o.r == reg && !ISK(src) && (src >> 1) < (1 << ASIZE))
+    {
+        *o.r = src >> 1;
+        ++n;
+    }
+
+    return n;
+}
+
+
+//*************************************************************************
+static size_t window(es_irfunc *f, es_peepstats *st)
+{
+    // rewrites pairs of neighbours in a block
+
+    size_t changes = 0;
+
+    for(size_t b = 0; b < f->blocks.size; ++b)
+    {
+        es_irblock *bl = f->blocks.data + b;
+
+        for(size_t n = bl->first; n < bl->last; ++n)
+        {
+            es_irins *in = f->ins.data + n;
+            if(in->dead) continue;
+
+            // mov r, r
+            if(in->op == OP_MOV && in->b == in->a << 1)
+            {
+                in->dead = true;
+                st->selfmoves += 1;
+                changes += 1;
+                continue;
+            }
+
+            es_irins *next = nextlive(f, n + 1);
+            if(!next || (size_t) (next - f->ins.data) >= bl->last) continue;
+
+            effect e;
+            effects(f, next, &e);
+
+            if(e.opaque || !rshas(&e.def, in->a)) continue;
+
+            // a write nothing reads before the next one overwrites it
+            if(removable(in->op) && !rshas(&e.use, in->a))
+            {
+                in->dead = true;
+                st->deadstores += 1;
+                changes += 1;
+                continue;
+            }
+
+            // mov a, b then an op that reads a and writes it, reads b
+            if(in->op == OP_MOV)
+            {
+                es_irins t = *next;
+
+                if(substitute(&t, in->a, in->b) == 0) continue;
+
+                effects(f, &t, &e);
+                if(rshas(&e.use, in->a)) continue;
+
+                *next = t;
+                in->dead = true;
+                st->forwarded += 1;
+                changes += 1;
+            }
+        }
+    }
+
+    return changes;
+}
+
+
+//*************************************************************************
+static size_t jumps(es_irfunc *f, es_peepstats *st)
+{
+    // a jump to a jmp 0 goes where that one goes, a jump to the next
+    // instruction does nothing
+
+    size_t changes = 0;
+
+    for(size_t n = 0; n < f->ins.size; ++n)
+    {
+        es_irins *in = f->ins.data + n;
+        if(in->dead || in->op != OP_JMP) continue;
+
+        // bounded, jumps can go round in circles
+        for(int hops = 0; hops < 16; ++hops)
+        {
+            es_irins *to = nextlive(f, (size_t) in->target);
+            if(!to || to->op != OP_JMP || to->a != 0 || to == in) break;
+
+            in->target = to->target;
+            st->jumps += 1;
+            changes += 1;
+        }
+
+        if(nextlive(f, (size_t) in->target) == nextlive(f, n + 1))
+        {
+            in->dead = true;
+            st->jumps += 1;
+            changes += 1;
+        }
+    }
+
+    return changes;
+}
+
+
+//*************************************************************************
+static size_t peephole(es_irfunc *f, es_peepstats *st)
+{
+    size_t total = 0;
+
+    for(int round = 0; round < 8; ++round)
+    {
+        size_t changes = jumps(f, st);
+
+        if(changes > 0 && !es_ir_blocks(f)) break;
+
+        changes += window(f, st);
+        total   += changes;
+
+        if(changes == 0) break;
+    }
+
+    return total;
+}
+
+
+//*************************************************************************
+typedef struct reloc_t
+{
+    void **slot;   // a pointer into the chunk
+    size_t *size;  // and its function's size, or NULL
+    size_t first;  // bound it starts at
+    size_t last;   // bound it ends at
+} reloc;
+
+
+es_array(reloc);
+
+
+//*************************************************************************
+static int cmpsize(const void *l, const void *r)
+{
+    size_t a = *(const size_t*) l, b = *(const size_t*) r;
+    return (a > b) - (a < b);
+}
+
+
+//*************************************************************************
+static size_t bound(const size_t_arr *bounds, size_t at)
+{
+    size_t lo = 0, hi = bounds->size;
+
+    while(lo + 1 < hi)
+    {
+        size_t mid = (lo + hi) / 2;
+        if(bounds->data[mid] <= at) lo = mid;
+        else hi = mid;
+    }
+
+    return lo;
+}
+
+
+//*************************************************************************
+size_t es_peephole(es_state *es, es_code *code, es_peepstats *stats)
+{
+    // functions and function pointers into the chunk split it up. each
+    // piece is rewritten on its own and moved up as the ones before shrink
+
+    size_t size = code->size;
+    es_instruction *base = code->instructions;
+
+    es_peepstats st;
+    memset(&st, 0, sizeof(es_peepstats));
+
+    if(stats) *stats = st;
+    if(size == 0) return 0;
+
+    size_t_arr bounds;
+    reloc_arr relocs;
+    es_construct_array(size_t, bounds, &es->alloc);
+    es_construct_array(reloc, relocs, &es->alloc);
+
+    // any piece that couldn't be recorded leaves the chunk as it is
+    int ok = es_arrpushv(size_t, bounds, 0) && es_arrpushv(size_t, bounds, size);
+
+    for(size_t i = 0; i < es->funcs.size; ++i)
+    {
+        es_function *fn = es->funcs.data + i;
+        if(!fn->ip || fn->ip < base || fn->ip >= base + size) continue;
+
+        size_t at  = (size_t)(fn->ip - base);
+        size_t end = at + fn->size > size ? size : at + fn->size;
+
+        ok = ok && es_arrpushv(size_t, bounds, at) && es_arrpushv(size_t, bounds, end) && es_arrpush(reloc, relocs);
+        if(!ok) break;
+
+        reloc *r = &es_arrback(relocs);
+        r->slot = (void**) &fn->ip;
+        r->size = &fn->size;
+        r->first = at;
+        r->last = end;
+    }
+
+    for(size_t i = 0; i < es->kst.size; ++i)
+    {
+        es_value *v = es->kst.data + i;
+        es_instruction *ip = (es_instruction*) v->p;
+        if(v->tid != ES_FUNCPTR || ip < base || ip >= base + size) continue;
+
+        size_t at = (size_t)(ip - base);
+        ok = ok && es_arrpushv(size_t, bounds, at) && es_arrpush(reloc, relocs);
+        if(!ok) break;
+
+        reloc *r = &es_arrback(relocs);
+        r->slot = &v->p;
+        r->size = NULL;
+        r->first = r->last = at;
+    }
+
+    qsort(bounds.data, bounds.size, sizeof(size_t), cmpsize);
+
+    size_t unique = 0;
+    for(size_t i = 0; i < bounds.size; ++i)
+        if(unique == 0 || bounds.data[unique - 1] != bounds.data[i])
+            bounds.data[unique++] = bounds.data[i];
+    bounds.size = unique;
+
+    // where each bound moves to
+    size_t *moved = ok ? (size_t*) es_malloc(&es->alloc, bounds.size * sizeof(size_t)) : NULL;
+
+    size_t w = 0;
+
+    for(size_t k = 0; moved && k + 1 < bounds.size; ++k)
+    {
+        size_t first = bounds.data[k];
+        size_t count = bounds.data[k + 1] - first;
+
+        moved[k] = w;
+
+        es_irfunc ir;
+        if(es_ir_build(&ir, es, base + first, count) && peephole(&ir, &st) > 0)
+            w += es_ir_lower(&ir, base + w);
+        else
+        {
+            memmove(base + w, base + first, count * sizeof(es_instruction));
+            w += count;
+        }
+
+        es_ir_destroy(&ir);
+    }
+
+    if(moved)
+    {
+        moved[bounds.size - 1] = w;
+
+        es_instruction *shrunk = base;
+
+        if(w < size)
+        {
+            shrunk = (es_instruction*) es_realloc(&es->alloc, base, size * sizeof(es_instruction), w * sizeof(es_instruction));
+
+            // keeps its size then, nothing jumps into the tail
+            if(!shrunk)
+            {
+                shrunk = base;
+                for(size_t i = w; i < size; ++i) base[i] = INS_OX(OP_RET, 0);
+            }
+            else code->size = w;
+        }
+
+        code->instructions = shrunk;
+
+        for(size_t i = 0; i < relocs.size; ++i)
+        {
+            reloc *r = relocs.data + i;
+            size_t first = moved[bound(&bounds, r->first)];
+
+            *r->slot = shrunk + first;
+            if(r->size) *r->size = moved[bound(&bounds, r->last)] - first;
+        }
+
+        es_free(&es->alloc, moved, bounds.size * sizeof(size_t));
+    }
+
+    es_destroy_array(size_t, bounds);
+    es_destroy_array(reloc, relocs);
+
+    // a chunk that couldn't shrink still has the rewritten pieces in front
+    st.removed = moved ? size - w : 0;
+    if(stats) *stats = st;
+
+    return st.removed;
+}
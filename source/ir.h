@@ -0,0 +1,81 @@
+/********************************************************************************
+ * \file ir.h
+ * \author Patrick Torgeson (torgersonpatricks@gmail.com)
+ * \brief a function's bytecode opened up into three address code and basic
+ *        blocks, the optimizer's passes work on this and lower it back
+ * \version 0.1
+ * \date 2022-01-25
+ *
+ * @copyright Copyright (c) 2022
+ *
+ ********************************************************************************/
+
+
+#ifndef ES_IR_H
+#define ES_IR_H
+
+
+#include "common.h"
+#include "instruction.h"
+#include "vm.h"
+
+
+// an instruction with its fields decoded. y is kept in b, loadkx has the
+// index of its extraarg in b, jumps point at the instruction they land on
+typedef struct es_irins_t
+{
+    es_opcode op;
+    u32 a;
+    u32 b;
+    u32 c;
+    i64 target; // jmp only, may be the end of the function
+    size_t at;  // where lowering puts it
+    bool dead;
+} es_irins;
+
+
+typedef struct es_irblock_t
+{
+    size_t first;
+    size_t last;   // one past
+    size_t next;   // fallthrough successor, or -1
+    size_t branch; // jump successor, or -1
+} es_irblock;
+
+
+es_array(es_irins);
+es_array(es_irblock);
+
+
+typedef struct es_irfunc_t
+{
+    es_state *es;
+    es_irins_arr ins;
+    es_irblock_arr blocks;
+} es_irfunc;
+
+
+// 0 when out of memory or a jump leaves the code, destroy 'f' either way
+int es_ir_build(es_irfunc *f, es_state *es, const es_instruction *code, size_t size);
+void es_ir_destroy(es_irfunc *f);
+
+// finds the basic blocks again, passes call this after moving jumps around
+int es_ir_blocks(es_irfunc *f);
+
+// writes the live instructions back to 'code' and returns how many there
+// are now, never more than were built from
+size_t es_ir_lower(es_irfunc *f, es_instruction *code);
+
+// runs the passes until none of them finds more, returns the instructions
+// it got rid of
+size_t es_ir_optimize(es_irfunc *f);
+
+// rewrites small windows of a whole chunk: self moves, moves into an op
+// that overwrites their target, stores overwritten right away, jumps to
+// jumps and jumps to the next instruction. functions and function
+// pointers into the chunk are moved along, returns the instructions saved.
+// what it did per kind goes in 'stats' when it isn't NULL
+size_t es_peephole(es_state *es, es_code *code, es_peepstats *stats);
+
+
+#endif
@@ -0,0 +1,542 @@
+#include "kernels.h"
+
+
+#if defined(_M_X64) || defined(__x86_64__)
+#define ES_SIMD_X64
+#include <immintrin.h>
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+#endif
+
+
+// msvc emits avx2 intrinsics anywhere, gcc / clang need them enabled per function
+#if defined(__GNUC__)
+#define ES_AVX2 __attribute__((target("avx2")))
+#else
+#define ES_AVX2
+#endif
+
+
+// [[[[[[[[[[[[[[[[[[[[[[[[[[[[[[[[[[[ Scalar ]]]]]]]]]]]]]]]]]]]]]]]]]]]]]]]]]]]
+
+
+//*************************************************************************
+static f64 sumf_scalar(const f64 *a, size_t n)
+{
+    f64 s = 0.0;
+    for(size_t i = 0; i < n; ++i) s += a[i];
+    return s;
+}
+
+
+//*************************************************************************
+static f64 minf_scalar(const f64 *a, size_t n)
+{
+    f64 m = a[0];
+    for(size_t i = 1; i < n; ++i) if(a[i] < m) m = a[i];
+    return m;
+}
+
+
+//*************************************************************************
+static f64 maxf_scalar(const f64 *a, size_t n)
+{
+    f64 m = a[0];
+    for(size_t i = 1; i < n; ++i) if(a[i] > m) m = a[i];
+    return m;
+}
+
+
+//*************************************************************************
+static f64 dotf_scalar(const f64 *a, const f64 *b, size_t n)
+{
+    f64 s = 0.0;
+    for(size_t i = 0; i < n; ++i) s += a[i] * b[i];
+    return s;
+}
+
+
+//*************************************************************************
+static void scalef_scalar(f64 *a, f64 k, size_t n)
+{
+    for(size_t i = 0; i < n; ++i) a[i] *= k;
+}
+
+
+//*************************************************************************
+static void addf_scalar(f64 *a, const f64 *b, size_t n)
+{
+    for(size_t i = 0; i < n; ++i) a[i] += b[i];
+}
+
+
+//*************************************************************************
+static void maskf_scalar(u8 *m, const f64 *a, f64 x, size_t n)
+{
+    for(size_t i = 0; i < n; ++i) m[i] = a[i] < x;
+}
+
+
+//*************************************************************************
+static i64 sumi_scalar(const i64 *a, size_t n)
+{
+    u64 s = 0;
+    for(size_t i = 0; i < n; ++i) s += (u64) a[i];
+    return (i64) s;
+}
+
+
+//*************************************************************************
+static void addi_scalar(i64 *a, const i64 *b, size_t n)
+{
+    for(size_t i = 0; i < n; ++i) a[i] = (i64)((u64) a[i] + (u64) b[i]);
+}
+
+
+//*************************************************************************
+static u64 sumb_scalar(const u8 *a, size_t n)
+{
+    u64 s = 0;
+    for(size_t i = 0; i < n; ++i) s += a[i];
+    return s;
+}
+
+
+#ifdef ES_SIMD_X64
+
+
+// [[[[[[[[[[[[[[[[[[[[[[[[[[[[[[[[[[[ SSE2 ]]]]]]]]]]]]]]]]]]]]]]]]]]]]]]]]]]]
+
+
+//*************************************************************************
+static f64 hsum_sse2(__m128d v)
+{
+    return _mm_cvtsd_f64(_mm_add_sd(v, _mm_unpackhi_pd(v, v)));
+}
+
+
+//*************************************************************************
+static f64 sumf_sse2(const f64 *a, size_t n)
+{
+    __m128d s0 = _mm_setzero_pd();
+    __m128d s1 = _mm_setzero_pd();
+    size_t i = 0;
+
+    for(; i + 4 <= n; i += 4)
+    {
+        s0 = _mm_add_pd(s0, _mm_loadu_pd(a + i));
+        s1 = _mm_add_pd(s1, _mm_loadu_pd(a + i + 2));
+    }
+
+    return hsum_sse2(_mm_add_pd(s0, s1)) + sumf_scalar(a + i, n - i);
+}
+
+
+//*************************************************************************
+static f64 minf_sse2(const f64 *a, size_t n)
+{
+    if(n < 2) return a[0];
+
+    __m128d m = _mm_loadu_pd(a);
+    size_t i = 2;
+
+    for(; i + 2 <= n; i += 2)
+        m = _mm_min_pd(m, _mm_loadu_pd(a + i));
+
+    m = _mm_min_sd(m, _mm_unpackhi_pd(m, m));
+    f64 r = _mm_cvtsd_f64(m);
+
+    return i < n && a[i] < r ? a[i] : r;
+}
+
+
+//*************************************************************************
+static f64 maxf_sse2(const f64 *a, size_t n)
+{
+    if(n < 2) return a[0];
+
+    __m128d m = _mm_loadu_pd(a);
+    size_t i = 2;
+
+    for(; i + 2 <= n; i += 2)
+        m = _mm_max_pd(m, _mm_loadu_pd(a + i));
+
+    m = _mm_max_sd(m, _mm_unpackhi_pd(m, m));
+    f64 r = _mm_cvtsd_f64(m);
+
+    return i < n && a[i] > r ? a[i] : r;
+}
+
+
+//*************************************************************************
+static f64 dotf_sse2(const f64 *a, const f64 *b, size_t n)
+{
+    __m128d s0 = _mm_setzero_pd();
+    __m128d s1 = _mm_setzero_pd();
+    size_t i = 0;
+
+    for(; i + 4 <= n; i += 4)
+    {
+        s0 = _mm_add_pd(s0, _mm_mul_pd(_mm_loadu_pd(a + i),     _mm_loadu_pd(b + i)));
+        s1 = _mm_add_pd(s1, _mm_mul_pd(_mm_loadu_pd(a + i + 2), _mm_loadu_pd(b + i + 2)));
+    }
+
+    return hsum_sse2(_mm_add_pd(s0, s1)) + dotf_scalar(a + i, b + i, n - i);
+}
+
+
+//*************************************************************************
+static void scalef_sse2(f64 *a, f64 k, size_t n)
+{
+    __m128d vk = _mm_set1_pd(k);
+    size_t i = 0;
+
+    for(; i + 2 <= n; i += 2)
+        _mm_storeu_pd(a + i, _mm_mul_pd(_mm_loadu_pd(a + i), vk));
+
+    scalef_scalar(a + i, k, n - i);
+}
+
+
+//*************************************************************************
+static void addf_sse2(f64 *a, const f64 *b, size_t n)
+{
+    size_t i = 0;
+
+    for(; i + 2 <= n; i += 2)
+        _mm_storeu_pd(a + i, _mm_add_pd(_mm_loadu_pd(a + i), _mm_loadu_pd(b + i)));
+
+    addf_scalar(a + i, b + i, n - i);
+}
+
+
+//*************************************************************************
+static void maskf_sse2(u8 *m, const f64 *a, f64 x, size_t n)
+{
+    __m128d vx = _mm_set1_pd(x);
+    size_t i = 0;
+
+    for(; i + 2 <= n; i += 2)
+    {
+        int bits = _mm_movemask_pd(_mm_cmplt_pd(_mm_loadu_pd(a + i), vx));
+        m[i]     = bits & 1;
+        m[i + 1] = (bits >> 1) & 1;
+    }
+
+    maskf_scalar(m + i, a + i, x, n - i);
+}
+
+
+//*************************************************************************
+static i64 sumi_sse2(const i64 *a, size_t n)
+{
+    __m128i s = _mm_setzero_si128();
+    size_t i = 0;
+
+    for(; i + 2 <= n; i += 2)
+        s = _mm_add_epi64(s, _mm_loadu_si128((const __m128i*)(a + i)));
+
+    s = _mm_add_epi64(s, _mm_unpackhi_epi64(s, s));
+
+    return (i64)((u64) _mm_cvtsi128_si64(s) + (u64) sumi_scalar(a + i, n - i));
+}
+
+
+//*************************************************************************
+static void addi_sse2(i64 *a, const i64 *b, size_t n)
+{
+    size_t i = 0;
+
+    for(; i + 2 <= n; i += 2)
+    {
+        __m128i va = _mm_loadu_si128((const __m128i*)(a + i));
+        __m128i vb = _mm_loadu_si128((const __m128i*)(b + i));
+        _mm_storeu_si128((__m128i*)(a + i), _mm_add_epi64(va, vb));
+    }
+
+    addi_scalar(a + i, b + i, n - i);
+}
+
+
+//*************************************************************************
+static u64 sumb_sse2(const u8 *a, size_t n)
+{
+    // sad against zero sums each group of 8 bytes into a 64 bit lane
+    __m128i s = _mm_setzero_si128();
+    __m128i z = _mm_setzero_si128();
+    size_t i = 0;
+
+    for(; i + 16 <= n; i += 16)
+        s = _mm_add_epi64(s, _mm_sad_epu8(_mm_loadu_si128((const __m128i*)(a + i)), z));
+
+    s = _mm_add_epi64(s, _mm_unpackhi_epi64(s, s));
+
+    return (u64) _mm_cvtsi128_si64(s) + sumb_scalar(a + i, n - i);
+}
+
+
+// [[[[[[[[[[[[[[[[[[[[[[[[[[[[[[[[[[[ AVX2 ]]]]]]]]]]]]]]]]]]]]]]]]]]]]]]]]]]]
+
+
+//*************************************************************************
+ES_AVX2 static f64 hsum_avx2(__m256d v)
+{
+    __m128d s = _mm_add_pd(_mm256_castpd256_pd128(v), _mm256_extractf128_pd(v, 1));
+    return _mm_cvtsd_f64(_mm_add_sd(s, _mm_unpackhi_pd(s, s)));
+}
+
+
+//*************************************************************************
+ES_AVX2 static f64 sumf_avx2(const f64 *a, size_t n)
+{
+    __m256d s0 = _mm256_setzero_pd();
+    __m256d s1 = _mm256_setzero_pd();
+    size_t i = 0;
+
+    for(; i + 8 <= n; i += 8)
+    {
+        s0 = _mm256_add_pd(s0, _mm256_loadu_pd(a + i));
+        s1 = _mm256_add_pd(s1, _mm256_loadu_pd(a + i + 4));
+    }
+
+    return hsum_avx2(_mm256_add_pd(s0, s1)) + sumf_sse2(a + i, n - i);
+}
+
+
+//*************************************************************************
+ES_AVX2 static f64 minf_avx2(const f64 *a, size_t n)
+{
+    if(n < 8) return minf_sse2(a, n);
+
+    __m256d m = _mm256_loadu_pd(a);
+    size_t i = 4;
+
+    for(; i + 4 <= n; i += 4)
+        m = _mm256_min_pd(m, _mm256_loadu_pd(a + i));
+
+    f64 lanes[4];
+    _mm256_storeu_pd(lanes, m);
+
+    f64 r = minf_scalar(lanes, 4);
+    if(i < n)
+    {
+        f64 t = minf_scalar(a + i, n - i);
+        if(t < r) r = t;
+    }
+    return r;
+}
+
+
+//*************************************************************************
+ES_AVX2 static f64 maxf_avx2(const f64 *a, size_t n)
+{
+    if(n < 8) return maxf_sse2(a, n);
+
+    __m256d m = _mm256_loadu_pd(a);
+    size_t i = 4;
+
+    for(; i + 4 <= n; i += 4)
+        m = _mm256_max_pd(m, _mm256_loadu_pd(a + i));
+
+    f64 lanes[4];
+    _mm256_storeu_pd(lanes, m);
+
+    f64 r = maxf_scalar(lanes, 4);
+    if(i < n)
+    {
+        f64 t = maxf_scalar(a + i, n - i);
+        if(t > r) r = t;
+    }
+    return r;
+}
+
+
+//*************************************************************************
+ES_AVX2 static f64 dotf_avx2(const f64 *a, const f64 *b, size_t n)
+{
+    __m256d s0 = _mm256_setzero_pd();
+    __m256d s1 = _mm256_setzero_pd();
+    size_t i = 0;
+
+    for(; i + 8 <= n; i += 8)
+    {
+        s0 = _mm256_add_pd(s0, _mm256_mul_pd(_mm256_loadu_pd(a + i),     _mm256_loadu_pd(b + i)));
+        s1 = _mm256_add_pd(s1, _mm256_mul_pd(_mm256_loadu_pd(a + i + 4), _mm256_loadu_pd(b + i + 4)));
+    }
+
+    return hsum_avx2(_mm256_add_pd(s0, s1)) + dotf_sse2(a + i, b + i, n - i);
+}
+
+
+//*************************************************************************
+ES_AVX2 static void scalef_avx2(f64 *a, f64 k, size_t n)
+{
+    __m256d vk = _mm256_set1_pd(k);
+    size_t i = 0;
+
+    for(; i + 4 <= n; i += 4)
+        _mm256_storeu_pd(a + i, _mm256_mul_pd(_mm256_loadu_pd(a + i), vk));
+
+    scalef_scalar(a + i, k, n - i);
+}
+
+
+//*************************************************************************
+ES_AVX2 static void addf_avx2(f64 *a, const f64 *b, size_t n)
+{
+    size_t i = 0;
+
+    for(; i + 4 <= n; i += 4)
+        _mm256_storeu_pd(a + i, _mm256_add_pd(_mm256_loadu_pd(a + i), _mm256_loadu_pd(b + i)));
+
+    addf_scalar(a + i, b + i, n - i);
+}
+
+
+//*************************************************************************
+ES_AVX2 static void maskf_avx2(u8 *m, const f64 *a, f64 x, size_t n)
+{
+    __m256d vx = _mm256_set1_pd(x);
+    size_t i = 0;
+
+    for(; i + 4 <= n; i += 4)
+    {
+        int bits = _mm256_movemask_pd(_mm256_cmp_pd(_mm256_loadu_pd(a + i), vx, _CMP_LT_OQ));
+        m[i]     = bits & 1;
+        m[i + 1] = (bits >> 1) & 1;
+        m[i + 2] = (bits >> 2) & 1;
+        m[i + 3] = (bits >> 3) & 1;
+    }
+
+    maskf_scalar(m + i, a + i, x, n - i);
+}
+
+
+//*************************************************************************
+ES_AVX2 static i64 sumi_avx2(const i64 *a, size_t n)
+{
+    __m256i s = _mm256_setzero_si256();
+    size_t i = 0;
+
+    for(; i + 4 <= n; i += 4)
+        s = _mm256_add_epi64(s, _mm256_loadu_si256((const __m256i*)(a + i)));
+
+    __m128i h = _mm_add_epi64(_mm256_castsi256_si128(s), _mm256_extracti128_si256(s, 1));
+    h = _mm_add_epi64(h, _mm_unpackhi_epi64(h, h));
+
+    return (i64)((u64) _mm_cvtsi128_si64(h) + (u64) sumi_scalar(a + i, n - i));
+}
+
+
+//*************************************************************************
+ES_AVX2 static void addi_avx2(i64 *a, const i64 *b, size_t n)
+{
+    size_t i = 0;
+
+    for(; i + 4 <= n; i += 4)
+    {
+        __m256i va = _mm256_loadu_si256((const __m256i*)(a + i));
+        __m256i vb = _mm256_loadu_si256((const __m256i*)(b + i));
+        _mm256_storeu_si256((__m256i*)(a + i), _mm256_add_epi64(va, vb));
+    }
+
+    addi_scalar(a + i, b + i, n - i);
+}
+
+
+//*************************************************************************
+ES_AVX2 static u64 sumb_avx2(const u8 *a, size_t n)
+{
+    __m256i s = _mm256_setzero_si256();
+    __m256i z = _mm256_setzero_si256();
+    size_t i = 0;
+
+    for(; i + 32 <= n; i += 32)
+        s = _mm256_add_epi64(s, _mm256_sad_epu8(_mm256_loadu_si256((const __m256i*)(a + i)), z));
+
+    __m128i h = _mm_add_epi64(_mm256_castsi256_si128(s), _mm256_extracti128_si256(s, 1));
+    h = _mm_add_epi64(h, _mm_unpackhi_epi64(h, h));
+
+    return (u64) _mm_cvtsi128_si64(h) + sumb_sse2(a + i, n - i);
+}
+
+
+//*************************************************************************
+static int has_avx2(void)
+{
+#if defined(_MSC_VER)
+    int r[4];
+
+    __cpuid(r, 0);
+    if(r[0] < 7) return 0;
+
+    // the os has to save ymm registers too
+    __cpuid(r, 1);
+    if(!(r[2] & (1 << 27)) || !(r[2] & (1 << 28))) return 0;
+    if((_xgetbv(0) & 6) != 6) return 0;
+
+    __cpuidex(r, 7, 0);
+    return (r[1] >> 5) & 1;
+#else
+    __builtin_cpu_init();
+    return __builtin_cpu_supports("avx2");
+#endif
+}
+
+
+#endif // ES_SIMD_X64
+
+
+#ifndef ES_SIMD_X64
+
+//*************************************************************************
+static const es_kernels scalar_kernels =
+{
+    "scalar",
+    sumf_scalar, minf_scalar, maxf_scalar, dotf_scalar, scalef_scalar, addf_scalar, maskf_scalar,
+    sumi_scalar, addi_scalar,
+    sumb_scalar,
+};
+
+#else
+
+//*************************************************************************
+static const es_kernels sse2_kernels =
+{
+    "sse2",
+    sumf_sse2, minf_sse2, maxf_sse2, dotf_sse2, scalef_sse2, addf_sse2, maskf_sse2,
+    sumi_sse2, addi_sse2,
+    sumb_sse2,
+};
+
+
+//*************************************************************************
+static const es_kernels avx2_kernels =
+{
+    "avx2",
+    sumf_avx2, minf_avx2, maxf_avx2, dotf_avx2, scalef_avx2, addf_avx2, maskf_avx2,
+    sumi_avx2, addi_avx2,
+    sumb_avx2,
+};
+
+#endif
+
+
+//*************************************************************************
+const es_kernels *es_get_kernels(void)
+{
+    // every thread computes the same answer, so the race is harmless
+    static const es_kernels *selected = NULL;
+
+    if(!selected)
+    {
+#ifdef ES_SIMD_X64
+        selected = has_avx2() ? &avx2_kernels : &sse2_kernels;
+#else
+        selected = &scalar_kernels;
+#endif
+    }
+
+    return selected;
+}
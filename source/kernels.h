@@ -0,0 +1,44 @@
+/********************************************************************************
+ * \file kernels.h
+ * \author Patrick Torgeson (torgersonpatricks@gmail.com)
+ * \brief bulk numeric kernels for es_numarray, picked once at runtime
+ * \version 0.1
+ * \date 2022-01-18
+ *
+ * @copyright Copyright (c) 2022
+ *
+ ********************************************************************************/
+
+
+#ifndef ES_KERNELS_H
+#define ES_KERNELS_H
+
+
+#include "common.h"
+
+
+// min / max expect n > 0, mask writes 1 where a[i] < x
+typedef struct es_kernels_t
+{
+    const char *isa;
+
+    f64  (*sumf)(const f64 *a, size_t n);
+    f64  (*minf)(const f64 *a, size_t n);
+    f64  (*maxf)(const f64 *a, size_t n);
+    f64  (*dotf)(const f64 *a, const f64 *b, size_t n);
+    void (*scalef)(f64 *a, f64 k, size_t n);
+    void (*addf)(f64 *a, const f64 *b, size_t n);
+    void (*maskf)(u8 *m, const f64 *a, f64 x, size_t n);
+
+    i64  (*sumi)(const i64 *a, size_t n);
+    void (*addi)(i64 *a, const i64 *b, size_t n);
+
+    u64  (*sumb)(const u8 *a, size_t n);
+} es_kernels;
+
+
+// selects the widest instruction set the cpu supports on first use
+const es_kernels *es_get_kernels(void);
+
+
+#endif
@@ -17,6 +17,8 @@ typedef struct lexstate_t
     int line;
     int col;
     int indent;
+
+    int oom;  // a lexeme couldn't be stored
 } lexstate;
 
 
@@ -71,6 +73,8 @@ static int isdelimiter(char c)
     if(isillegal(c))   return 1;
     if(c == ';')       return 1;
     if(c == ',')       return 1;
+    if(c == ':')       return 1;
+    if(c == '.')       return 1;
     if(c == '\'')      return 1;
     if(c == '\"')      return 1;
     if(c == '=')      return 1;
@@ -121,7 +125,11 @@ static void push_lexeme(lexstate* ls, int type)
 
     // push lexeme
 
-    es_arrpush(es_lexeme, (*ls->lexemes));
+    if(!es_arrpush(es_lexeme, (*ls->lexemes)))
+    {
+        ls->oom = 1;
+        return;
+    }
 
     es_arrback((*ls->lexemes)).ptr  = ls->c;
     es_arrback((*ls->lexemes)).size = ls->lsize;
@@ -338,12 +346,13 @@ int es_lex(const char *source, size_t ssize, es_lexeme_arr *lexemes)
     ls.col  = 1;
 
     ls.indent = 0;
+    ls.oom = 0;
 
     while(*ls.c == ' ') ls.indent += 1;
 
     const char* end = source + ssize;
 
-    for(; ls.c < end && *ls.c != '\0'; nextc(&ls))
+    for(; !ls.oom && ls.c < end && *ls.c != '\0'; nextc(&ls))
     {
         // whitespace
         if(isspace(*ls.c)) continue;
@@ -371,6 +380,10 @@ int es_lex(const char *source, size_t ssize, es_lexeme_arr *lexemes)
             push_char(&ls, LEX_CLOSE_CURLY);
         else if(*ls.c == ',')
             push_char(&ls, LEX_COMMA);
+        else if(*ls.c == ':')
+            push_char(&ls, LEX_COLON);
+        else if(*ls.c == '.')
+            push_char(&ls, LEX_DOT);
 
         // keyword , identifier , boolean , nill
         else if(isalpha(*ls.c))
@@ -436,7 +449,7 @@ int es_lex(const char *source, size_t ssize, es_lexeme_arr *lexemes)
     ls.lsize = 0;
     push_lexeme(&ls, LEX_EOF);
 
-    return -360;
+    return ls.oom ? -1 : 0;
 }
 
 
@@ -95,6 +95,8 @@ typedef enum es_lexeme_type
     LEX_CLOSE_CURLY,
     LEX_SEMICOLON,
     LEX_COMMA,
+    LEX_COLON,
+    LEX_DOT,
     LEX_EQUAL,
 
     // white space
@@ -135,6 +137,7 @@ typedef struct es_lexeme_t
 es_array(es_lexeme);
 
 
+// -1 when out of memory, the lexemes are then incomplete
 int es_lex(const char *source, size_t ssize, es_lexeme_arr *lexemes);
 void es_print_lexeme(es_lexeme *lexeme);
 
@@ -1,187 +1,809 @@
 #include "map.h"
+#include "hash.h"
 
 #include <stdlib.h>
 #include <stdio.h>
 
 
-#define MAP_MAX_LOAD     0.75
-#define MAP_TARGET_LOAD  0.5
+#if defined(_M_X64) || defined(__x86_64__) || defined(__SSE2__)
+#define ES_MAP_SSE2
+#include <emmintrin.h>
+#endif
+
+
+// control bytes, full slots hold the low 7 bits of their hash
+#define CTRL_EMPTY    ((u8) 0x80)
+#define CTRL_DELETED  ((u8) 0xFE)
+
+#define MAP_GROUP     16u
+#define MAP_MINCAP    16u
+
+// max load is 7/8, counting tombstones, it's also how many entries an
+// index of 'cap' slots can address
+#define MAP_MAXLOAD(cap) ((cap) - (cap) / 8)
+
+// entries grow by half from here until the index is full
+#define MAP_MINENTRIES   8u
+
+// erased entries keep their place until the next rebuild
+#define HOLE ((es_typeid) -1)
+
+#define NOSLOT ((size_t) -1)
+
+#define H1(h) ((h) >> 7)
+#define H2(h) ((u8)((h) & 0x7F))
+
+#define HASH(m,k) es_hash_value((k), (m)->seed)
+
+// keys hashed and prefetched ahead of probing by the batch calls, and
+// the table size below which it's assumed cached and not worth it
+#define MAP_BATCH        16u
+#define MAP_FARBYTES     (512u * 1024u)
+
+#if defined(__GNUC__) || defined(__clang__)
+#define PREFETCH(p) __builtin_prefetch(p)
+#elif defined(ES_MAP_SSE2)
+#define PREFETCH(p) _mm_prefetch((const char*)(p), _MM_HINT_T0)
+#else
+#define PREFETCH(p) ((void) 0)
+#endif
+
+// old slots moved per insert or erase while resizing, and the
+// largest table that is still moved all at once
+#define MAP_MIGRATE      64u
+#define MAP_SYNCMIGRATE  1024u
+
+
+// [[[[[[[[[[[[[[[[[[[[[[[[[[[[[[[[[[[ Groups ]]]]]]]]]]]]]]]]]]]]]]]]]]]]]]]]]]]
+
+
+// bit i of a mask is set when byte i of the group matches
+
+#ifdef ES_MAP_SSE2
+
+//*************************************************************************
+static u32 matchbyte(const u8 *group, u8 b)
+{
+    __m128i g = _mm_loadu_si128((const __m128i*) group);
+    return (u32) _mm_movemask_epi8(_mm_cmpeq_epi8(g, _mm_set1_epi8((char) b)));
+}
+
+
+//*************************************************************************
+static u32 matchfree(const u8 *group)
+{
+    // empty and deleted are the only control bytes with the high bit set
+    return (u32) _mm_movemask_epi8(_mm_loadu_si128((const __m128i*) group));
+}
+
+#else
+
+//*************************************************************************
+static u32 matchbyte(const u8 *group, u8 b)
+{
+    u32 mask = 0;
+    for(u32 i = 0; i < MAP_GROUP; ++i)
+        mask |= (u32)(group[i] == b) << i;
+    return mask;
+}
+
+
+//*************************************************************************
+static u32 matchfree(const u8 *group)
+{
+    u32 mask = 0;
+    for(u32 i = 0; i < MAP_GROUP; ++i)
+        mask |= (u32)(group[i] >> 7) << i;
+    return mask;
+}
+
+#endif
+
+
+//*************************************************************************
+static u32 lowbit(u32 mask)
+{
+    u32 n = 0;
+    while(!(mask & 1)) { mask >>= 1; ++n; }
+    return n;
+}
+
+
+//*************************************************************************
+static void setctrl(es_maptable *t, size_t i, u8 c)
+{
+    // the first group is mirrored past the end so groups never wrap
+    t->ctrl[i] = c;
+    if(i < MAP_GROUP - 1)
+        t->ctrl[t->capacity + i] = c;
+}
+
+
+//*************************************************************************
+static int keyequal(es_value *a, es_value *b)
+{
+    if(a->tid != b->tid) return 0;
+    if(a->u == b->u)     return 1;
+    if(a->tid != ES_STRING) return 0;
+    return es_cmp_strings(AS_STRING(a), AS_STRING(b)) == 0;
+}
+
+
+// [[[[[[[[[[[[[[[[[[[[[[[[[[[[[[[[[[[ Index ]]]]]]]]]]]]]]]]]]]]]]]]]]]]]]]]]]]
 
 
 //*************************************************************************
-size_t hashvalue(es_value *v)
+static size_t width(size_t capacity)
 {
-    // FNV-1a hash : http://www.isthe.com/chongo/tech/comp/fnv/
-    const size_t FNV_prime    = 1099511628211ull;
-    const size_t offset_basis = 14695981039346656037ull;
+    // bytes per index slot, enough to address MAP_MAXLOAD(capacity) entries
+    if(capacity <= 0x100ull)       return 1;
+    if(capacity <= 0x10000ull)     return 2;
+    if(capacity <= 0x100000000ull) return 4;
+    return 8;
+}
+
 
-    size_t hash = offset_basis;
+//*************************************************************************
+static size_t blocksize(size_t capacity)
+{
+    // control bytes then entry positions, one allocation
+    return capacity + MAP_GROUP + capacity * width(capacity);
+}
 
-    uint8_t* end = ((uint8_t*)v) + sizeof(es_value);
 
-    for(uint8_t* octet = (uint8_t*) v; octet != end; ++octet)
+//*************************************************************************
+static size_t getslot(es_maptable *t, size_t i)
+{
+    switch(t->width)
     {
-        hash ^= *octet;
-        hash *= FNV_prime;
+    case 1:  return ((u8*)  t->index)[i];
+    case 2:  return ((u16*) t->index)[i];
+    case 4:  return ((u32*) t->index)[i];
+    default: return (size_t)((u64*) t->index)[i];
     }
+}
+
 
-    if(v->tid == ES_STRING)
+//*************************************************************************
+static void putslot(es_maptable *t, size_t i, size_t e)
+{
+    switch(t->width)
     {
-        for(char *c = AS_STRING(v)->data; *c != '\0'; ++c)
-        {
-            hash ^= *c;
-            hash *= FNV_prime;
-        }
+    case 1:  ((u8*)  t->index)[i] = (u8)  e; break;
+    case 2:  ((u16*) t->index)[i] = (u16) e; break;
+    case 4:  ((u32*) t->index)[i] = (u32) e; break;
+    default: ((u64*) t->index)[i] = (u64) e; break;
     }
+}
+
+
+//*************************************************************************
+static int allocate(es_allocator *alloc, es_maptable *t, size_t capacity)
+{
+    // only control bytes are initialized, positions are read once marked full
 
-    return hash;
+    u8 *block = es_malloc(alloc, blocksize(capacity));
+    if(!block) return 0;
+
+    t->ctrl       = block;
+    t->index      = block + capacity + MAP_GROUP;
+    t->capacity   = capacity;
+    t->size       = 0;
+    t->tombstones = 0;
+    t->width      = (u8) width(capacity);
+
+    memset(t->ctrl, CTRL_EMPTY, capacity + MAP_GROUP);
+
+    return 1;
+}
+
+
+//*************************************************************************
+static void release(es_allocator *alloc, es_maptable *t)
+{
+    if(t->ctrl) es_free(alloc, t->ctrl, blocksize(t->capacity));
+
+    t->ctrl       = NULL;
+    t->index      = NULL;
+    t->capacity   = 0;
+    t->size       = 0;
+    t->tombstones = 0;
+    t->width      = 0;
 }
 
 
 //*************************************************************************
-es_map_node *probe(es_map *map, es_value *key)
+static size_t find(es_map *map, es_maptable *t, es_value *key, size_t hash)
 {
-    size_t index = hashvalue(key) % map->capacity;
-    size_t i = index;
+    // the slot whose entry holds 'key', or NOSLOT
 
-    // first encountered tombstone
-    es_map_node *tombstone = NULL;
+    if(t->size == 0) return NOSLOT;
 
-    for(;;)
+    size_t mask = t->capacity - 1;
+    size_t pos  = H1(hash) & mask;
+    u8 h2 = H2(hash);
+
+    // triangular steps over groups visit every slot of a power of two table
+    for(size_t step = MAP_GROUP; ; step += MAP_GROUP)
     {
-        if(es_cmp_values(key, &(map->data[i].k)))
-        {
-            // found key
-            return map->data + i;
-        }
-        else if(!tombstone && map->data[i].k.tid == ES_NIL && map->data[i].k.u == 1)
+        const u8 *group = t->ctrl + pos;
+
+        for(u32 m = matchbyte(group, h2); m; m &= m - 1)
         {
-            // first tombstone, save and continue
-            tombstone = map->data + i;
+            size_t i = (pos + lowbit(m)) & mask;
+            if(keyequal(&map->entries[getslot(t, i)].k, key))
+                return i;
         }
-        else if(map->data[i].k.tid == ES_NIL && map->data[i].k.u == 0)
+
+        if(matchbyte(group, CTRL_EMPTY))
+            return NOSLOT;
+
+        if(step > t->capacity)
+            return NOSLOT;
+
+        pos = (pos + step) & mask;
+    }
+}
+
+
+//*************************************************************************
+static void insert(es_maptable *t, size_t hash, size_t e)
+{
+    // points a free slot at entry 'e'
+
+    size_t mask = t->capacity - 1;
+    size_t pos  = H1(hash) & mask;
+
+    for(size_t step = MAP_GROUP; ; step += MAP_GROUP)
+    {
+        u32 m = matchfree(t->ctrl + pos);
+
+        if(m)
         {
-            // empty node, return tombstone to recycle if possible
-            return (tombstone)? tombstone : map->data + i;
+            size_t i = (pos + lowbit(m)) & mask;
+
+            if(t->ctrl[i] == CTRL_DELETED) --(t->tombstones);
+            setctrl(t, i, H2(hash));
+            putslot(t, i, e);
+            ++(t->size);
+
+            return;
         }
 
-        i = (i+1) % map->capacity;
-        if(i == index) break;
+        pos = (pos + step) & mask;
     }
+}
+
 
-    // map is 100% full
+//*************************************************************************
+static void erase(es_maptable *t, size_t i)
+{
+    setctrl(t, i, CTRL_DELETED);
+    --(t->size);
+    ++(t->tombstones);
+}
 
-    if(tombstone) return tombstone;
 
-    printf("\n  >  map overflow!  <\n\n");
-    return NULL;
+//*************************************************************************
+static void migrate(es_map *map, size_t count)
+{
+    // moves up to 'count' slots of the old index, frees it once drained,
+    // the entries themselves stay where they are
+
+    size_t end = map->migrated + count;
+    if(end > map->old.capacity) end = map->old.capacity;
+
+    for(size_t i = map->migrated; i < end; ++i)
+    {
+        if(map->old.ctrl[i] & 0x80) continue;
+
+        size_t e = getslot(&map->old, i);
+
+        insert(&map->table, HASH(map, &map->entries[e].k), e);
+        erase(&map->old, i);
+    }
+
+    map->migrated = end;
+
+    if(map->migrated == map->old.capacity)
+        release(map->alloc, &map->old);
 }
 
 
 //*************************************************************************
-int es_mapgrow(es_map *map, size_t newcap)
+static int resize(es_map *map, size_t newcap)
 {
-    const size_t max = (size_t)(~0ull);
+    // starts moving the index into a fresh one of 'newcap' slots
+
+    if(map->old.capacity)
+        migrate(map, map->old.capacity);
+
+    es_maptable fresh;
+    if(!allocate(map->alloc, &fresh, newcap)) return 0;
+
+    map->old      = map->table;
+    map->table    = fresh;
+    map->migrated = 0;
+
+    // small tables aren't worth spreading out
+    if(map->old.capacity <= MAP_SYNCMIGRATE)
+        migrate(map, map->old.capacity);
+
+    return 1;
+}
 
-    while(max % newcap != 0) ++newcap;
 
-    if(newcap < map->capacity) return 0;
+//*************************************************************************
+static int rebuild(es_map *map, size_t newcap)
+{
+    // squeezes the holes out of the entries, keeping their order, and
+    // indexes them again, all at once
 
-    // allocate new buffer
-    es_map_node* ptr = malloc(newcap * sizeof(es_map_node));
-    if(!ptr) return 0;
+    es_maptable fresh;
+    if(!allocate(map->alloc, &fresh, newcap)) return 0;
 
-    // init nodes as empty
-    for(size_t i = 0; i < newcap; ++i)
+    size_t n = 0;
+    for(size_t e = 0; e < map->ecount; ++e)
     {
-        ptr[i].k.tid = ES_NIL;
-        ptr[i].k.u   = 0;
+        if(map->entries[e].k.tid == HOLE) continue;
+        map->entries[n++] = map->entries[e];
     }
 
-    // temp destination map
-    es_map temp;
-    temp.data = ptr;
-    temp.capacity = newcap;
-    temp.size = 0ull;
-    temp.tombstones = 0ull;
+    map->ecount = n;
+
+    release(map->alloc, &map->table);
+    release(map->alloc, &map->old);
+    map->table    = fresh;
+    map->migrated = 0;
+
+    for(size_t e = 0; e < n; ++e)
+        insert(&map->table, HASH(map, &map->entries[e].k), e);
+
+    return 1;
+}
+
+
+//*************************************************************************
+static int growentries(es_map *map, size_t n)
+{
+    if(n <= map->ecapacity) return 1;
+
+    es_map_node *entries = es_realloc(map->alloc, map->entries,
+                                      map->ecapacity * sizeof(es_map_node),
+                                      n * sizeof(es_map_node));
+    if(!entries) return 0;
+
+    map->entries   = entries;
+    map->ecapacity = n;
+
+    return 1;
+}
+
+
+//*************************************************************************
+static es_map_node *hashfind(es_map *map, es_value *key, size_t hash, es_maptable **t, size_t *slot)
+{
+    // 't' and 'slot' get where the entry is indexed, if wanted
+
+    if(map->size == map->acount) return NULL;
 
-    // copy over old buffer
-    // we can't memcpy as the hashes change with capacity
-    if(map->data)
+    es_maptable *in = &map->table;
+
+    size_t i = find(map, in, key, hash);
+    if(i == NOSLOT) i = find(map, in = &map->old, key, hash);
+    if(i == NOSLOT) return NULL;
+
+    if(t)    *t = in;
+    if(slot) *slot = i;
+
+    return map->entries + getslot(in, i);
+}
+
+
+//*************************************************************************
+static es_map_node *append(es_map *map, size_t hash)
+{
+    // the caller fills in the entry, there must be room for it
+
+    size_t e = (map->ecount)++;
+    insert(&map->table, hash, e);
+    ++(map->size);
+
+    return map->entries + e;
+}
+
+
+//*************************************************************************
+static void detach(es_map *map, es_maptable *t, size_t slot)
+{
+    // leaves a hole, the caller has taken or destroyed what was there
+
+    map->entries[getslot(t, slot)].k.tid = HOLE;
+    erase(t, slot);
+    --(map->size);
+}
+
+
+// [[[[[[[[[[[[[[[[[[[[[[[[[[[[[[[[[[[ Array part ]]]]]]]]]]]]]]]]]]]]]]]]]]]]]]]]]]]
+
+
+//*************************************************************************
+static int intkey(es_value *key, size_t *k)
+{
+    if(key->tid != ES_INT || key->i < 0 || key->i >= ((i64) 1 << (ES_MAP_ABITS - 1)))
+        return 0;
+
+    *k = (size_t) key->i;
+    return 1;
+}
+
+
+//*************************************************************************
+static u32 keybin(size_t k)
+{
+    // bin b holds keys in [2^(b-1), 2^b), bin 0 holds 0
+    u32 b = 0;
+    while(k) { k >>= 1; ++b; }
+    return b;
+}
+
+
+//*************************************************************************
+static void countkey(es_map *map, es_value *key, int delta)
+{
+    size_t k;
+    if(intkey(key, &k)) map->nums[keybin(k)] += delta;
+}
+
+
+//*************************************************************************
+static void hasherase(es_map *map, es_maptable *t, size_t slot)
+{
+    es_map_node *node = map->entries + getslot(t, slot);
+
+    countkey(map, &node->k, -1);
+    es_destroy_value(&node->k);
+    es_destroy_value(&node->v);
+    detach(map, t, slot);
+}
+
+
+//*************************************************************************
+static size_t arraysize(es_map *map, es_value *key)
+{
+    // the largest power of two n with more than n/2 of the keys 0..n-1
+    // present, 'key' is about to be inserted and counts too
+
+    size_t k, total = 0, n = 0;
+    u32 extra = key && intkey(key, &k) ? keybin(k) : ES_MAP_ABITS;
+
+    for(u32 b = 0; b < ES_MAP_ABITS; ++b)
+    {
+        total += map->nums[b] + (b == extra);
+        if(total > ((size_t) 1 << b) / 2)
+            n = (size_t) 1 << b;
+    }
+
+    return n;
+}
+
+
+//*************************************************************************
+static int rebalance(es_map *map, es_value *key)
+{
+    // moves keys between the parts when the best array size has changed
+
+    size_t n = arraysize(map, key);
+    if(n == map->asize) return 1;
+
+    if(map->old.capacity)
+        migrate(map, map->old.capacity);
+
+    es_value *array = NULL;
+    if(n && !(array = es_malloc(map->alloc, n * sizeof(es_value))))
+        return 0;
+
+    if(n < map->asize)
     {
-        for(size_t i = 0; i < map->capacity; ++i)
+        // the tail goes to the hash part, which must have room first
+        size_t moving = 0;
+        for(size_t i = n; i < map->asize; ++i)
+            moving += map->array[i].tid != ES_NIL;
+
+        if(!es_mapreserve(map, map->table.size + moving))
         {
-            if(map->data[i].k.tid == ES_NIL) continue;
+            es_free(map->alloc, array, n * sizeof(es_value));
+            return 0;
+        }
 
-            es_map_node *node = probe(&temp, &(map->data[i].k));
-            if(node && node->k.tid == ES_NIL)
-            {
-                node->k.tid = map->data[i].k.tid;
-                node->k.u   = map->data[i].k.u;
-                node->v.tid = map->data[i].v.tid;
-                node->v.u   = map->data[i].v.u;
-                ++(temp.size);
-            }
-            else
-            {
-                printf("\n  >  source map duplicate key?  <\n\n");
-                exit(-1);
-            }
+        for(size_t i = n; i < map->asize; ++i)
+        {
+            if(map->array[i].tid == ES_NIL) continue;
+
+            es_value k;
+            k.tid = ES_INT;
+            k.i   = (i64) i;
+
+            es_map_node *node = append(map, HASH(map, &k));
+            node->k = k;
+            node->v = map->array[i];
+
+            --(map->acount);
+            --(map->size);
         }
-        free(map->data);
-    }
 
-    if(map->size != temp.size)
+        if(n) memcpy(array, map->array, n * sizeof(es_value));
+    }
+    else
     {
-        printf("\n  >  map realloc error, coudn't copy all nodes  <\n\n");
-        exit(-1);
+        if(map->asize) memcpy(array, map->array, map->asize * sizeof(es_value));
+        for(size_t i = map->asize; i < n; ++i)
+        {
+            array[i].tid = ES_NIL;
+            array[i].u   = 0;
+        }
+
+        // nil entries stay behind, the array part can't represent them
+        for(size_t e = 0, k; e < map->ecount; ++e)
+        {
+            es_map_node *node = map->entries + e;
+
+            if(node->k.tid == HOLE || !intkey(&node->k, &k) || k >= n || node->v.tid == ES_NIL)
+                continue;
+
+            size_t slot = find(map, &map->table, &node->k, HASH(map, &node->k));
+
+            array[k] = node->v;
+            detach(map, &map->table, slot);
+            ++(map->acount);
+            ++(map->size);
+        }
     }
 
-    printf("growing map [%02.2f>%02.2f] : %04lli : %04lli\n",
-        (double)(map->size) / (double)(map->capacity),
-        (double)(temp.size) / (double)(temp.capacity),
-        newcap,
-        map->tombstones);
+    if(map->asize) es_free(map->alloc, map->array, map->asize * sizeof(es_value));
 
-    map->data       = temp.data;
-    map->capacity   = temp.capacity;
-    map->size       = temp.size;
-    map->tombstones = temp.tombstones;
+    map->array = array;
+    map->asize = n;
 
     return 1;
 }
 
 
+// [[[[[[[[[[[[[[[[[[[[[[[[[[[[[[[[[[[ Map ]]]]]]]]]]]]]]]]]]]]]]]]]]]]]]]]]]]
+
+
 //*************************************************************************
 void es_destroy_map(es_map *map)
 {
-    if(map->data) free(map->data);
-    map->data = NULL;
-    map->capacity = 0ull;
+    if(map->array)   es_free(map->alloc, map->array, map->asize * sizeof(es_value));
+    if(map->entries) es_free(map->alloc, map->entries, map->ecapacity * sizeof(es_map_node));
+    release(map->alloc, &map->table);
+    release(map->alloc, &map->old);
+    memset(map->nums, 0, sizeof(map->nums));
+    map->array = NULL;
+    map->asize = 0ull;
+    map->acount = 0ull;
+    map->entries = NULL;
+    map->ecount = 0ull;
+    map->ecapacity = 0ull;
+    map->migrated = 0ull;
     map->size = 0ull;
-    map->tombstones = 0ull;
 }
 
 
 //*************************************************************************
-void es_construct_map(es_map *map)
+void es_construct_map(es_map *map, es_allocator *alloc)
 {
-    map->data = NULL;
+    // storage is allocated on first insert
+    map->alloc = alloc;
+    map->array = NULL;
+    map->entries = NULL;
+    map->table.ctrl = NULL;
+    map->old.ctrl = NULL;
+    map->seed = es_hash_seed();
     es_destroy_map(map);
-    es_mapgrow(map, 4ull);
 }
 
 
 //*************************************************************************
-int reevalmem(es_map *map)
+int es_mapseed(es_map *map, u64 seed)
+{
+    u64 old = map->seed;
+
+    map->seed = seed;
+
+    // existing keys move to their new slots
+    if(map->table.capacity && !rebuild(map, map->table.capacity))
+    {
+        map->seed = old;
+        return 0;
+    }
+
+    return 1;
+}
+
+
+//*************************************************************************
+int es_mapreserve(es_map *map, size_t size)
 {
-    double load_factor = (double)(map->size + map->tombstones) / (double)(map->capacity);
+    // room for 'size' keys in the hash part, holes count against it
 
-    if(load_factor >= MAP_MAX_LOAD)
+    size_t holes = map->ecount - (map->size - map->acount);
+
+    if(holes + size <= map->ecapacity)
+        return 1;
+
+    if(holes + size > MAP_MAXLOAD(map->table.capacity))
+    {
+        size_t newcap = map->table.capacity ? map->table.capacity : MAP_MINCAP;
+        while(size > MAP_MAXLOAD(newcap)) newcap *= 2;
+
+        if(!rebuild(map, newcap)) return 0;
+        holes = 0;
+    }
+
+    return growentries(map, holes + size);
+}
+
+
+//*************************************************************************
+static int reevalmem(es_map *map, es_value *key)
+{
+    // makes room for one more entry
+
+    if(map->ecount < map->ecapacity)
+        return 1;
+
+    if(map->ecapacity == MAP_MAXLOAD(map->table.capacity))
+    {
+        // growing the hash part is when the array part gets a look
+        if(!rebalance(map, key)) return 0;
+        if(map->ecount < map->ecapacity)
+            return 1;
+    }
+
+    size_t cap = map->table.capacity;
+
+    if(map->ecapacity == MAP_MAXLOAD(cap))
     {
-        return es_mapgrow(map, (size_t)(map->size / MAP_TARGET_LOAD));
+        // mostly holes, squeeze them out instead of growing
+        if(map->size - map->acount + 1 <= MAP_MAXLOAD(cap) / 2)
+            return rebuild(map, cap);
+
+        if(!resize(map, cap ? cap * 2 : MAP_MINCAP)) return 0;
+    }
+
+    size_t n = map->ecapacity + map->ecapacity / 2;
+    if(n < MAP_MINENTRIES) n = MAP_MINENTRIES;
+    if(n > MAP_MAXLOAD(map->table.capacity)) n = MAP_MAXLOAD(map->table.capacity);
+
+    return growentries(map, n);
+}
+
+
+//*************************************************************************
+static es_value *get(es_map *map, es_value *key, size_t hash)
+{
+    size_t k;
+    if(intkey(key, &k) && k < map->asize && map->array[k].tid != ES_NIL)
+        return map->array + k;
+
+    es_map_node *node = hashfind(map, key, hash, NULL, NULL);
+    return node ? &node->v : NULL;
+}
+
+
+//*************************************************************************
+static es_value *getadd(es_map *map, es_value *key, size_t hash)
+{
+    size_t k;
+    int isint = intkey(key, &k);
+
+    if(isint && k < map->asize && map->array[k].tid != ES_NIL)
+        return map->array + k;
+
+    if(map->old.capacity)
+        migrate(map, MAP_MIGRATE);
+
+    es_map_node *node = hashfind(map, key, hash, NULL, NULL);
+    if(node) return &node->v;
+
+    if(!reevalmem(map, key)) return NULL;
+
+    node = append(map, hash);
+    es_copy_value(&node->k, key);
+    node->v.tid = ES_NIL;
+    node->v.u   = 0;
+    countkey(map, key, 1);
+
+    return &node->v;
+}
+
+
+//*************************************************************************
+static es_value *set(es_map *map, es_value *key, es_value *value, size_t hash)
+{
+    size_t k;
+    int isint = intkey(key, &k);
+
+    if(isint && k < map->asize)
+    {
+        es_value *slot = map->array + k;
+
+        if(value->tid != ES_NIL)
+        {
+            if(slot->tid == ES_NIL)
+            {
+                // es_mapgetadd may have left a nil entry in the hash part
+                es_maptable *t;
+                size_t i;
+                if(hashfind(map, key, hash, &t, &i)) hasherase(map, t, i);
+
+                countkey(map, key, 1);
+                ++(map->acount);
+                ++(map->size);
+            }
+
+            es_copy_value(slot, value);
+            return slot;
+        }
+
+        // a nil value is still a key, only the hash part can hold it
+        if(slot->tid != ES_NIL)
+        {
+            countkey(map, key, -1);
+            es_destroy_value(slot);
+            --(map->acount);
+            --(map->size);
+        }
+    }
+
+    es_value *v = getadd(map, key, hash);
+    if(!v) return NULL;
+
+    // the insert grew the array part over the key, move it there
+    if(isint && k < map->asize && value->tid != ES_NIL && v != map->array + k)
+        return set(map, key, value, hash);
+
+    es_copy_value(v, value);
+    return v;
+}
+
+
+//*************************************************************************
+static int far(es_map *map)
+{
+    return blocksize(map->table.capacity) + blocksize(map->old.capacity) +
+           map->ecapacity * sizeof(es_map_node) + map->asize * sizeof(es_value) > MAP_FARBYTES;
+}
+
+
+//*************************************************************************
+static void prefetch(es_map *map, es_value *key, size_t hash)
+{
+    // pulls in the first slot a probe for 'key' will touch, the entry
+    // itself isn't known until the slot is read
+
+    size_t k;
+    if(intkey(key, &k) && k < map->asize)
+    {
+        PREFETCH(map->array + k);
+        return;
+    }
+
+    if(map->table.capacity)
+    {
+        size_t pos = H1(hash) & (map->table.capacity - 1);
+        PREFETCH(map->table.ctrl + pos);
+        PREFETCH((u8*) map->table.index + pos * map->table.width);
+    }
+
+    if(map->old.size)
+    {
+        size_t pos = H1(hash) & (map->old.capacity - 1);
+        PREFETCH(map->old.ctrl + pos);
+        PREFETCH((u8*) map->old.index + pos * map->old.width);
     }
-    return 0;
 }
 
 
@@ -189,37 +811,88 @@ int reevalmem(es_map *map)
 es_value *es_mapget(es_map *map, es_value *key)
 {
     if(map->size == 0) return NULL;
-    es_map_node *node = probe(map, key);
-    if(node->k.tid == ES_NIL)  return NULL;
-    else                       return &(node->v);
+
+    size_t k;
+    if(intkey(key, &k) && k < map->asize && map->array[k].tid != ES_NIL)
+        return map->array + k;
+
+    es_map_node *node = hashfind(map, key, HASH(map, key), NULL, NULL);
+    return node ? &node->v : NULL;
 }
 
 
 //*************************************************************************
 es_value *es_mapgetadd(es_map *map, es_value *key)
 {
-    reevalmem(map);
-    es_map_node *node = probe(map, key);
-    if(node->k.tid == ES_NIL)
+    return getadd(map, key, HASH(map, key));
+}
+
+
+//*************************************************************************
+es_value *es_mapset(es_map *map, es_value *key, es_value *value)
+{
+    return set(map, key, value, HASH(map, key));
+}
+
+
+//*************************************************************************
+void es_mapget_batch(es_map *map, es_value *keys, es_value **out, size_t count)
+{
+    // hashes and prefetches a batch before probing any of it, so the
+    // cache misses of the batch overlap instead of queueing
+
+    size_t hashes[MAP_BATCH];
+
+    for(size_t base = 0; base < count; base += MAP_BATCH)
     {
-        if(node->k.u == 1) --(map->tombstones);
-        es_copy_value(&node->k, key);
-        node->v.tid = ES_NIL;
-        node->v.u   = 0;
-        ++(map->size);
-        return &node->v;
+        size_t n = count - base < MAP_BATCH ? count - base : MAP_BATCH;
+
+        if(!far(map))
+        {
+            for(size_t i = 0; i < n; ++i)
+                out[base + i] = es_mapget(map, keys + base + i);
+            continue;
+        }
+
+        for(size_t i = 0; i < n; ++i)
+        {
+            hashes[i] = HASH(map, keys + base + i);
+            prefetch(map, keys + base + i, hashes[i]);
+        }
+
+        for(size_t i = 0; i < n; ++i)
+            out[base + i] = get(map, keys + base + i, hashes[i]);
     }
-    else return &node->v;
-    return NULL;
 }
 
 
 //*************************************************************************
-es_value *es_mapset(es_map *map, es_value *key, es_value *value)
+size_t es_mapset_batch(es_map *map, es_value *keys, es_value *values, size_t count)
 {
-    es_value *v = es_mapgetadd(map, key);
-    es_copy_value(v, value);
-    return v;
+    // a resize part way through only makes the remaining prefetches miss,
+    // the seed and so the hashes stay the same
+
+    size_t hashes[MAP_BATCH];
+
+    for(size_t base = 0; base < count; base += MAP_BATCH)
+    {
+        size_t n = count - base < MAP_BATCH ? count - base : MAP_BATCH;
+        int pf = far(map);
+
+        for(size_t i = 0; i < n; ++i)
+        {
+            hashes[i] = HASH(map, keys + base + i);
+            if(pf) prefetch(map, keys + base + i, hashes[i]);
+        }
+
+        for(size_t i = 0; i < n; ++i)
+        {
+            if(!set(map, keys + base + i, values + base + i, hashes[i]))
+                return base + i;
+        }
+    }
+
+    return count;
 }
 
 
@@ -227,12 +900,56 @@ es_value *es_mapset(es_map *map, es_value *key, es_value *value)
 void es_maperase(es_map *map, es_value *key)
 {
     if(map->size == 0) return;
-    es_map_node *node = probe(map, key);
-    if(node->k.tid == ES_NIL) return;
-    es_destroy_value(&node->k);
-    es_destroy_value(&node->v);
-    node->k.tid = ES_NIL;
-    node->k.u   = 1; // tombstone
-    --(map->size);
-    ++(map->tombstones);
-}
\ No newline at end of file
+
+    size_t k;
+    if(intkey(key, &k) && k < map->asize && map->array[k].tid != ES_NIL)
+    {
+        countkey(map, key, -1);
+        es_destroy_value(map->array + k);
+        --(map->acount);
+        --(map->size);
+
+        // a failed shrink leaves the array part as it is
+        if(map->acount < map->asize / 4)
+            rebalance(map, NULL);
+
+        return;
+    }
+
+    if(map->old.capacity)
+        migrate(map, MAP_MIGRATE);
+
+    es_maptable *t;
+    size_t i;
+    if(hashfind(map, key, HASH(map, key), &t, &i)) hasherase(map, t, i);
+}
+
+
+//*************************************************************************
+es_value *es_mapnext(es_map *map, size_t *iter, es_value *key)
+{
+    // the array part in key order, then the entries in insertion order
+
+    for(; *iter < map->asize; ++(*iter))
+    {
+        if(map->array[*iter].tid != ES_NIL)
+        {
+            key->tid = ES_INT;
+            key->i   = (i64) *iter;
+            return map->array + (*iter)++;
+        }
+    }
+
+    for(; *iter < map->asize + map->ecount; ++(*iter))
+    {
+        es_map_node *node = map->entries + (*iter - map->asize);
+        if(node->k.tid != HOLE)
+        {
+            *key = node->k;
+            ++(*iter);
+            return &node->v;
+        }
+    }
+
+    return NULL;
+}
@@ -16,26 +16,94 @@
 
 #include "common.h"
 #include "value.h"
+#include "object.h"
 
 
 typedef struct { es_value k; es_value v; } es_map_node;
 
 
-typedef struct es_map_t
+// the index over the entries, open addressing over groups of 16 slots,
+// each slot has a control byte that is empty, deleted or 7 bits of the
+// key's hash, and the position of its entry in 'width' bytes, the fewest
+// that can address the entries of a table this size, capacity is a power of 2
+typedef struct es_maptable_t
 {
-    es_map_node* data;
-    size_t size;
+    u8 *ctrl;
+    void *index;
     size_t capacity;
+    size_t size;
     size_t tombstones;
+    u8 width;
+} es_maptable;
+
+
+// integer keys below 2^(ES_MAP_ABITS-1) can live in the array part
+#define ES_MAP_ABITS 32
+
+
+// non-negative integer keys 0..asize-1 live unboxed in 'array', where a nil
+// slot is an absent key, everything else goes in the hash part. the array
+// part is resized to the largest power of two that is more than half full
+// whenever the hash part has to grow, or the array part falls below 1/4 full
+//
+// the hash part keeps its keys and values densely in 'entries', in insertion
+// order, erasing leaves a hole until the entries are next compacted. growing
+// the index is incremental, 'old' drains into 'table' a few slots per insert
+// or erase and lookups check both until it's empty
+typedef struct es_map_t
+{
+    es_value *array;
+    size_t asize;
+    size_t acount;
+    es_map_node *entries;
+    size_t ecount;
+    size_t ecapacity;
+    es_maptable table;
+    es_maptable old;
+    size_t migrated;
+    size_t size;
+    u64 seed;
+    es_allocator *alloc;
+
+    // integer keys counted by bit length, across both parts
+    u32 nums[ES_MAP_ABITS];
 } es_map;
 
 
-void es_construct_map(es_map *map);
+// the ES_MAP object, a script visible map
+typedef struct es_mapobject_t
+{
+    es_object obj;
+    es_map map;
+} es_mapobject;
+
+
+#define AS_MAP(o) ((es_mapobject*)(o->obj))
+
+
+// 'alloc' may be NULL to use the c runtime directly
+void es_construct_map(es_map *map, es_allocator *alloc);
+int  es_mapreserve(es_map *map, size_t size);
+
+// tables get a random seed on construction, this replaces it and rehashes
+int  es_mapseed(es_map *map, u64 seed);
 void es_destroy_map(es_map *map);
 
+// returned pointers are valid until the next insert or erase, storing nil
+// through one doesn't erase the key
 es_value *es_mapget(es_map *map, es_value *key);
 es_value *es_mapgetadd(es_map *map, es_value *key);
 es_value *es_mapset(es_map *map, es_value *key, es_value *value);
 void es_maperase(es_map *map, es_value *key);
 
+// the same as calling es_mapget or es_mapset once per key, but misses on
+// large maps overlap, es_mapset_batch returns how many pairs were stored
+void   es_mapget_batch(es_map *map, es_value *keys, es_value **out, size_t count);
+size_t es_mapset_batch(es_map *map, es_value *keys, es_value *values, size_t count);
+
+// iterates entries, start with *iter = 0, copies the key out and returns the
+// value, NULL at the end. integer keys in the array part come first, in
+// order, then the rest in the order they were inserted
+es_value *es_mapnext(es_map *map, size_t *iter, es_value *key);
+
 #endif
\ No newline at end of file
@@ -0,0 +1,162 @@
+#include "memory.h"
+
+
+//*************************************************************************
+void *es_default_alloc(void *ud, void *ptr, size_t oldsize, size_t newsize)
+{
+    (void) ud;
+    (void) oldsize;
+
+    if(newsize == 0)
+    {
+        free(ptr);
+        return NULL;
+    }
+
+    return realloc(ptr, newsize);
+}
+
+
+//*************************************************************************
+void es_construct_allocator(es_allocator *alloc, es_alloc_fn fn, void *ud)
+{
+    alloc->fn = (fn) ? fn : es_default_alloc;
+    alloc->ud = ud;
+
+    alloc->live = 0;
+    alloc->peak = 0;
+    alloc->limit = 0;
+    alloc->overlimit = 0;
+
+    for(size_t i = 0; i < ES_POOL_CLASSES; ++i)
+        alloc->pool.freelists[i] = NULL;
+
+    alloc->pool.slabs = NULL;
+
+    alloc->gc = NULL;
+}
+
+
+//*************************************************************************
+void es_destroy_allocator(es_allocator *alloc)
+{
+    // bulk release, blocks still in use are freed with their slab
+    while(alloc->pool.slabs)
+    {
+        es_pool_slab *next = alloc->pool.slabs->next;
+        alloc->fn(alloc->ud, alloc->pool.slabs, ES_POOL_SLABSIZE, 0);
+        alloc->pool.slabs = next;
+    }
+
+    for(size_t i = 0; i < ES_POOL_CLASSES; ++i)
+        alloc->pool.freelists[i] = NULL;
+}
+
+
+//*************************************************************************
+static int account(es_allocator *alloc, size_t oldsize, size_t newsize)
+{
+    if(alloc->limit && newsize > oldsize && alloc->live - oldsize + newsize > alloc->limit)
+    {
+        alloc->overlimit = 1;
+        return 0;
+    }
+
+    alloc->live = alloc->live - oldsize + newsize;
+    if(alloc->live > alloc->peak) alloc->peak = alloc->live;
+
+    return 1;
+}
+
+
+//*************************************************************************
+void *es_realloc(es_allocator *alloc, void *ptr, size_t oldsize, size_t newsize)
+{
+    if(!alloc) return es_default_alloc(NULL, ptr, oldsize, newsize);
+
+    if(!ptr) oldsize = 0;
+
+    if(!account(alloc, oldsize, newsize))
+        return NULL;
+
+    void *result = alloc->fn(alloc->ud, ptr, oldsize, newsize);
+
+    if(!result && newsize > 0)
+    {
+        alloc->live = alloc->live - newsize + oldsize;
+        return NULL;
+    }
+
+    return result;
+}
+
+
+//*************************************************************************
+static int refill(es_allocator *alloc, size_t c)
+{
+    const size_t blocksize = (c + 1) * ES_POOL_GRANULE;
+
+    // slabs aren't counted as live, blocks are as they're handed out
+    // slab header is padded to one granule to keep blocks aligned
+    es_pool_slab *slab = (es_pool_slab*) alloc->fn(alloc->ud, NULL, 0, ES_POOL_SLABSIZE);
+    if(!slab) return 0;
+
+    slab->next = alloc->pool.slabs;
+    slab->blocksize = blocksize;
+    alloc->pool.slabs = slab;
+
+    u8 *block = ((u8*) slab) + ES_POOL_GRANULE;
+    u8 *end   = ((u8*) slab) + ES_POOL_SLABSIZE;
+
+    for(; block + blocksize <= end; block += blocksize)
+    {
+        ((es_pool_block*) block)->next = alloc->pool.freelists[c];
+        alloc->pool.freelists[c] = (es_pool_block*) block;
+    }
+
+    return 1;
+}
+
+
+//*************************************************************************
+void *es_pool_alloc(es_allocator *alloc, size_t size)
+{
+    if(size == 0 || size > ES_POOL_MAXBLOCK)
+        return es_malloc(alloc, size);
+
+    size_t c = (size - 1) / ES_POOL_GRANULE;
+
+    if(!account(alloc, 0, (c + 1) * ES_POOL_GRANULE))
+        return NULL;
+
+    if(!alloc->pool.freelists[c] && !refill(alloc, c))
+    {
+        alloc->live -= (c + 1) * ES_POOL_GRANULE;
+        return NULL;
+    }
+
+    es_pool_block *block = alloc->pool.freelists[c];
+    alloc->pool.freelists[c] = block->next;
+    return block;
+}
+
+
+//*************************************************************************
+void es_pool_free(es_allocator *alloc, void *ptr, size_t size)
+{
+    if(!ptr) return;
+
+    if(size == 0 || size > ES_POOL_MAXBLOCK)
+    {
+        es_free(alloc, ptr, size);
+        return;
+    }
+
+    size_t c = (size - 1) / ES_POOL_GRANULE;
+
+    alloc->live -= (c + 1) * ES_POOL_GRANULE;
+
+    ((es_pool_block*) ptr)->next = alloc->pool.freelists[c];
+    alloc->pool.freelists[c] = (es_pool_block*) ptr;
+}
+
@@ -0,0 +1,93 @@
+/********************************************************************************
+ * \file memory.h
+ * \author Patrick Torgeson (torgersonpatricks@gmail.com)
+ * \brief
+ * \version 0.1
+ * \date 2022-01-17
+ *
+ * @copyright Copyright (c) 2022
+ *
+ ********************************************************************************/
+
+
+#ifndef ES_MEMORY_H
+#define ES_MEMORY_H
+
+
+#include "common.h"
+
+
+// -- allocation hook
+
+
+// allocates when ptr is NULL, frees when newsize is 0, otherwise reallocates
+// oldsize is the size ptr was allocated with, 0 if ptr is NULL
+typedef void *(*es_alloc_fn)(void *ud, void *ptr, size_t oldsize, size_t newsize);
+
+void *es_default_alloc(void *ud, void *ptr, size_t oldsize, size_t newsize);
+
+
+// -- size class pool
+
+
+#define ES_POOL_GRANULE   16u
+#define ES_POOL_CLASSES   16u
+#define ES_POOL_MAXBLOCK  (ES_POOL_GRANULE * ES_POOL_CLASSES)
+#define ES_POOL_SLABSIZE  4096u
+
+
+typedef struct es_pool_block_t
+{
+    struct es_pool_block_t *next;
+} es_pool_block;
+
+
+typedef struct es_pool_slab_t
+{
+    struct es_pool_slab_t *next;
+    size_t blocksize;
+} es_pool_slab;
+
+
+// free lists are per pool, a pool belongs to a single state
+typedef struct es_pool_t
+{
+    es_pool_block *freelists[ES_POOL_CLASSES];
+    es_pool_slab *slabs;
+} es_pool;
+
+
+// -- allocator
+
+
+typedef struct es_allocator_t
+{
+    es_alloc_fn fn;
+    void *ud;
+
+    size_t live;     // bytes currently allocated, pooled blocks count while in use
+    size_t peak;     // highest value of live
+    size_t limit;    // allocations beyond this fail, 0 for no limit
+    int overlimit;   // set when an allocation was refused by limit
+
+    es_pool pool;    // small objects
+
+    struct es_gc_t *gc;  // collects objects allocated here, may be NULL
+} es_allocator;
+
+
+void es_construct_allocator(es_allocator *alloc, es_alloc_fn fn, void *ud);
+void es_destroy_allocator(es_allocator *alloc);
+
+// 'alloc' may be NULL, in which case the c runtime is used directly
+void *es_realloc(es_allocator *alloc, void *ptr, size_t oldsize, size_t newsize);
+
+#define es_malloc(a,s)  (es_realloc((a), NULL, 0, (s)))
+#define es_free(a,p,s)  (es_realloc((a), (p), (s), 0))
+
+// pooled for sizes up to ES_POOL_MAXBLOCK
+void *es_pool_alloc(es_allocator *alloc, size_t size);
+void  es_pool_free(es_allocator *alloc, void *ptr, size_t size);
+
+
+#endif
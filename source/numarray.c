@@ -0,0 +1,47 @@
+#include "numarray.h"
+
+
+//*************************************************************************
+size_t es_elemsize(es_elemtype elem)
+{
+    switch(elem)
+    {
+    case ES_ELEM_INT:   return sizeof(i64);
+    case ES_ELEM_FLOAT: return sizeof(f64);
+    case ES_ELEM_BYTE:  return sizeof(u8);
+    default:            return 0;
+    }
+}
+
+
+//*************************************************************************
+int es_construct_numarray(es_numarray *arr, es_elemtype elem, size_t size)
+{
+    arr->elem   = (u8) elem;
+    arr->size   = 0;
+    arr->data.p = NULL;
+
+    if(size == 0) return 1;
+
+    if(size > SIZE_MAX / es_elemsize(elem)) return 0;
+
+    size_t bytes = size * es_elemsize(elem);
+
+    arr->data.p = es_malloc(arr->obj.alloc, bytes);
+    if(!arr->data.p) return 0;
+
+    memset(arr->data.p, 0, bytes);
+    arr->size = size;
+
+    return 1;
+}
+
+
+//*************************************************************************
+void es_destroy_numarray(es_numarray *arr)
+{
+    es_free(arr->obj.alloc, arr->data.p, arr->size * es_elemsize(arr->elem));
+
+    arr->data.p = NULL;
+    arr->size   = 0;
+}
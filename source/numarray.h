@@ -0,0 +1,59 @@
+/********************************************************************************
+ * \file numarray.h
+ * \author Patrick Torgeson (torgersonpatricks@gmail.com)
+ * \brief
+ * \version 0.1
+ * \date 2022-01-18
+ *
+ * @copyright Copyright (c) 2022
+ *
+ ********************************************************************************/
+
+
+#ifndef ES_NUMARRAY_H
+#define ES_NUMARRAY_H
+
+
+#include "common.h"
+#include "object.h"
+
+
+typedef enum es_elemtype_t
+{
+    ES_ELEM_INT,    // i64
+    ES_ELEM_FLOAT,  // f64
+    ES_ELEM_BYTE,   // u8
+
+    ES_ELEM_COUNT,
+} es_elemtype;
+
+
+// fixed size array of unboxed numbers, the ES_ARRAY object
+typedef struct es_numarray_t
+{
+    es_object obj;
+
+    u8 elem;
+    size_t size;
+
+    union
+    {
+        i64  *i;
+        f64  *f;
+        u8   *b;
+        void *p;
+    } data;
+} es_numarray;
+
+
+#define AS_NUMARRAY(o) ((es_numarray*)(o->obj))
+
+
+// elements are zeroed, returns 0 if the buffer couldn't be allocated
+int  es_construct_numarray(es_numarray *arr, es_elemtype elem, size_t size);
+void es_destroy_numarray(es_numarray *arr);
+
+size_t es_elemsize(es_elemtype elem);
+
+
+#endif
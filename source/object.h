@@ -15,14 +15,25 @@
 
 
 #include "common.h"
+#include "memory.h"
 
 
 typedef struct es_object_t
 {
-    u64 refcount;
+    struct es_object_t *next;  // collector's list of all objects
+    es_allocator *alloc;
+    u8 type;
+    u8 mark;
+    u8 shared;  // sticky, set once referenced by more than one value
 } es_object;
 
-#define ES_ALLOCATE_OBJ(o) ((es_object*)malloc(sizeof(o)))
+
+// objects are linked into alloc's collector, if it has one
+es_object *es_allocate_object(es_allocator *alloc, size_t size, u8 type);
+void es_free_object(es_object *obj, size_t size);
+
+#define ES_ALLOCATE_OBJ(a,o,t) (es_allocate_object((a), sizeof(o), (t)))
+#define ES_FREE_OBJ(p,o) (es_free_object((es_object*)(p), sizeof(o)))
 
 
 #endif
\ No newline at end of file
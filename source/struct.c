@@ -0,0 +1,35 @@
+#include "struct.h"
+#include "estring.h"
+
+
+//*************************************************************************
+es_structobject *es_allocate_struct(es_allocator *alloc, es_shape *shape)
+{
+    es_structobject *s = (es_structobject*) es_allocate_object(alloc, ES_STRUCT_SIZE(shape), ES_STRUCT);
+    if(!s) return NULL;
+
+    s->shape = shape;
+
+    for(u32 i = 0; i < shape->size; ++i)
+    {
+        s->slots[i].tid = ES_NIL;
+        s->slots[i].u   = 0;
+    }
+
+    return s;
+}
+
+
+//*************************************************************************
+i32 es_structfield(const es_shape *shape, const es_value *kst, const es_value *name)
+{
+    for(u32 i = 0; i < shape->size; ++i)
+    {
+        const es_value *field = kst + shape->fields[i];
+
+        if(field == name || es_cmp_values((es_value*) field, (es_value*) name))
+            return (i32) i;
+    }
+
+    return -1;
+}
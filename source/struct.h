@@ -0,0 +1,57 @@
+/********************************************************************************
+ * \file struct.h
+ * \author Patrick Torgeson (torgersonpatricks@gmail.com)
+ * \brief struct objects, fields live at fixed offsets described by a shape
+ * \version 0.1
+ * \date 2022-01-23
+ *
+ * @copyright Copyright (c) 2022
+ *
+ ********************************************************************************/
+
+
+#ifndef ES_STRUCT_H
+#define ES_STRUCT_H
+
+
+#include "common.h"
+#include "value.h"
+#include "object.h"
+
+
+// the layout shared by every object of a struct type, made once when the
+// struct is declared and never changed, so objects only carry a pointer
+typedef struct es_shape_t
+{
+    char *name;
+    u32 id;
+    u32 size;     // slots per object
+    u32 *fields;  // constant index of each field's name, in slot order
+} es_shape;
+
+
+typedef es_shape* es_shapeptr;
+
+
+// the ES_STRUCT object, 'slots' is sized to the shape
+typedef struct es_structobject_t
+{
+    es_object obj;
+    es_shape *shape;
+    es_value slots[];
+} es_structobject;
+
+
+#define AS_STRUCT(o) ((es_structobject*)(o->obj))
+
+#define ES_STRUCT_SIZE(shape) (sizeof(es_structobject) + (shape)->size * sizeof(es_value))
+
+
+// slots start nil, NULL when out of memory
+es_structobject *es_allocate_struct(es_allocator *alloc, es_shape *shape);
+
+// slot of the field named 'name' or -1, 'kst' holds the field names
+i32 es_structfield(const es_shape *shape, const es_value *kst, const es_value *name);
+
+
+#endif
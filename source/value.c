@@ -1,5 +1,5 @@
 #include "value.h"
-#include "string.h"
+#include "estring.h"
 
 
 //*************************************************************************
@@ -17,6 +17,10 @@ bool es_cmp_values(es_value *l, es_value *r)
         return l->u == r->u;
     case ES_STRING:
         return es_cmp_strings(AS_STRING(l), AS_STRING(r)) == 0;
+    case ES_STRUCT:
+    case ES_ARRAY:
+    case ES_MAP:
+        return l->obj == r->obj;
     default:
         printf("\n\n  >  value comparison error!\n\n");
         exit(-1);
@@ -29,72 +33,20 @@ bool es_cmp_values(es_value *l, es_value *r)
 //*************************************************************************
 void es_copy_value(es_value *dest, es_value *src)
 {
-    // TODO: improve for case where types are equal
+    // objects are shared, not copied, the collector reclaims them
 
-    if(dest->tid >= ES_STRUCT)
-        es_destroy_value(dest);
+    dest->tid = src->tid;
+    dest->u   = src->u;
 
-    if(src->tid < ES_STRUCT)
-    {
-        dest->tid = src->tid;
-        dest->u   = src->u;
-    }
-    else
-    {
-        if(src->obj == NULL) return;
-
-        dest->tid = src->tid;
-
-        // take ownership
-        if(src->obj->refcount == 0)
-        {
-            dest->obj = src->obj;
-            dest->obj->refcount = 1;
-            return;
-        }
-
-        // copy
-        switch(src->tid)
-        {
-        case ES_STRING:
-            dest->obj = ES_ALLOCATE_OBJ(es_string);
-            es_construct_string(AS_STRING(dest), AS_STRING(src)->data, AS_STRING(src)->size);
-            break;
-        default:
-            printf("\n\n  >  value copy error!\n\n");
-            exit(-1);
-        }
-    }
+    if(src->tid >= ES_STRUCT && src->obj)
+        src->obj->shared = 1;
 }
 
 
 //*************************************************************************
 void es_destroy_value(es_value *v)
 {
-    if(v->tid < ES_STRUCT)
-    {
-        v->tid = ES_NIL;
-        v->u   = 0;
-    }
-    else
-    {
-        if(v->obj == NULL) return;
-
-        v->obj->refcount -= 1;
-        if(v->obj->refcount > 0) return;
-
-        switch(v->tid)
-        {
-        case ES_STRING:
-            es_destroy_string(AS_STRING(v));
-            break;
-        default:
-            printf("\n\n  >  value destroy error!\n\n");
-            exit(-1);
-        }
-
-        free(v->obj);
-        v->obj = NULL;
-        v->tid = ES_NIL;
-    }
+    // objects are reclaimed by the collector once unreachable
+    v->tid = ES_NIL;
+    v->u   = 0;
 }
\ No newline at end of file
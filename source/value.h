@@ -15,7 +15,7 @@
 
 
 #include "common.h"
-#include "string.h"
+#include "estring.h"
 #include "array.h"
 
 
@@ -1,68 +1,144 @@
 #include "vm.h"
 
 #include "disassembly.h"
-#include "string.h"
+#include "estring.h"
+#include "numarray.h"
+#include "map.h"
+#include "struct.h"
+#include "builtins.h"
 
 #include <stdio.h>
 #include <string.h>
+#include <inttypes.h>
+
+
+//*************************************************************************
+static void markroots(es_gc *gc, void *ud)
+{
+    es_state *es = (es_state*) ud;
+
+    for(es_value *v = es->stack; v < es->top; ++v)
+        es_gc_markvalue(gc, v);
+
+    for(size_t i = 0; i < es->kst.size; ++i)
+        es_gc_markvalue(gc, es->kst.data + i);
+
+    for(size_t i = 0; i < es->globals.size; ++i)
+        es_gc_markvalue(gc, es->globals.data + i);
+}
 
 
 //*************************************************************************
 void es_construct_state(es_state *es)
 {
+    es_construct_state_alloc(es, es_default_alloc, NULL);
+}
+
+
+//*************************************************************************
+void es_construct_state_alloc(es_state *es, es_alloc_fn fn, void *ud)
+{
+    es_construct_allocator(&es->alloc, fn, ud);
+    es_construct_gc(&es->gc, &es->alloc, markroots, es);
+
     es->ssize = 128u;
-    es->stack = (es_value*) malloc(es->ssize * sizeof(es_value));
+    es->stack = (es_value*) es_malloc(&es->alloc, es->ssize * sizeof(es_value));
     es->top = es->stack;
 
-    es_construct_array(es_value, es->kst);
-    es_construct_array(es_callframe, es->frames);
-    es_construct_array(es_code, es->codechunks);
+    // registers above top are scanned once top passes them again
+    for(size_t i = 0; i < es->ssize; ++i)
+        es->stack[i].tid = ES_NIL;
+
+    es_construct_array(es_value, es->kst, &es->alloc);
+    es_construct_map(&es->kindex, &es->alloc);
+    es_construct_array(es_value, es->globals, &es->alloc);
+    es_construct_array(cstr, es->globalnames, &es->alloc);
+    es_construct_array(es_callframe, es->frames, &es->alloc);
+    es_construct_array(es_code, es->codechunks, &es->alloc);
 
-    es_construct_array(es_function, es->funcs);
+    es_construct_array(es_function, es->funcs, &es->alloc);
+    es_construct_array(es_shapeptr, es->shapes, &es->alloc);
+
+    memset(&es->peepstats, 0, sizeof(es_peepstats));
+
+    es_open_builtins(es);
 }
 
 
 //*************************************************************************
 void es_destruct_state(es_state *es)
 {
-    free(es->stack);
+    es_destroy_gc(&es->gc);
+
+    es_free(&es->alloc, es->stack, es->ssize * sizeof(es_value));
 
     es->stack   =  (es_value*)      NULL;
     es->top     =  (es_value*)      NULL;
 
     es_destroy_array(es_callframe, es->frames);
     es_destroy_array(es_value, es->kst);
+    es_destroy_map(&es->kindex);
+    es_destroy_array(es_value, es->globals);
+
+    for(size_t i = 0; i < es->globalnames.size; ++i)
+        es_free(&es->alloc, es->globalnames.data[i], strlen(es->globalnames.data[i]) + 1);
+
+    es_destroy_array(cstr, es->globalnames);
 
     for(size_t i = 0; i < es->codechunks.size; ++i)
     {
-        free(es->codechunks.data[i].instructions);
+        es_free(&es->alloc, es->codechunks.data[i].instructions, es->codechunks.data[i].size * sizeof(es_instruction));
     }
     for(size_t i = 0; i < es->funcs.size; ++i)
     {
-        free(es->funcs.data[i].name);
+        es_free(&es->alloc, es->funcs.data[i].name, strlen(es->funcs.data[i].name) + 1);
+        es_free(&es->alloc, es->funcs.data[i].fieldcaches, es->funcs.data[i].fieldcount * sizeof(es_fieldcache));
+    }
+
+    // after the collector, struct objects read their size from their shape
+    for(size_t i = 0; i < es->shapes.size; ++i)
+    {
+        es_shape *shape = es->shapes.data[i];
+        es_free(&es->alloc, shape->name, strlen(shape->name) + 1);
+        es_free(&es->alloc, shape->fields, shape->size * sizeof(u32));
+        es_free(&es->alloc, shape, sizeof(es_shape));
     }
 
     es_destroy_array(es_code, es->codechunks);
 
     es_destroy_array(es_function, es->funcs);
+    es_destroy_array(es_shapeptr, es->shapes);
+
+    es_destroy_allocator(&es->alloc);
+}
+
+
+//*************************************************************************
+void es_set_memlimit(es_state *es, size_t limit)
+{
+    es->alloc.limit = limit;
+    es->alloc.overlimit = 0;
 }
 
 
 //*************************************************************************
-size_t addk(es_state *es, es_value *k)
+static size_t addk(es_state *es, es_value *k)
 {
     // search
-    for(size_t i = 0; i < es->kst.size; ++i)
-    {
-        // TODO: expand for objects
-        if(es->kst.data[i].tid == k->tid && es->kst.data[i].u == k->u)
-        { return i; }
-    }
+    es_value *i = es_mapget(&es->kindex, k);
+    if(i) return (size_t) i->i;
+
+    // add, constants are shared by every instruction that names them
+    if(!es_arrpush(es_value, es->kst)) return ES_KNONE;
+    es_copy_value(&es_arrback(es->kst), k);
+
+    es_value index;
+    index.tid = ES_INT;
+    index.i   = (i64) es->kst.size - 1;
+
+    // without an index entry it's only never found again
+    es_mapset(&es->kindex, &es_arrback(es->kst), &index);
 
-    // add
-    es_arrpush(es_value, es->kst);
-    es_arrback(es->kst).u   = k->u;
-    es_arrback(es->kst).tid = k->tid;
     return es->kst.size - 1;
 }
 
@@ -87,17 +163,194 @@ size_t es_addk_float(es_state *es, long double f)
 }
 
 
+//*************************************************************************
+size_t es_addk_bool(es_state *es, bool b)
+{
+    es_value k;
+    k.u = b;
+    k.tid = ES_BOOL;
+    return addk(es,&k);
+}
+
+
+//*************************************************************************
+size_t es_addk_nil(es_state *es)
+{
+    es_value k;
+    k.u = 0;
+    k.tid = ES_NIL;
+    return addk(es,&k);
+}
+
+
 //*************************************************************************
 size_t es_addk_string(es_state *es, const char *str, size_t strsize)
 {
+    // look for the contents before allocating a string for them
+    es_string probe;
+    probe.data     = (char*) str;
+    probe.size     = strsize;
+    probe.capacity = 0;
+    probe.parent   = NULL;
+
     es_value k;
-    k.obj = ES_ALLOCATE_OBJ(es_string);
+    k.obj = &probe.obj;
+    k.tid = ES_STRING;
+
+    es_value *i = es_mapget(&es->kindex, &k);
+    if(i) return (size_t) i->i;
+
+    // an object that failed to construct is left to the collector
+    k.obj = ES_ALLOCATE_OBJ(&es->alloc, es_string, ES_STRING);
+    if(!k.obj) return ES_KNONE;
+
     k.tid = ES_STRING;
-    es_construct_string((es_string*) k.obj, str, strsize);
+    if(!es_construct_string((es_string*) k.obj, str, strsize)) return ES_KNONE;
+
     return addk(es,&k);
 }
 
 
+//*************************************************************************
+void es_register_cfunc(es_state *es, const char *name, es_cfunction cfunc, i32 params, i32 returns)
+{
+    size_t size = strlen(name);
+
+    // left unregistered when out of memory
+    char *copy = (char*) es_malloc(&es->alloc, size + 1);
+    if(!copy) return;
+
+    if(!es_arrpush(es_function, es->funcs))
+    {
+        es_free(&es->alloc, copy, size + 1);
+        return;
+    }
+
+    es_arrback(es->funcs).ip       = NULL;
+    es_arrback(es->funcs).name     = copy;
+    es_arrback(es->funcs).params   = params;
+    es_arrback(es->funcs).returns  = returns;
+    es_arrback(es->funcs).size     = 0;
+    es_arrback(es->funcs).cfunc    = cfunc;
+    es_arrback(es->funcs).maxregs  = 0;
+    es_arrback(es->funcs).fieldcaches = NULL;
+    es_arrback(es->funcs).fieldcount  = 0;
+
+    memcpy(es_arrback(es->funcs).name, name, size + 1);
+}
+
+
+//*************************************************************************
+es_shape *es_register_shape(es_state *es, const char *name, size_t namesize, const u32 *fields, u32 size)
+{
+    // shapes are allocated one at a time, objects and caches point at them
+    es_shape *shape = (es_shape*) es_malloc(&es->alloc, sizeof(es_shape));
+    if(!shape) return NULL;
+
+    shape->id     = (u32) es->shapes.size;
+    shape->size   = size;
+    shape->name   = (char*) es_malloc(&es->alloc, namesize + 1);
+    shape->fields = size ? (u32*) es_malloc(&es->alloc, size * sizeof(u32)) : NULL;
+
+    if(!shape->name || (size && !shape->fields) || !es_arrpush(es_shapeptr, es->shapes))
+    {
+        es_free(&es->alloc, shape->name, namesize + 1);
+        es_free(&es->alloc, shape->fields, size * sizeof(u32));
+        es_free(&es->alloc, shape, sizeof(es_shape));
+        return NULL;
+    }
+
+    memcpy(shape->name, name, namesize);
+    shape->name[namesize] = '\0';
+
+    if(size) memcpy(shape->fields, fields, size * sizeof(u32));
+
+    es_arrback(es->shapes) = shape;
+
+    return shape;
+}
+
+
+//*************************************************************************
+i64 es_register_global(es_state *es, const char *name, size_t namesize)
+{
+    i64 g = es_find_global(es, name, namesize);
+    if(g >= 0) return g;
+
+    char *gname = (char*) es_malloc(&es->alloc, namesize + 1);
+    if(!gname) return -1;
+
+    if(!es_arrpush(cstr, es->globalnames))
+    {
+        es_free(&es->alloc, gname, namesize + 1);
+        return -1;
+    }
+
+    if(!es_arrpush(es_value, es->globals))
+    {
+        es_arrpopn(es->globalnames, 1);
+        es_free(&es->alloc, gname, namesize + 1);
+        return -1;
+    }
+
+    memcpy(gname, name, namesize);
+    gname[namesize] = '\0';
+
+    es_arrback(es->globalnames) = gname;
+    es_arrback(es->globals).tid = ES_NIL;
+    es_arrback(es->globals).u   = 0;
+
+    return (i64) es->globals.size - 1;
+}
+
+
+//*************************************************************************
+i64 es_find_global(es_state *es, const char *name, size_t namesize)
+{
+    for(size_t i = 0; i < es->globalnames.size; ++i)
+    {
+        const char *gname = es->globalnames.data[i];
+
+        if(strncmp(gname, name, namesize) == 0 && gname[namesize] == '\0')
+            return (i64) i;
+    }
+
+    return -1;
+}
+
+
+//*************************************************************************
+es_value es_get_global(es_state *es, size_t handle)
+{
+    es_value v;
+    es_copy_value(&v, es->globals.data + handle);
+    return v;
+}
+
+
+//*************************************************************************
+void es_set_global(es_state *es, size_t handle, es_value *v)
+{
+    // globals are roots, marked again before every sweep, no barrier needed
+    es_copy_value(es->globals.data + handle, v);
+}
+
+
+//*************************************************************************
+es_shape *es_find_shape(es_state *es, const char *name, size_t namesize)
+{
+    for(size_t i = 0; i < es->shapes.size; ++i)
+    {
+        es_shape *shape = es->shapes.data[i];
+
+        if(strlen(shape->name) == namesize && strncmp(shape->name, name, namesize) == 0)
+            return shape;
+    }
+
+    return NULL;
+}
+
+
 // //*************************************************************************
 // size_t es_addk_func(es_state *es, es_instruction *ip, const char *fname)
 // {
@@ -130,6 +383,10 @@ size_t es_addk_string(es_state *es, const char *str, size_t strsize)
                       bsize  -= cw;}\
 
 
+//*************************************************************************
+static const char *elemnames[ES_ELEM_COUNT] = { "int", "float", "byte" };
+
+
 //*************************************************************************
 int es_valuetostring(es_value *v, char *buffer, size_t bsize)
 {
@@ -142,7 +399,10 @@ int es_valuetostring(es_value *v, char *buffer, size_t bsize)
         case ES_FLOAT:   write("%f", v->f);                   break;
         case ES_BOOL:    write("%s", (v->u)?"true":"false");  break;
         case ES_NIL:     write("%s", "nil");                  break;
-        case ES_STRING:  write("%s", AS_STRING(v)->data);     break;
+        case ES_STRING:  write("%.*s", (int) AS_STRING(v)->size, AS_STRING(v)->data);  break;
+        case ES_ARRAY:   write("%s[%zu]", elemnames[AS_NUMARRAY(v)->elem], AS_NUMARRAY(v)->size); break;
+        case ES_MAP:     write("map[%zu]", AS_MAP(v)->map.size); break;
+        case ES_STRUCT:  write("%s{%u}", AS_STRUCT(v)->shape->name, AS_STRUCT(v)->shape->size); break;
 
         default: write("%s", "ERR");
     }
@@ -193,6 +453,241 @@ void es_print_stack(es_state *es)
 // [[[[[[[[[[[[[[[[[[[[[[[[[[[[[[[[[[[ Execution ]]]]]]]]]]]]]]]]]]]]]]]]]]]]]]]]]]]
 
 
+#define ES_MAX_CONCAT 512
+
+
+//*************************************************************************
+static void memerror(es_state *es)
+{
+    if(es->alloc.overlimit) printf("runtime error : memory limit exceeded");
+    else                    printf("runtime error : out of memory");
+}
+
+
+//*************************************************************************
+static int concat(es_state *es, es_value *a, es_value **vs, size_t count)
+{
+    // returns 1 on success, 0 on mistype, -1 on allocation failure
+
+    for(size_t n = 0; n < count; ++n)
+        if(vs[n]->tid != ES_STRING) return 0;
+
+    // a is the only reference to the first operand, append in place
+    if(a == vs[0] && !a->obj->shared)
+    {
+        size_t size = AS_STRING(a)->size;
+        for(size_t n = 1; n < count; ++n)
+            size += AS_STRING(vs[n])->size;
+
+        es_strreserve(AS_STRING(a), size + 1);
+        if(AS_STRING(a)->capacity < size + 1) return -1;
+
+        for(size_t n = 1; n < count; ++n)
+            es_strappend(AS_STRING(a), AS_STRING(vs[n]));
+
+        return 1;
+    }
+
+    const es_string *strs[ES_MAX_CONCAT];
+    for(size_t n = 0; n < count; ++n)
+        strs[n] = AS_STRING(vs[n]);
+
+    es_string *str = es_strconcatn(&es->alloc, strs, count);
+    if(!str) return -1;
+
+    es_destroy_value(a);
+    a->tid = ES_STRING;
+    a->obj = &str->obj;
+
+    return 1;
+}
+
+
+//*************************************************************************
+static int readelem(es_value *r, es_value *b, es_value *c)
+{
+    // arrays and strings, returns 1 on success, 0 on mistype, -1 out of range
+
+    if(c->tid != ES_INT) return 0;
+
+    u64 n = (u64) c->i;
+
+    if(b->tid == ES_ARRAY)
+    {
+        es_numarray *arr = AS_NUMARRAY(b);
+
+        if(n >= arr->size) return -1;
+
+        switch(arr->elem)
+        {
+        case ES_ELEM_INT:   r->tid = ES_INT;   r->i = arr->data.i[n]; break;
+        case ES_ELEM_FLOAT: r->tid = ES_FLOAT; r->f = arr->data.f[n]; break;
+        default:            r->tid = ES_INT;   r->i = arr->data.b[n]; break;
+        }
+
+        return 1;
+    }
+    else if(b->tid == ES_STRING)
+    {
+        if(n >= AS_STRING(b)->size) return -1;
+
+        r->tid = ES_INT;
+        r->i   = (u8) AS_STRING(b)->data[n];
+
+        return 1;
+    }
+
+    return 0;
+}
+
+
+//*************************************************************************
+static int writeelem(es_value *a, es_value *b, es_value *c)
+{
+    if(a->tid != ES_ARRAY || b->tid != ES_INT) return 0;
+
+    es_numarray *arr = AS_NUMARRAY(a);
+    u64 n = (u64) b->i;
+
+    if(n >= arr->size) return -1;
+
+    if(arr->elem == ES_ELEM_FLOAT && c->tid == ES_FLOAT)
+        arr->data.f[n] = c->f;
+    else if(arr->elem == ES_ELEM_FLOAT && c->tid == ES_INT)
+        arr->data.f[n] = (f64) c->i;
+    else if(arr->elem == ES_ELEM_INT && c->tid == ES_INT)
+        arr->data.i[n] = c->i;
+    else if(arr->elem == ES_ELEM_BYTE && c->tid == ES_INT)
+        arr->data.b[n] = (u8) c->i;
+    else
+        return 0;
+
+    return 1;
+}
+
+
+//*************************************************************************
+static int readkey(es_value *r, es_value *b, es_value *c)
+{
+    // missing keys read as nil
+    es_value *v = es_mapget(&AS_MAP(b)->map, c);
+
+    if(v) es_copy_value(r, v);
+    else  { r->tid = ES_NIL; r->u = 0; }
+
+    return 1;
+}
+
+
+//*************************************************************************
+static int writekey(es_value *a, es_value *b, es_value *c)
+{
+    // writing nil erases the key, returns -2 on allocation failure
+
+    if(b->tid == ES_NIL) return 0;
+
+    es_mapobject *m = AS_MAP(a);
+
+    if(c->tid == ES_NIL)
+    {
+        es_maperase(&m->map, b);
+        return 1;
+    }
+
+    if(!es_mapset(&m->map, b, c)) return -2;
+
+    es_gc_barrierv(&m->obj, b);
+    es_gc_barrierv(&m->obj, c);
+
+    return 1;
+}
+
+
+//*************************************************************************
+static void indexerror(es_state *es, int result, const char *op)
+{
+    if(result == 0)       printf("runtime error %s mistype", op);
+    else if(result == -1) printf("runtime error index out of range");
+    else                  memerror(es);
+}
+
+
+//*************************************************************************
+static int readindex(es_state *es, es_value *a, es_value *b, es_value *c, const char *op)
+{
+    // any container and key, what the specialized reads fall back to.
+    // returns 0 after reporting an error
+    es_value r;
+
+    int result = b->tid == ES_MAP ? readkey(&r, b, c) : readelem(&r, b, c);
+
+    if(result <= 0)
+    {
+        indexerror(es, result, op);
+        return 0;
+    }
+
+    *a = r;
+    return 1;
+}
+
+
+//*************************************************************************
+static int writeindex(es_state *es, es_value *a, es_value *b, es_value *c, const char *op)
+{
+    int result = a->tid == ES_MAP ? writekey(a, b, c) : writeelem(a, b, c);
+
+    if(result <= 0)
+    {
+        indexerror(es, result, op);
+        return 0;
+    }
+
+    return 1;
+}
+
+
+//*************************************************************************
+static int fieldmiss(es_state *es, es_structobject *s, es_fieldcache *fc)
+{
+    // the site's first access, or a shape it hasn't seen, find the field by
+    // name and keep where this shape has it, returns 0 if it has no such field
+    i32 slot = es_structfield(s->shape, es->kst.data, es->kst.data + fc->name);
+    if(slot < 0) return 0;
+
+    fc->shape = s->shape;
+    fc->slot  = (u32) slot;
+
+    return 1;
+}
+
+
+//*************************************************************************
+static void fielderror(es_state *es, es_value *v, es_fieldcache *fc, const char *op)
+{
+    es_string *name = (es_string*) es->kst.data[fc->name].obj;
+
+    if(v->tid != ES_STRUCT) printf("runtime error %s mistype", op);
+    else printf("runtime error %s has no field '%.*s'", AS_STRUCT(v)->shape->name, (int) name->size, name->data);
+}
+
+
+
+//*************************************************************************
+static int reserve(es_state *es, es_value *end)
+{
+    // a frame's registers are under top from the call on, the ops write
+    // them without moving it. whatever was above the old top may be stale
+    if(end > es->stack + es->ssize) return 0;
+
+    for(; es->top < end; ++(es->top))
+        es->top->tid = ES_NIL;
+
+    return 1;
+}
+
+
+
 // helper macros
 #define R(r)    (es_arrback(es->frames).base+(r))
 #define K(k)    (es->kst.data+(k))
@@ -256,9 +751,6 @@ void es_execute_bytecode(es_state *es, es_instruction *program, size_t size)
         {
             es_value* a =  RA(i);
 
-            if(a == es->top)
-            { ++(es->top); }
-
             es_value* b = RKB(i);
             es_value* c = RKC(i);
 
@@ -278,6 +770,17 @@ void es_execute_bytecode(es_state *es, es_instruction *program, size_t size)
                 printf("%f", a->f);
                 break;
             }
+            else if(b->tid == ES_STRING && c->tid == ES_STRING)
+            {
+                es_value* vs[2] = {b, c};
+                if(concat(es, a, vs, 2) < 0)
+                {
+                    memerror(es);
+                    return;
+                }
+                printf("\"%s\"", AS_STRING(a)->data);
+                break;
+            }
 
             printf("runtime error add mistype");
             return;
@@ -288,9 +791,6 @@ void es_execute_bytecode(es_state *es, es_instruction *program, size_t size)
         {
             es_value* a =  RA(i);
 
-            if(a == es->top)
-            { ++(es->top); }
-
             es_value* b = RKB(i);
             es_value* c = RKC(i);
 
@@ -320,9 +820,6 @@ void es_execute_bytecode(es_state *es, es_instruction *program, size_t size)
         {
             es_value* a =  RA(i);
 
-            if(a == es->top)
-            { ++(es->top); }
-
             es_value* b = RKB(i);
             es_value* c = RKC(i);
 
@@ -352,9 +849,6 @@ void es_execute_bytecode(es_state *es, es_instruction *program, size_t size)
         {
             es_value* a =  RA(i);
 
-            if(a == es->top)
-            { ++(es->top); }
-
             es_value* b = RKB(i);
             es_value* c = RKC(i);
 
@@ -384,9 +878,6 @@ void es_execute_bytecode(es_state *es, es_instruction *program, size_t size)
         {
             es_value* a = RA(i);
 
-            if(a == es->top)
-            { ++(es->top); }
-
             es_value* b = RKB(i);
             es_value* c = RKC(i);
 
@@ -413,9 +904,6 @@ void es_execute_bytecode(es_state *es, es_instruction *program, size_t size)
         {
             es_value* a = RA(i);
 
-            if(a == es->top)
-            { ++(es->top); }
-
             es_value* b = RKB(i);
             es_value* c = RKC(i);
 
@@ -442,9 +930,6 @@ void es_execute_bytecode(es_state *es, es_instruction *program, size_t size)
         {
             es_value* a = RA(i);
 
-            if(a == es->top)
-            { ++(es->top); }
-
             es_value* b = RKB(i);
             es_value* c = RKC(i);
 
@@ -471,9 +956,6 @@ void es_execute_bytecode(es_state *es, es_instruction *program, size_t size)
         {
             es_value* a = RA(i);
 
-            if(a == es->top)
-            { ++(es->top); }
-
             es_value* b = RKB(i);
             es_value* c = RKC(i);
 
@@ -496,12 +978,454 @@ void es_execute_bytecode(es_state *es, es_instruction *program, size_t size)
         }
 
         //------------------------------
-        case OP_JMP:
+        case OP_ADDI:
         {
-            uint64_t a = A(i);
-            int64_t  y = YS(i);
+            es_value* a = RA(i);
+            es_value* b = RB(i);
+            int64_t   c = CS(i);
 
-            y *= (es->top-1)->i == a || a >= 2;
+            if(b->tid != ES_INT)
+            {
+                printf("runtime error addi mistype");
+                return;
+            }
+
+            printf("%" PRId64 " + %" PRId64 " = ", b->i, c);
+            a->i = b->i + c;
+            a->tid = ES_INT;
+            printf("%" PRId64, a->i);
+
+            break;
+        }
+
+        //------------------------------
+        case OP_SUBI:
+        {
+            es_value* a = RA(i);
+            es_value* b = RB(i);
+            int64_t   c = CS(i);
+
+            if(b->tid != ES_INT)
+            {
+                printf("runtime error subi mistype");
+                return;
+            }
+
+            printf("%" PRId64 " - %" PRId64 " = ", b->i, c);
+            a->i = b->i - c;
+            a->tid = ES_INT;
+            printf("%" PRId64, a->i);
+
+            break;
+        }
+
+        //------------------------------
+        case OP_EQI:
+        {
+            es_value* a = RA(i);
+            es_value* b = RB(i);
+            int64_t   c = CS(i);
+
+            // anything but an int is never equal to one
+            bool r = b->tid == ES_INT && b->i == c;
+
+            es_printvalue(b);
+            printf(" == %" PRId64 " : ", c);
+            a->i = r;
+            a->tid = ES_BOOL;
+
+            printf(BOOLALPHA(a->i));
+
+            break;
+        }
+
+        //------------------------------
+        case OP_NEI:
+        {
+            es_value* a = RA(i);
+            es_value* b = RB(i);
+            int64_t   c = CS(i);
+
+            // anything but an int is never equal to one
+            bool r = b->tid != ES_INT || b->i != c;
+
+            es_printvalue(b);
+            printf(" != %" PRId64 " : ", c);
+            a->i = r;
+            a->tid = ES_BOOL;
+
+            printf(BOOLALPHA(a->i));
+
+            break;
+        }
+
+        //------------------------------
+        case OP_LTI:
+        {
+            es_value* a = RA(i);
+            es_value* b = RB(i);
+            int64_t   c = CS(i);
+
+            if(b->tid != ES_INT)
+            {
+                printf("runtime error lti mistype");
+                return;
+            }
+
+            printf("%" PRId64 " < %" PRId64 " : ", b->i, c);
+            a->i = b->i < c;
+            a->tid = ES_BOOL;
+
+            printf(BOOLALPHA(a->i));
+
+            break;
+        }
+
+        //------------------------------
+        case OP_LEI:
+        {
+            es_value* a = RA(i);
+            es_value* b = RB(i);
+            int64_t   c = CS(i);
+
+            if(b->tid != ES_INT)
+            {
+                printf("runtime error lei mistype");
+                return;
+            }
+
+            printf("%" PRId64 " <= %" PRId64 " : ", b->i, c);
+            a->i = b->i <= c;
+            a->tid = ES_BOOL;
+
+            printf(BOOLALPHA(a->i));
+
+            break;
+        }
+
+        //------------------------------
+        case OP_GTI:
+        {
+            es_value* a = RA(i);
+            es_value* b = RB(i);
+            int64_t   c = CS(i);
+
+            if(b->tid != ES_INT)
+            {
+                printf("runtime error gti mistype");
+                return;
+            }
+
+            printf("%" PRId64 " > %" PRId64 " : ", b->i, c);
+            a->i = b->i > c;
+            a->tid = ES_BOOL;
+
+            printf(BOOLALPHA(a->i));
+
+            break;
+        }
+
+        //------------------------------
+        case OP_GEI:
+        {
+            es_value* a = RA(i);
+            es_value* b = RB(i);
+            int64_t   c = CS(i);
+
+            if(b->tid != ES_INT)
+            {
+                printf("runtime error gei mistype");
+                return;
+            }
+
+            printf("%" PRId64 " >= %" PRId64 " : ", b->i, c);
+            a->i = b->i >= c;
+            a->tid = ES_BOOL;
+
+            printf(BOOLALPHA(a->i));
+
+            break;
+        }
+
+        //------------------------------
+        case OP_CONCAT:
+        {
+            es_value* a = RA(i);
+
+            size_t count = C(i) - B(i) + 1;
+
+            if(C(i) < B(i) || count > ES_MAX_CONCAT)
+            {
+                printf("runtime error concat range");
+                return;
+            }
+
+            es_value* vs[ES_MAX_CONCAT];
+            for(size_t n = 0; n < count; ++n)
+                vs[n] = RB(i) + n;
+
+            int result = concat(es, a, vs, count);
+
+            if(result < 0)
+            {
+                memerror(es);
+                return;
+            }
+            else if(result == 0)
+            {
+                printf("runtime error concat mistype");
+                return;
+            }
+
+            printf("\"%s\"", AS_STRING(a)->data);
+
+            break;
+        }
+
+        //------------------------------
+        case OP_READS:
+        {
+            es_value* a = RA(i);
+
+            es_value* b = RB(i);
+            es_fieldcache* fc = es_arrback(es->frames).func->fieldcaches + C(i);
+
+            if(b->tid != ES_STRUCT || (AS_STRUCT(b)->shape != fc->shape && !fieldmiss(es, AS_STRUCT(b), fc)))
+            {
+                fielderror(es, b, fc, "reads");
+                return;
+            }
+
+            es_copy_value(a, AS_STRUCT(b)->slots + fc->slot);
+            es_printvalue(a);
+
+            break;
+        }
+
+        //------------------------------
+        case OP_WRITES:
+        {
+            es_value* a = RA(i);
+            es_value* c = RKC(i);
+            es_fieldcache* fc = es_arrback(es->frames).func->fieldcaches + B(i);
+
+            if(a->tid != ES_STRUCT || (AS_STRUCT(a)->shape != fc->shape && !fieldmiss(es, AS_STRUCT(a), fc)))
+            {
+                fielderror(es, a, fc, "writes");
+                return;
+            }
+
+            es_copy_value(AS_STRUCT(a)->slots + fc->slot, c);
+            es_gc_barrierv(a->obj, c);
+
+            es_printvalue(c);
+
+            break;
+        }
+
+        //------------------------------
+        case OP_NEWS:
+        {
+            es_value* a = RA(i);
+
+            es_structobject *s = es_allocate_struct(&es->alloc, es->shapes.data[B(i)]);
+
+            if(!s)
+            {
+                memerror(es);
+                return;
+            }
+
+            // fields from the arguments, the object may already be black
+            for(u64 n = 0; n < C(i); ++n)
+            {
+                es_copy_value(s->slots + n, a + n);
+                es_gc_barrierv(&s->obj, a + n);
+            }
+
+            es_destroy_value(a);
+            a->tid = ES_STRUCT;
+            a->obj = &s->obj;
+
+            es_printvalue(a);
+
+            break;
+        }
+
+        //------------------------------
+        case OP_READA:
+        {
+            es_value* a = RA(i);
+            es_value* b = RB(i);
+            es_value* c = RKC(i);
+
+            // numbers of an array in place, strings and maps go the long way
+            if(b->tid == ES_ARRAY && c->tid == ES_INT && (u64) c->i < AS_NUMARRAY(b)->size)
+            {
+                es_numarray *arr = AS_NUMARRAY(b);
+                u64 n = (u64) c->i;
+
+                switch(arr->elem)
+                {
+                case ES_ELEM_INT:   a->i = arr->data.i[n]; a->tid = ES_INT;   break;
+                case ES_ELEM_FLOAT: a->f = arr->data.f[n]; a->tid = ES_FLOAT; break;
+                default:            a->i = arr->data.b[n]; a->tid = ES_INT;   break;
+                }
+            }
+            else if(!readindex(es, a, b, c, "reada"))
+                return;
+
+            es_printvalue(a);
+
+            break;
+        }
+
+        //------------------------------
+        case OP_WRITEA:
+        {
+            es_value* a = RA(i);
+            es_value* b = RKB(i);
+            es_value* c = RKC(i);
+
+            // stores that need no conversion in place
+            es_numarray *arr = a->tid == ES_ARRAY ? AS_NUMARRAY(a) : NULL;
+
+            if(arr && b->tid == ES_INT && (u64) b->i < arr->size && arr->elem == ES_ELEM_INT && c->tid == ES_INT)
+                arr->data.i[b->i] = c->i;
+            else if(arr && b->tid == ES_INT && (u64) b->i < arr->size && arr->elem == ES_ELEM_FLOAT && c->tid == ES_FLOAT)
+                arr->data.f[b->i] = c->f;
+            else if(!writeindex(es, a, b, c, "writea"))
+                return;
+
+            es_printvalue(c);
+
+            break;
+        }
+
+        //------------------------------
+        case OP_READM:
+        {
+            es_value* a = RA(i);
+            es_value* b = RB(i);
+            es_value* c = RKC(i);
+
+            // missing keys read as nil
+            if(b->tid == ES_MAP)
+            {
+                es_value *v = es_mapget(&AS_MAP(b)->map, c);
+
+                if(v) es_copy_value(a, v);
+                else  { a->tid = ES_NIL; a->u = 0; }
+            }
+            else if(!readindex(es, a, b, c, "readm"))
+                return;
+
+            es_printvalue(a);
+
+            break;
+        }
+
+        //------------------------------
+        case OP_WRITEM:
+        {
+            es_value* a = RA(i);
+            es_value* b = RKB(i);
+            es_value* c = RKC(i);
+
+            // sets of a map in place, erasing and arrays go the long way
+            if(a->tid == ES_MAP && b->tid != ES_NIL && c->tid != ES_NIL)
+            {
+                es_mapobject *m = AS_MAP(a);
+
+                if(!es_mapset(&m->map, b, c))
+                {
+                    indexerror(es, -2, "writem");
+                    return;
+                }
+
+                es_gc_barrierv(&m->obj, b);
+                es_gc_barrierv(&m->obj, c);
+            }
+            else if(!writeindex(es, a, b, c, "writem"))
+                return;
+
+            es_printvalue(c);
+
+            break;
+        }
+
+        //------------------------------
+        case OP_NEWM:
+        {
+            es_value* a = RA(i);
+
+            es_mapobject *m = (es_mapobject*) ES_ALLOCATE_OBJ(&es->alloc, es_mapobject, ES_MAP);
+
+            if(m) es_construct_map(&m->map, &es->alloc);
+
+            if(!m || !es_mapreserve(&m->map, Y(i)))
+            {
+                memerror(es);
+                return;
+            }
+
+            es_destroy_value(a);
+            a->tid = ES_MAP;
+            a->obj = &m->obj;
+
+            es_printvalue(a);
+
+            break;
+        }
+
+        //------------------------------
+        case OP_GETG:
+        {
+            es_value* a = RA(i);
+
+            es_copy_value(a, es->globals.data + Y(i));
+
+            es_printvalue(a);
+
+            break;
+        }
+
+        //------------------------------
+        case OP_SETG:
+        {
+            es_value* a = RA(i);
+
+            es_copy_value(es->globals.data + Y(i), a);
+
+            es_printvalue(a);
+
+            break;
+        }
+
+        //------------------------------
+        case OP_LOADKX:
+        {
+            es_value* a = RA(i);
+
+            // always emitted right after its extraarg
+            es_copy_value(a, KX(ip[-2]));
+
+            es_printvalue(a);
+
+            break;
+        }
+
+        //------------------------------
+        case OP_EXTRAARG:
+            break;
+
+        //------------------------------
+        case OP_JMP:
+        {
+            es_value* a = ORA(i);
+            int64_t   y = YS(i);
+
+            y *= !a || a->i == false;
             ip += y;
 
             printf("ip += %lli", y);
@@ -514,9 +1438,6 @@ void es_execute_bytecode(es_state *es, es_instruction *program, size_t size)
         {
             es_value* a = RA(i);
 
-            if(a == es->top)
-            { es->top->tid = ES_NIL; ++(es->top); }
-
             es_value* b = RKY(i);
 
             es_copy_value(a,b);
@@ -531,9 +1452,6 @@ void es_execute_bytecode(es_state *es, es_instruction *program, size_t size)
         {
             es_value* a = RA(i);
 
-            if(a == es->top)
-            { ++(es->top); }
-
             uint64_t b = YS(i);
 
             a->i   = b;
@@ -550,11 +1468,29 @@ void es_execute_bytecode(es_state *es, es_instruction *program, size_t size)
             es_value* x = RA(i);
             u64 fn = Y(i);
 
-            es_arrpush(es_callframe, es->frames);
+            if(es->funcs.data[fn].cfunc)
+            {
+                int rets = es->funcs.data[fn].cfunc(es, x);
 
-            if(es->frames.size > es->frames.capacity)
+                if(rets < 0)
+                {
+                    if(es->alloc.overlimit) memerror(es);
+                    else printf("runtime error in %s", es->funcs.data[fn].name);
+                    return;
+                }
+
+                es->top = x + rets;
+                reserve(es, es_arrback(es->frames).base + es_arrback(es->frames).func->maxregs);
+
+                printf("cfunc %s", es->funcs.data[fn].name);
+                es_print_stack(es);
+
+                break;
+            }
+
+            if(!es_arrpush(es_callframe, es->frames))
             {
-                printf("\nSTACK OVERFLOW! frames\n");
+                memerror(es);
                 return;
             }
 
@@ -562,6 +1498,12 @@ void es_execute_bytecode(es_state *es, es_instruction *program, size_t size)
             es_arrback(es->frames).base = x;
             es_arrback(es->frames).retaddr = ip;
 
+            if(!reserve(es, x + es->funcs.data[fn].maxregs))
+            {
+                printf("\n  >  runtime error : stack overflow  <\n");
+                return;
+            }
+
             es->dispatch[0] = es_arrback(es->frames).base;
 
             ip = es_arrback(es->frames).func->ip;
@@ -591,8 +1533,6 @@ void es_execute_bytecode(es_state *es, es_instruction *program, size_t size)
 
             es_arrpop(es->frames);
 
-            es->dispatch[0] = es_arrback(es->frames).base;
-
             // return from main
             if(ip == NULL)
             {
@@ -600,6 +1540,12 @@ void es_execute_bytecode(es_state *es, es_instruction *program, size_t size)
                 return;
             }
 
+            es->dispatch[0] = es_arrback(es->frames).base;
+
+            // back over all the caller's registers, the returns may
+            // already reach past them
+            reserve(es, es_arrback(es->frames).base + es_arrback(es->frames).func->maxregs);
+
             break;
         }
 
@@ -631,14 +1577,27 @@ int es_call(es_state *es, const char* function)
 
     // TODO: check params
 
+    if(f->cfunc) return f->cfunc(es, es->stack);
+
     printf("func %s() : \n\n", function);
 
     es_arrclear(es->frames);
-    es_arrpush(es_callframe, es->frames);
+    if(!es_arrpush(es_callframe, es->frames))
+    {
+        memerror(es);
+        return -1;
+    }
+
     es_arrback(es->frames).base = es->stack;
     es_arrback(es->frames).func = f;
     es_arrback(es->frames).retaddr = NULL;
 
+    if(!reserve(es, es->stack + f->maxregs))
+    {
+        printf("\n  >  runtime error : stack overflow  <\n");
+        return -1;
+    }
+
     es_execute_bytecode(es, f->ip, f->size);
 
     return f->returns;
@@ -20,6 +20,26 @@
 #include "instruction.h"
 #include "array.h"
 #include "map.h"
+#include "struct.h"
+#include "memory.h"
+#include "gc.h"
+
+
+struct es_state_t;
+
+// native function, arguments are read from and results written to 'args'
+// returns the number of results, or -1 on error
+typedef int (*es_cfunction)(struct es_state_t *es, es_value *args);
+
+
+// inline cache of one field access site, the shape it last saw and where
+// that shape keeps the field, so a repeat is one compare and one load
+typedef struct es_fieldcache_t
+{
+    es_shape *shape;
+    u32 slot;
+    u32 name;  // constant index of the field's name
+} es_fieldcache;
 
 
 typedef struct es_function_t
@@ -29,9 +49,23 @@ typedef struct es_function_t
     i32 returns;
     es_instruction *ip;
     size_t size;
+    es_cfunction cfunc;
+
+    // registers the function's frame needs, reserved by the call
+    u32 maxregs;
+
+    // field access sites, indexed by the reads / writes instructions
+    es_fieldcache *fieldcaches;
+    size_t fieldcount;
 } es_function;
 
 
+// calls : the arguments go in R(a), R(a+1), ... of the caller and are the
+// callee's r0, r1, ..., its frame starts at a. the call reserves maxregs
+// registers from there, the ones that come newly under top are nil. the
+// results come back in R(a), R(a+1), ... and the caller's frame is reserved
+// again on return, so its registers above the results are nil, nothing the
+// caller keeps at or past a survives the call
 typedef struct es_callframe_t
 {
     es_function *func;
@@ -54,6 +88,20 @@ es_array(es_code);
 es_array(cstr);
 es_array(size_t);
 es_array(es_function);
+es_array(es_fieldcache);
+es_array(es_shapeptr);
+
+
+// what the peephole pass rewrote in a chunk, es_compile and es_assemble
+// leave their chunk's in es_state
+typedef struct es_peepstats_t
+{
+    size_t selfmoves;
+    size_t forwarded;
+    size_t deadstores;
+    size_t jumps;
+    size_t removed; // instructions the chunk got shorter by
+} es_peepstats;
 
 
 typedef struct es_state_t
@@ -64,10 +112,21 @@ typedef struct es_state_t
     es_value *dispatch[2];
 
     es_value_arr kst;
+    es_map kindex;  // constant to its kst index, strings by contents
+
+    // script globals, slots are handed out by name at compile time
+    es_value_arr globals;
+    cstr_arr globalnames;
     es_callframe_arr frames;
     es_code_arr codechunks;
 
     es_function_arr funcs;
+    es_shapeptr_arr shapes;
+
+    es_allocator alloc;
+    es_gc gc;
+
+    es_peepstats peepstats;
 
     size_t ssize;
     uint8_t testresult;
@@ -76,13 +135,36 @@ typedef struct es_state_t
 
 
 void es_construct_state(es_state *es);
+void es_construct_state_alloc(es_state *es, es_alloc_fn fn, void *ud);
 void es_destruct_state(es_state *es);
 
+// live and peak byte counts are in es->alloc, 0 removes the limit
+void es_set_memlimit(es_state *es, size_t limit);
+
+// constant indices, ES_KNONE when out of memory
+#define ES_KNONE ((size_t) -1)
+
 size_t es_addk_int(es_state *es, int64_t i);
 size_t es_addk_float(es_state *es, long double f);
 size_t es_addk_string(es_state *es, const char *str, size_t strsize);
+size_t es_addk_bool(es_state *es, bool b);
+size_t es_addk_nil(es_state *es);
 // size_t es_addk_func(es_state *es, es_instruction *ip, const char *fname);
 
+void es_register_cfunc(es_state *es, const char *name, es_cfunction cfunc, i32 params, i32 returns);
+
+// 'fields' are constant indices of the field names, NULL when out of memory
+es_shape *es_register_shape(es_state *es, const char *name, size_t namesize, const u32 *fields, u32 size);
+es_shape *es_find_shape(es_state *es, const char *name, size_t namesize);
+
+// globals are found by name once, the handle is their slot and reads and
+// writes through it are direct. registering a name that exists returns its
+// handle, -1 when out of memory or, for es_find_global, not found
+i64 es_register_global(es_state *es, const char *name, size_t namesize);
+i64 es_find_global(es_state *es, const char *name, size_t namesize);
+es_value es_get_global(es_state *es, size_t handle);
+void es_set_global(es_state *es, size_t handle, es_value *v);
+
 void es_execute_bytecode(es_state *es, es_instruction *program, size_t size);
 int es_call(es_state *es, const char* function);
 
@@ -0,0 +1,84 @@
+/********************************************************************************
+ * \file test.h
+ * \author Patrick Torgeson (torgersonpatricks@gmail.com)
+ * \brief checks shared by the test executables, each one is a main that
+ *        returns non zero if anything failed
+ * \version 0.1
+ * \date 2022-01-26
+ *
+ * @copyright Copyright (c) 2022
+ *
+ ********************************************************************************/
+
+
+#ifndef ES_TEST_H
+#define ES_TEST_H
+
+
+#include "vm.h"
+
+#include <stdio.h>
+#include <string.h>
+
+
+static int es_test_failures = 0;
+
+
+#define CHECK(c) \
+    do { if(!(c)) { printf("\n%s:%i: check failed : %s\n", __FILE__, __LINE__, #c); ++es_test_failures; } } while(0)
+
+#define CHECK_INT(v, x) \
+    CHECK((v)->tid == ES_INT && (v)->i == (x))
+
+#define CHECK_BOOL(v, x) \
+    CHECK((v)->tid == ES_BOOL && (v)->i == (x))
+
+#define CHECK_STR(v, s) \
+    CHECK((v)->tid == ES_STRING && AS_STRING((v))->size == strlen(s) && memcmp(AS_STRING((v))->data, (s), strlen(s)) == 0)
+
+#define TEST_RESULT() \
+    (printf("\n%s : %s\n", __FILE__, es_test_failures ? "FAILED" : "passed"), es_test_failures != 0)
+
+
+//*************************************************************************
+static inline es_value intkey(i64 i)
+{
+    es_value v;
+    v.tid = ES_INT;
+    v.i = i;
+    return v;
+}
+
+
+//*************************************************************************
+static inline int run(es_state *es, const char *src)
+{
+    // compiles 'src' and calls its main, returns main's result count, its
+    // values are at the bottom of the stack. -1 if it didn't compile
+    if(es_compile(es, src, strlen(src)) != 0) return -1;
+    return es_call(es, "main");
+}
+
+
+//*************************************************************************
+static inline int opcount(es_state *es, const char *fname, es_opcode op)
+{
+    // how many of 'op' the compiled function 'fname' ended up with, -1 if
+    // there's no such script function
+    for(size_t i = 0; i < es->funcs.size; ++i)
+    {
+        es_function *f = es->funcs.data + i;
+        if(!f->ip || strcmp(f->name, fname) != 0) continue;
+
+        int n = 0;
+        for(size_t ins = 0; ins < f->size; ++ins)
+            n += O(f->ip[ins]) == (u64) op;
+
+        return n;
+    }
+
+    return -1;
+}
+
+
+#endif
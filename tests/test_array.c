@@ -0,0 +1,156 @@
+#include "test.h"
+
+
+es_array_small(int, 4);
+
+
+//*************************************************************************
+static int reallocs = 0;
+
+static void *counting(void *ud, void *ptr, size_t oldsize, size_t newsize)
+{
+    if(ptr && newsize) reallocs += 1;
+    return es_default_alloc(ud, ptr, oldsize, newsize);
+}
+
+
+//*************************************************************************
+static void growth()
+{
+    es_allocator alloc;
+    es_construct_allocator(&alloc, counting, NULL);
+
+    size_t_arr a;
+    es_construct_array(size_t, a, &alloc);
+
+    // nothing is allocated until the first push
+    CHECK(a.data == NULL && a.capacity == 0 && alloc.live == 0);
+
+    // capacity doubles, a million pushes only grow it a couple dozen times
+    int ok = 1;
+    for(size_t i = 0; i < 1000000; ++i)
+        ok &= es_arrpushv(size_t, a, i);
+
+    CHECK(ok);
+    CHECK(a.size == 1000000);
+    CHECK(reallocs < 20);
+    CHECK(a.data[0] == 0 && es_arrback(a) == 999999);
+
+    // shrink trims to size, reserve grows once
+    CHECK(es_arrshrink(size_t, a));
+    CHECK(a.capacity == a.size && alloc.live == a.size * sizeof(size_t));
+
+    CHECK(es_arrreserve(size_t, a, 2000000));
+    CHECK(a.capacity == 2000000 && a.size == 1000000);
+
+    es_destroy_array(size_t, a);
+    CHECK(a.data == NULL && alloc.live == 0);
+    es_destroy_allocator(&alloc);
+}
+
+
+//*************************************************************************
+static void inline_storage()
+{
+    es_allocator alloc;
+    es_construct_allocator(&alloc, es_default_alloc, NULL);
+
+    int_sarr s;
+    es_construct_sarray(int, s, &alloc);
+
+    // the first few live in the struct
+    for(int i = 0; i < 4; ++i)
+        es_arrpushv(int, s, i);
+
+    CHECK(s.data == s.buf && alloc.live == 0);
+
+    // and spill to the heap, keeping what was there
+    es_arrpushv(int, s, 4);
+    CHECK(s.data != s.buf && alloc.live > 0);
+    CHECK(s.size == 5 && s.data[0] == 0 && s.data[3] == 3 && s.data[4] == 4);
+
+    es_destroy_array(int, s);
+    CHECK(alloc.live == 0);
+    es_destroy_allocator(&alloc);
+}
+
+
+//*************************************************************************
+static void failures()
+{
+    es_allocator alloc;
+    es_construct_allocator(&alloc, es_default_alloc, NULL);
+    alloc.limit = 64;
+
+    size_t_arr a;
+    es_construct_array(size_t, a, &alloc);
+
+    // a refused push reports it and leaves the array as it was
+    size_t pushed = 0;
+    while(es_arrpushv(size_t, a, pushed)) ++pushed;
+
+    CHECK(pushed == 64 / sizeof(size_t));
+    CHECK(a.size == pushed && a.capacity == pushed);
+    CHECK(es_arrback(a) == pushed - 1);
+    CHECK(!es_arrpush(size_t, a) && a.size == pushed);
+    CHECK(!es_arrreserve(size_t, a, 100) && a.capacity == pushed);
+
+    es_destroy_array(size_t, a);
+    es_destroy_allocator(&alloc);
+}
+
+
+//*************************************************************************
+static void compilelimit()
+{
+    // a script compiled under every limit up to what it needs either
+    // compiles or fails cleanly
+    const char *src =
+        "struct point\n"
+        "    x, y\n"
+        "var g = 5\n"
+        "func add(var a, b)\n"
+        "    return a + b\n"
+        "func main()\n"
+        "    var p = point(1, 2)\n"
+        "    var s = \"some\" + \" string\"\n"
+        "    var m = {1 : 2}\n"
+        "    var r = add(p.x, m[1])\n"
+        "    return r + g, s\n";
+
+    es_state es;
+    es_construct_state(&es);
+    size_t base = es.alloc.live;
+    CHECK(run(&es, src) == 2);
+    CHECK_INT(es.stack + 0, 8);
+    size_t needed = es.alloc.peak - base;
+    es_destruct_state(&es);
+
+    int compiled = 0;
+    for(size_t limit = 0; limit <= needed; limit += 16)
+    {
+        es_construct_state(&es);
+        es_set_memlimit(&es, es.alloc.live + limit);
+
+        if(es_compile(&es, src, strlen(src)) == 0)
+            compiled += 1;
+        else
+            CHECK(es.alloc.overlimit);
+
+        es_destruct_state(&es);
+    }
+
+    CHECK(compiled > 0);
+}
+
+
+//*************************************************************************
+int main()
+{
+    growth();
+    inline_storage();
+    failures();
+    compilelimit();
+
+    return TEST_RESULT();
+}
@@ -0,0 +1,247 @@
+#include "test.h"
+
+#include <stdlib.h>
+
+
+//*************************************************************************
+static void folding()
+{
+    // literal arithmetic and consts collapse to one value, nothing is run
+    es_state es;
+    es_construct_state(&es);
+
+    int rets = run(&es,
+        "const a, b = 6, a * 7\n"
+        "const s = \"con\" + \"st\"\n"
+        "func main()\n"
+        "    var x = 2 * 3 + 4\n"
+        "    var y = b - a * 2\n"
+        "    var z = -(a + 1)\n"
+        "    var t = s\n"
+        "    return x, y, z, t\n");
+
+    CHECK(rets == 4);
+    CHECK_INT(es.stack + 0, 10);
+    CHECK_INT(es.stack + 1, 30);
+    CHECK_INT(es.stack + 2, -7);
+    CHECK_STR(es.stack + 3, "const");
+
+    CHECK(opcount(&es, "main", OP_MUL) == 0);
+    CHECK(opcount(&es, "main", OP_ADD) == 0);
+    CHECK(opcount(&es, "main", OP_SUB) == 0);
+
+    es_destruct_state(&es);
+
+    // a variable operand stops the fold, the constant part is still folded
+    es_construct_state(&es);
+
+    rets = run(&es,
+        "func f(var p)\n"
+        "    var r = p + 2 * 3\n"
+        "    return r\n"
+        "func main()\n"
+        "    var r = f(1)\n"
+        "    return r\n");
+
+    CHECK(rets == 1);
+    CHECK_INT(es.stack + 0, 7);
+    CHECK(opcount(&es, "f", OP_MUL) == 0);
+
+    es_destruct_state(&es);
+
+    // a negative literal passed on its own still gets its register
+    es_construct_state(&es);
+
+    rets = run(&es,
+        "func f(var p, q)\n"
+        "    if p < q\n"
+        "        return p\n"
+        "    return q\n"
+        "func main()\n"
+        "    var r = f(-7, 3)\n"
+        "    return r\n");
+
+    CHECK(rets == 1);
+    CHECK_INT(es.stack + 0, -7);
+
+    es_destruct_state(&es);
+}
+
+
+//*************************************************************************
+static void scopes()
+{
+    // a function's parameters are gone at module scope, the name is free
+    es_state es;
+    es_construct_state(&es);
+
+    int rets = run(&es,
+        "func f(var n)\n"
+        "    return n\n"
+        "const n = 1\n"
+        "func main()\n"
+        "    var r = f(n + 1)\n"
+        "    return r\n");
+
+    CHECK(rets == 1);
+    CHECK_INT(es.stack + 0, 2);
+
+    es_destruct_state(&es);
+    es_construct_state(&es);
+
+    // consts can't be redeclared, or be given a value known only when run
+    CHECK(run(&es,
+        "const k = 1\n"
+        "const k = 2\n"
+        "func main()\n"
+        "    return k\n") == -1);
+
+    es_destruct_state(&es);
+    es_construct_state(&es);
+
+    CHECK(run(&es,
+        "func main()\n"
+        "    var x = 1\n"
+        "    const k = x + 1\n"
+        "    return k\n") == -1);
+
+    es_destruct_state(&es);
+}
+
+
+//*************************************************************************
+static void pool()
+{
+    // the same constant is added once, keyed by type and contents
+    es_state es;
+    es_construct_state(&es);
+
+    size_t i = es_addk_int(&es, 1);
+    size_t b = es_addk_bool(&es, true);
+    size_t f = es_addk_float(&es, 1);
+    size_t s = es_addk_string(&es, "key", 3);
+    size_t n = es_addk_nil(&es);
+
+    CHECK(i != b && i != f && b != f && s != n);
+    CHECK(es_addk_int(&es, 1) == i);
+    CHECK(es_addk_bool(&es, true) == b);
+    CHECK(es_addk_float(&es, 1) == f);
+    CHECK(es_addk_nil(&es) == n);
+
+    // strings by contents, not by where the text lives
+    char text[] = "a key";
+    CHECK(es_addk_string(&es, text + 2, 3) == s);
+    CHECK(es_addk_string(&es, "ke", 2) != s);
+
+    // thousands of distinct constants each get their own slot
+    size_t size = es.kst.size;
+    int ok = 1;
+    for(i64 v = 1000; v < 5000; ++v)
+        ok &= es_addk_int(&es, v) == size + (size_t) (v - 1000);
+
+    CHECK(ok && es.kst.size == size + 4000);
+    CHECK(es_addk_int(&es, 4321) == size + 3321);
+
+    es_destruct_state(&es);
+
+    // repeated literals in a script share one entry
+    es_construct_state(&es);
+
+    int rets = run(&es,
+        "func main()\n"
+        "    var a = \"same\"\n"
+        "    var b = \"same\"\n"
+        "    var c = a + b\n"
+        "    return c\n");
+
+    CHECK(rets == 1);
+    CHECK_STR(es.stack + 0, "samesame");
+
+    int same = 0;
+    for(size_t k = 0; k < es.kst.size; ++k)
+    {
+        es_value *v = es.kst.data + k;
+        same += v->tid == ES_STRING && AS_STRING(v)->size == 4 && memcmp(AS_STRING(v)->data, "same", 4) == 0;
+    }
+
+    CHECK(same == 1);
+
+    es_destruct_state(&es);
+}
+
+
+//*************************************************************************
+static char *sumsource(int n)
+{
+    // main adds up n distinct constants, each one its own kst entry
+    size_t size = 64 + (size_t) n * 32;
+    char *src = (char*) malloc(size);
+
+    int len = sprintf(src, "func main()\n    var s = 0\n");
+    for(int i = 0; i < n; ++i)
+        len += sprintf(src + len, "    s = s + %i\n", 1000000 + i);
+
+    sprintf(src + len, "    return s\n");
+    return src;
+}
+
+
+//*************************************************************************
+static void wide()
+{
+    // the range checks everything emitted goes through, negative values
+    // never fit an unsigned field
+    CHECK(FITSARG(255u, 8) && !FITSARG(256u, 8) && !FITSARG(-1, 8));
+    CHECK(FITSSARG(-256, 9) && FITSSARG(255, 9) && !FITSSARG(256, 9) && !FITSSARG(-257, 9));
+
+    // past k255 constants go through a register, past k131071 through loadkx
+    int sizes[] = {300, 132000};
+
+    for(int t = 0; t < 2; ++t)
+    {
+        int n = sizes[t];
+        char *src = sumsource(n);
+
+        es_state es;
+        es_construct_state(&es);
+
+        int rets = run(&es, src);
+
+        CHECK(rets == 1);
+        CHECK_INT(es.stack + 0, (i64) n * 1000000 + (i64) n * (n - 1) / 2);
+        CHECK((opcount(&es, "main", OP_LOADKX) > 0) == (n > 131072));
+
+        es_destruct_state(&es);
+        free(src);
+    }
+
+    // too many registers is an error rather than wrapping around
+    size_t size = 64 + 300 * 24;
+    char *src = (char*) malloc(size);
+
+    int len = sprintf(src, "func main()\n");
+    for(int i = 0; i < 300; ++i)
+        len += sprintf(src + len, "    var v%i = %i\n", i, i);
+
+    sprintf(src + len, "    return v0\n");
+
+    es_state es;
+    es_construct_state(&es);
+
+    CHECK(run(&es, src) == -1);
+
+    es_destruct_state(&es);
+    free(src);
+}
+
+
+//*************************************************************************
+int main()
+{
+    folding();
+    scopes();
+    pool();
+    wide();
+
+    return TEST_RESULT();
+}
@@ -0,0 +1,106 @@
+#include "test.h"
+
+
+//*************************************************************************
+static void calls()
+{
+    // arguments and results line up with the callee's r0, r1, ...
+    es_state es;
+    es_construct_state(&es);
+
+    int rets = run(&es,
+        "func fib(var n)\n"
+        "    if n < 2\n"
+        "        return n\n"
+        "    var a = fib(n - 1)\n"
+        "    var b = fib(n - 2)\n"
+        "    var r = a + b\n"
+        "    return r\n"
+        "func main()\n"
+        "    var r = fib(15)\n"
+        "    return r\n");
+
+    CHECK(rets == 1);
+    CHECK_INT(es.stack + 0, 610);
+
+    // the whole frame is released, only the result is left under top
+    CHECK(es.top == es.stack + 1);
+    CHECK(es.frames.size == 0);
+
+    es_destruct_state(&es);
+}
+
+
+//*************************************************************************
+static void returns()
+{
+    // a call returned directly keeps its frame where its arguments are,
+    // the result is moved into place after. the branch keeps it a call
+    es_state es;
+    es_construct_state(&es);
+
+    int rets = run(&es,
+        "func twice(var x)\n"
+        "    if x < 0\n"
+        "        return x\n"
+        "    var r = x * 2\n"
+        "    return r\n"
+        "func main()\n"
+        "    var a = 4\n"
+        "    var b = 5\n"
+        "    return twice(b)\n");
+
+    CHECK(rets == 1);
+    CHECK_INT(es.stack + 0, 10);
+
+    es_destruct_state(&es);
+
+    // returning a local after other work returns the local, not the work
+    es_construct_state(&es);
+
+    rets = run(&es,
+        "func main()\n"
+        "    var t = 5\n"
+        "    var c = t * 2\n"
+        "    var d = c + 1\n"
+        "    return t\n");
+
+    CHECK(rets == 1);
+    CHECK_INT(es.stack + 0, 5);
+
+    es_destruct_state(&es);
+}
+
+
+//*************************************************************************
+static void overflow()
+{
+    // recursion that outgrows the stack stops instead of writing past it
+    es_state es;
+    es_construct_state(&es);
+
+    int rets = run(&es,
+        "func down(var n)\n"
+        "    var r = down(n + 1)\n"
+        "    return r\n"
+        "func main()\n"
+        "    var r = down(0)\n"
+        "    return r\n");
+
+    CHECK(rets == 1);
+    CHECK(es.top <= es.stack + es.ssize);
+    CHECK(es.frames.size > 1);
+
+    es_destruct_state(&es);
+}
+
+
+//*************************************************************************
+int main()
+{
+    calls();
+    returns();
+    overflow();
+
+    return TEST_RESULT();
+}
@@ -0,0 +1,159 @@
+#include "test.h"
+#include "gc.h"
+#include "estring.h"
+
+
+#define ROOTS 8
+
+static es_object *roots[ROOTS];
+
+
+//*************************************************************************
+static void markroots(es_gc *gc, void *ud)
+{
+    (void) ud;
+
+    for(int i = 0; i < ROOTS; ++i)
+        if(roots[i]) es_gc_markobject(gc, roots[i]);
+}
+
+
+//*************************************************************************
+static es_string *newstring(es_allocator *alloc, const char *s)
+{
+    es_string *str = (es_string*) ES_ALLOCATE_OBJ(alloc, es_string, ES_STRING);
+    es_construct_string(str, s, strlen(s));
+    return str;
+}
+
+
+//*************************************************************************
+static size_t count(es_gc *gc)
+{
+    size_t n = 0;
+    for(es_object *o = gc->objects; o; o = o->next) ++n;
+    return n;
+}
+
+
+//*************************************************************************
+static void collects()
+{
+    es_allocator alloc;
+    es_construct_allocator(&alloc, es_default_alloc, NULL);
+
+    es_gc gc;
+    es_construct_gc(&gc, &alloc, markroots, NULL);
+    memset(roots, 0, sizeof(roots));
+
+    es_string *kept = newstring(&alloc, "kept");
+    roots[0] = &kept->obj;
+
+    for(int i = 0; i < 100; ++i)
+        newstring(&alloc, "garbage");
+
+    // only what the roots reach survives a full cycle
+    es_gc_collect(&gc);
+    CHECK(count(&gc) == 1 && gc.objects == &kept->obj);
+    CHECK(strcmp(kept->data, "kept") == 0);
+    CHECK(gc.stats.freed == 100 && gc.stats.cycles >= 1);
+
+    // a substring keeps the buffer's owner alive
+    es_string *sub = (es_string*) ES_ALLOCATE_OBJ(&alloc, es_string, ES_STRING);
+    es_construct_substring(sub, kept, 1, 2);
+    roots[0] = &sub->obj;
+
+    es_gc_collect(&gc);
+    CHECK(count(&gc) == 2);
+    CHECK(sub->size == 2 && memcmp(sub->data, "ep", 2) == 0);
+
+    roots[0] = NULL;
+    es_gc_collect(&gc);
+    CHECK(count(&gc) == 0);
+
+    es_destroy_gc(&gc);
+    CHECK(alloc.live == 0);
+    es_destroy_allocator(&alloc);
+}
+
+
+//*************************************************************************
+static void incremental()
+{
+    es_allocator alloc;
+    es_construct_allocator(&alloc, es_default_alloc, NULL);
+
+    es_gc gc;
+    es_construct_gc(&gc, &alloc, markroots, NULL);
+    memset(roots, 0, sizeof(roots));
+
+    gc.stepwork = 4;
+
+    es_string *kept = newstring(&alloc, "kept");
+    roots[0] = &kept->obj;
+
+    for(int i = 0; i < 50; ++i)
+        newstring(&alloc, "garbage");
+
+    // a cycle is spread over steps that each do a bounded amount of work
+    gc.threshold = 0;
+    es_gc_step(&gc);
+    CHECK(gc.phase == GC_PROPAGATE);
+
+    size_t steps = 1;
+    while(gc.phase != GC_PAUSE)
+    {
+        // objects made during the cycle aren't taken by it
+        if(steps == 3) roots[1] = &newstring(&alloc, "young")->obj;
+
+        es_gc_step(&gc);
+        ++steps;
+    }
+
+    CHECK(steps > 51 / 4);
+    CHECK(count(&gc) == 2);
+    CHECK(gc.stats.freed == 50);
+
+    es_destroy_gc(&gc);
+    es_destroy_allocator(&alloc);
+}
+
+
+//*************************************************************************
+static void script()
+{
+    // a script's temporaries are collected, the values it returned stay
+    es_state es;
+    es_construct_state(&es);
+
+    int rets = run(&es,
+        "func build(var s, n)\n"
+        "    if n < 1\n"
+        "        return len(s)\n"
+        "    var t = s + \"0123456789abcdef0123456789abcdef\"\n"
+        "    var u = substr(t, 32, 1000000)\n"
+        "    var r = build(u + \"x\", n - 1)\n"
+        "    return r\n"
+        "func main()\n"
+        "    return build(\"a\", 20)\n");
+
+    CHECK(rets == 1);
+    CHECK_INT(es.stack + 0, 21);
+
+    es_gc_collect(&es.gc);
+    CHECK(es.gc.stats.freed > 0);
+    CHECK_INT(es.stack + 0, 21);
+
+    es_destruct_state(&es);
+}
+
+
+//*************************************************************************
+int main()
+{
+    collects();
+    incremental();
+    script();
+
+    return TEST_RESULT();
+}
@@ -0,0 +1,170 @@
+#include "test.h"
+
+
+//*************************************************************************
+static void script()
+{
+    // module level vars live in slots shared by every function
+    es_state es;
+    es_construct_state(&es);
+
+    int rets = run(&es,
+        "var count, name = 10, \"cfg\"\n"
+        "var unset\n"
+        "func bump(var n)\n"
+        "    count = count + n\n"
+        "    return count\n"
+        "func main()\n"
+        "    var a = bump(5)\n"
+        "    var b = bump(7)\n"
+        "    var s = name\n"
+        "    var u = unset\n"
+        "    return a, b, s, u\n");
+
+    CHECK(rets == 4);
+    CHECK_INT(es.stack + 0, 15);
+    CHECK_INT(es.stack + 1, 22);
+    CHECK_STR(es.stack + 2, "cfg");
+    CHECK(es.stack[3].tid == ES_NIL);
+
+    // the values stay in the slots after the call returns
+    i64 g = es_find_global(&es, "count", 5);
+    CHECK(g >= 0);
+
+    es_value v = es_get_global(&es, (size_t) g);
+    CHECK_INT(&v, 22);
+    CHECK(es_find_global(&es, "missing", 7) == -1);
+
+    es_destruct_state(&es);
+
+    // locals shadow globals of the same name
+    es_construct_state(&es);
+
+    rets = run(&es,
+        "var x = 1\n"
+        "func f()\n"
+        "    return x\n"
+        "func main()\n"
+        "    var x = 2\n"
+        "    x = x + 40\n"
+        "    var y = f()\n"
+        "    return x, y\n");
+
+    CHECK(rets == 2);
+    CHECK_INT(es.stack + 0, 42);
+    CHECK_INT(es.stack + 1, 1);
+
+    es_destruct_state(&es);
+}
+
+
+//*************************************************************************
+static void folded()
+{
+    // initializers fold like consts do, consts and arithmetic included
+    es_state es;
+    es_construct_state(&es);
+
+    int rets = run(&es,
+        "const K = 3\n"
+        "var g, h = K, 60 * 60\n"
+        "var s = \"a\" + \"b\"\n"
+        "var n = -K\n"
+        "func main()\n"
+        "    var a = g\n"
+        "    var b = h\n"
+        "    var c = s\n"
+        "    var d = n\n"
+        "    return a, b, c, d\n");
+
+    CHECK(rets == 4);
+    CHECK_INT(es.stack + 0, 3);
+    CHECK_INT(es.stack + 1, 3600);
+    CHECK_STR(es.stack + 2, "ab");
+    CHECK_INT(es.stack + 3, -3);
+
+    es_destruct_state(&es);
+    es_construct_state(&es);
+
+    // another global's value is only known when run
+    CHECK(run(&es,
+        "var g = 1\n"
+        "var h = g + 1\n"
+        "func main()\n"
+        "    return h\n") == -1);
+
+    es_destruct_state(&es);
+}
+
+
+//*************************************************************************
+static void host()
+{
+    // handles registered before compiling are seen by the script
+    es_state es;
+    es_construct_state(&es);
+
+    i64 limit = es_register_global(&es, "limit", 5);
+    i64 out = es_register_global(&es, "out", 3);
+    CHECK(limit >= 0 && out >= 0 && limit != out);
+
+    // registering again hands back the same slot
+    CHECK(es_register_global(&es, "limit", 5) == limit);
+
+    es_value v;
+    v.tid = ES_INT;
+    v.i = 99;
+    es_set_global(&es, (size_t) limit, &v);
+
+    int rets = run(&es,
+        "func main()\n"
+        "    out = limit + 1\n"
+        "    return out\n");
+
+    CHECK(rets == 1);
+    CHECK_INT(es.stack + 0, 100);
+
+    es_value o = es_get_global(&es, (size_t) out);
+    CHECK_INT(&o, 100);
+
+    es_destruct_state(&es);
+}
+
+
+//*************************************************************************
+static void errors()
+{
+    es_state es;
+    es_construct_state(&es);
+
+    // initializers are constants, stored when compiling
+    CHECK(run(&es,
+        "func f()\n"
+        "    return 1\n"
+        "var x = f()\n"
+        "func main()\n"
+        "    return x\n") == -1);
+
+    es_destruct_state(&es);
+    es_construct_state(&es);
+
+    // unknown names still don't compile
+    CHECK(run(&es,
+        "func main()\n"
+        "    y = 1\n"
+        "    return y\n") == -1);
+
+    es_destruct_state(&es);
+}
+
+
+//*************************************************************************
+int main()
+{
+    script();
+    folded();
+    host();
+    errors();
+
+    return TEST_RESULT();
+}
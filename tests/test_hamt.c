@@ -0,0 +1,92 @@
+#include "test.h"
+#include "hamt.h"
+
+
+//*************************************************************************
+static void versions()
+{
+    es_allocator alloc;
+    es_construct_allocator(&alloc, es_default_alloc, NULL);
+
+    es_hamt empty;
+    es_construct_hamt(&empty, &alloc);
+
+    // each set is a new version, the one it came from is unchanged
+    enum { N = 2000 };
+    es_hamt v1;
+    es_construct_hamt(&v1, &alloc);
+
+    int ok = 1;
+    for(i64 i = 0; i < N; ++i)
+    {
+        es_value k = intkey(i), v = intkey(i * 10);
+        ok &= es_hamtset(&v1, &v1, &k, &v);
+    }
+    CHECK(ok && v1.size == N);
+
+    es_hamt v2;
+    es_construct_hamt(&v2, &alloc);
+    es_value k = intkey(7), v = intkey(-7);
+    CHECK(es_hamtset(&v2, &v1, &k, &v));
+
+    CHECK(es_hamtget(&v1, &k)->i == 70);
+    CHECK(es_hamtget(&v2, &k)->i == -7);
+    CHECK(v2.size == N && es_hamtget(&empty, &k) == NULL);
+
+    // the rest is shared, not copied, so the new version costs a path
+    size_t before = alloc.live;
+    es_hamt v3;
+    es_construct_hamt(&v3, &alloc);
+    es_value k2 = intkey(1234);
+    CHECK(es_hamterase(&v3, &v2, &k2));
+    CHECK(alloc.live - before < 4096);
+
+    CHECK(v3.size == N - 1 && es_hamtget(&v3, &k2) == NULL);
+    CHECK(es_hamtget(&v2, &k2) && es_hamtget(&v2, &k2)->i == 12340);
+
+    // a copy is another handle on the same version
+    es_hamt c = es_hamtcopy(&v3);
+    CHECK(c.root == v3.root && c.size == v3.size);
+    es_destroy_hamt(&v3);
+    CHECK(es_hamtget(&c, &k)->i == -7);
+
+    // iteration visits each key once
+    es_hamt_iter iter;
+    memset(&iter, 0, sizeof(iter));
+    es_value key, *value;
+    size_t count = 0;
+    i64 sum = 0;
+    while((value = es_hamtnext(&c, &iter, &key)))
+    {
+        ++count;
+        sum += key.i;
+    }
+    CHECK(count == N - 1 && sum == (i64) N * (N - 1) / 2 - 1234);
+
+    // erasing everything folds the trie back down to nothing
+    ok = 1;
+    for(i64 i = 0; i < N; ++i)
+    {
+        es_value ki = intkey(i);
+        ok &= es_hamterase(&c, &c, &ki);
+    }
+    CHECK(ok && c.size == 0);
+    CHECK(es_hamtget(&v1, &k)->i == 70);
+
+    es_destroy_hamt(&c);
+    es_destroy_hamt(&v2);
+    es_destroy_hamt(&v1);
+    es_destroy_hamt(&empty);
+
+    CHECK(alloc.live == 0);
+    es_destroy_allocator(&alloc);
+}
+
+
+//*************************************************************************
+int main()
+{
+    versions();
+
+    return TEST_RESULT();
+}
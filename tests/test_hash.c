@@ -0,0 +1,108 @@
+#include "test.h"
+#include "hash.h"
+#include "map.h"
+#include "estring.h"
+
+
+//*************************************************************************
+static void bytes()
+{
+    // only 'size' bytes count, whatever follows them doesn't
+    char a[64], b[64];
+    memset(a, 'x', sizeof(a));
+    memset(b, 'y', sizeof(b));
+
+    int same = 1, differs = 1;
+    for(size_t n = 0; n < 40; ++n)
+    {
+        memcpy(b, a, n);
+        same &= es_hash_bytes(a, n, 7) == es_hash_bytes(b, n, 7);
+
+        // and every one of them does, across the 8 byte reads and the tail
+        for(size_t i = 0; i < n; ++i)
+        {
+            b[i] ^= 1;
+            differs &= es_hash_bytes(a, n, 7) != es_hash_bytes(b, n, 7);
+            b[i] ^= 1;
+        }
+    }
+
+    CHECK(same);
+    CHECK(differs);
+
+    // the seed changes everything
+    CHECK(es_hash_bytes(a, 10, 1) != es_hash_bytes(a, 10, 2));
+    CHECK(es_hash_word(42, 1) != es_hash_word(42, 2));
+    CHECK(es_hash_word(1, 0) != es_hash_word(2, 0));
+}
+
+
+//*************************************************************************
+static void values()
+{
+    // padding and the bytes past an int's payload don't take part
+    es_value x, y;
+    memset(&x, 0xaa, sizeof(x));
+    memset(&y, 0x55, sizeof(y));
+    x.tid = y.tid = ES_INT;
+    x.i = y.i = 1234;
+
+    CHECK(es_hash_value(&x, 3) == es_hash_value(&y, 3));
+
+    // strings by contents, wherever they are
+    es_allocator alloc;
+    es_construct_allocator(&alloc, es_default_alloc, NULL);
+
+    es_string *s = (es_string*) ES_ALLOCATE_OBJ(&alloc, es_string, ES_STRING);
+    es_string *t = (es_string*) ES_ALLOCATE_OBJ(&alloc, es_string, ES_STRING);
+    es_string *u = (es_string*) ES_ALLOCATE_OBJ(&alloc, es_string, ES_STRING);
+    es_construct_string(s, "key", 3);
+    es_construct_string(t, "a key", 5);
+    es_construct_substring(u, t, 2, 3);
+
+    es_value sv, uv;
+    sv.tid = uv.tid = ES_STRING;
+    sv.obj = &s->obj;
+    uv.obj = &u->obj;
+
+    CHECK(es_hash_value(&sv, 3) == es_hash_value(&uv, 3));
+
+    // so either finds what the other stored
+    es_map map;
+    es_construct_map(&map, &alloc);
+
+    es_value one;
+    one.tid = ES_INT;
+    one.i = 1;
+
+    es_mapset(&map, &sv, &one);
+    CHECK(es_mapget(&map, &uv) && es_mapget(&map, &uv)->i == 1);
+
+    // a new seed rehashes what's there
+    CHECK(es_mapseed(&map, 99));
+    CHECK(map.seed == 99 && es_mapget(&map, &sv) != NULL);
+
+    es_destroy_map(&map);
+    es_destroy_string(u);
+    es_destroy_string(t);
+    es_destroy_string(s);
+    ES_FREE_OBJ(u, es_string);
+    ES_FREE_OBJ(t, es_string);
+    ES_FREE_OBJ(s, es_string);
+
+    CHECK(alloc.live == 0);
+    es_destroy_allocator(&alloc);
+
+    // tables are seeded differently
+    CHECK(es_hash_seed() != es_hash_seed());
+}
+
+
+//*************************************************************************
+int main()
+{
+    bytes();
+    values();
+
+    return TEST_RESULT();
+}
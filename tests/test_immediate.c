@@ -0,0 +1,96 @@
+#include "test.h"
+
+
+//*************************************************************************
+static void script()
+{
+    // ints in -256..255 go in the instruction, on either side, others
+    // stay constants
+    es_state es;
+    es_construct_state(&es);
+
+    int rets = run(&es,
+        "func f(var x)\n"
+        "    var a = x + 5\n"
+        "    var b = 7 + x\n"
+        "    var c = x - 255\n"
+        "    var d = x - 256\n"
+        "    var e = x < 10\n"
+        "    var g = 3 < x\n"
+        "    var r = a + b + c + d\n"
+        "    if e\n"
+        "        r = r + 1000\n"
+        "    if g\n"
+        "        r = r + 10000\n"
+        "    return r\n"
+        "func main()\n"
+        "    var r = f(4)\n"
+        "    return r\n");
+
+    CHECK(rets == 1);
+    CHECK_INT(es.stack + 0, 9 + 11 - 251 - 252 + 11000);
+
+    CHECK(opcount(&es, "f", OP_ADDI) == 2);
+    CHECK(opcount(&es, "f", OP_SUBI) == 1);
+    CHECK(opcount(&es, "f", OP_SUB) == 1);
+    CHECK(opcount(&es, "f", OP_LTI) == 1);
+    CHECK(opcount(&es, "f", OP_GTI) == 1);
+
+    es_destruct_state(&es);
+}
+
+
+//*************************************************************************
+static void compares()
+{
+    // the ones the parser doesn't reach yet, written out by hand
+    es_state es;
+    es_construct_state(&es);
+
+    size_t s = es_addk_string(&es, "four", 4);
+
+    es_instruction code[] =
+    {
+        INS_OAY(OP_MOVI, 0, 4),
+        INS_OABC(OP_EQI, 1, 0, 4),
+        INS_OABC(OP_NEI, 2, 0, 4),
+        INS_OAY(OP_MOV, 3, (u32) ASK(s)),
+        INS_OABC(OP_EQI, 3, 3, 4),          // only ints equal an int
+        INS_OABC(OP_LEI, 4, 0, (u32) -1),
+        INS_OABC(OP_GEI, 5, 0, (u32) -256),
+        INS_OX(OP_RET, 6),
+    };
+
+    char *name = (char*) es_malloc(&es.alloc, 2);
+    memcpy(name, "t", 2);
+
+    CHECK(es_arrpush(es_function, es.funcs));
+
+    es_function *f = &es_arrback(es.funcs);
+    memset(f, 0, sizeof(es_function));
+    f->name    = name;
+    f->returns = 6;
+    f->ip      = code;
+    f->size    = sizeof(code) / sizeof(*code);
+    f->maxregs = 6;
+
+    CHECK(es_call(&es, "t") == 6);
+    CHECK_INT(es.stack + 0, 4);
+    CHECK_BOOL(es.stack + 1, true);
+    CHECK_BOOL(es.stack + 2, false);
+    CHECK_BOOL(es.stack + 3, false);
+    CHECK_BOOL(es.stack + 4, false);
+    CHECK_BOOL(es.stack + 5, true);
+
+    es_destruct_state(&es);
+}
+
+
+//*************************************************************************
+int main()
+{
+    script();
+    compares();
+
+    return TEST_RESULT();
+}
@@ -0,0 +1,90 @@
+#include "test.h"
+
+
+//*************************************************************************
+static void leaves()
+{
+    // short straight line functions are copied in, nested ones too
+    es_state es;
+    es_construct_state(&es);
+
+    int rets = run(&es,
+        "struct P\n"
+        "    x, y\n"
+        "func square(var n)\n"
+        "    var r = n * n\n"
+        "    return r\n"
+        "func quad(var n)\n"
+        "    var r = square(square(n))\n"
+        "    return r\n"
+        "func sum3(var a, b, c)\n"
+        "    var r = a + b + c\n"
+        "    return r\n"
+        "func getx(var p)\n"
+        "    var r = p.x\n"
+        "    return r\n"
+        "func main()\n"
+        "    var a = square(6)\n"
+        "    var b = quad(3)\n"
+        "    var c = sum3(a, b, 1)\n"
+        "    var p = P(4, 5)\n"
+        "    var d = getx(p)\n"
+        "    return a, b, c, d\n");
+
+    CHECK(rets == 4);
+    CHECK_INT(es.stack + 0, 36);
+    CHECK_INT(es.stack + 1, 81);
+    CHECK_INT(es.stack + 2, 118);
+    CHECK_INT(es.stack + 3, 4);
+
+    CHECK(opcount(&es, "quad", OP_CALL) == 0);
+    CHECK(opcount(&es, "main", OP_CALL) == 0);
+
+    es_destruct_state(&es);
+}
+
+
+//*************************************************************************
+static void kept()
+{
+    // branches and recursion stay calls
+    es_state es;
+    es_construct_state(&es);
+
+    int rets = run(&es,
+        "func abs(var n)\n"
+        "    if n < 0\n"
+        "        var m = 0 - n\n"
+        "        return m\n"
+        "    return n\n"
+        "func fib(var n)\n"
+        "    if n < 2\n"
+        "        return n\n"
+        "    var a = fib(n - 1)\n"
+        "    var b = fib(n - 2)\n"
+        "    var r = a + b\n"
+        "    return r\n"
+        "func main()\n"
+        "    var a = abs(-7)\n"
+        "    var b = fib(10)\n"
+        "    return a, b\n");
+
+    CHECK(rets == 2);
+    CHECK_INT(es.stack + 0, 7);
+    CHECK_INT(es.stack + 1, 55);
+
+    CHECK(opcount(&es, "main", OP_CALL) == 2);
+    CHECK(opcount(&es, "fib", OP_CALL) == 2);
+
+    es_destruct_state(&es);
+}
+
+
+//*************************************************************************
+int main()
+{
+    leaves();
+    kept();
+
+    return TEST_RESULT();
+}
@@ -0,0 +1,92 @@
+#include "test.h"
+#include "ir.h"
+
+
+//*************************************************************************
+static void passes()
+{
+    // a repeated expression, a copy and a store nothing reads
+    es_state es;
+    es_construct_state(&es);
+
+    es_instruction code[] =
+    {
+        INS_OABC(OP_MUL, 1, 0 << 1, 0 << 1), // r1 = r0 * r0
+        INS_OABC(OP_MUL, 2, 0 << 1, 0 << 1), // r2 = r0 * r0, same as r1
+        INS_OAY(OP_MOV, 3, 2 << 1),          // r3 = r2
+        INS_OAY(OP_MOVI, 4, 9),              // r4 = 9, never read
+        INS_OABC(OP_ADD, 0, 1 << 1, 3 << 1), // r0 = r1 + r3
+        INS_OX(OP_RET, 1),
+    };
+    size_t size = sizeof(code) / sizeof(*code);
+
+    es_irfunc f;
+    CHECK(es_ir_build(&f, &es, code, size));
+
+    size_t removed = es_ir_optimize(&f);
+    size_t lowered = es_ir_lower(&f, code);
+
+    // the second multiply, the copy and the dead store are gone
+    CHECK(removed == 3);
+    CHECK(lowered == size - removed);
+    CHECK(O(code[0]) == OP_MUL && O(code[1]) == OP_ADD && O(code[2]) == OP_RET);
+    CHECK(B(code[1]) == C(code[1]));
+
+    es_ir_destroy(&f);
+    es_destruct_state(&es);
+}
+
+
+//*************************************************************************
+static void calls()
+{
+    // a call nils the caller's registers past its results, values computed
+    // before it can't be reused after
+    es_state es;
+    es_construct_state(&es);
+
+    int rets = run(&es,
+        "func g(var x)\n"
+        "    if x < 0\n"
+        "        return x\n"
+        "    return x\n"
+        "func main()\n"
+        "    var p = 3\n"
+        "    var a = (p * 2) + ((p * 3) + ((p * 5) + p * 7))\n"
+        "    var b = g(1)\n"
+        "    var c = p * 7\n"
+        "    return c\n");
+
+    CHECK(rets == 1);
+    CHECK_INT(es.stack + 0, 21);
+
+    es_destruct_state(&es);
+
+    // and the same expression twice with nothing between is computed once
+    es_construct_state(&es);
+
+    rets = run(&es,
+        "func main()\n"
+        "    var p = 3\n"
+        "    var a = p * 7\n"
+        "    var b = p * 7\n"
+        "    var c = a + b\n"
+        "    return c\n");
+
+    CHECK(rets == 1);
+    CHECK_INT(es.stack + 0, 42);
+
+    CHECK(opcount(&es, "main", OP_MUL) == 1);
+
+    es_destruct_state(&es);
+}
+
+
+//*************************************************************************
+int main()
+{
+    passes();
+    calls();
+
+    return TEST_RESULT();
+}
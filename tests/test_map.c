@@ -0,0 +1,345 @@
+#include "test.h"
+#include "map.h"
+
+
+//*************************************************************************
+static void script()
+{
+    // string keys index through readm/writem, everything else through
+    // reada/writea, each handles the other's container too
+    es_state es;
+    es_construct_state(&es);
+
+    int rets = run(&es,
+        "func main()\n"
+        "    var m = {\"a\": 1, 2: \"two\"}\n"
+        "    var i = 2\n"
+        "    var k = \"a\"\n"
+        "    m[\"b\"] = 20\n"
+        "    m[3] = 30\n"
+        "    m[k] = 10\n"
+        "    var x = m[\"a\"] + m[\"b\"] + m[3]\n"
+        "    var t = m[i]\n"
+        "    var n = m[\"none\"]\n"
+        "    m[\"b\"] = nil\n"
+        "    m[3] = nil\n"
+        "    var l = len(m)\n"
+        "    var s = \"str\"\n"
+        "    var c = s[1]\n"
+        "    var a = ints(2)\n"
+        "    a[i - 1] = 5\n"
+        "    var e = a[1]\n"
+        "    return x, t, n, l, c, e\n");
+
+    CHECK(rets == 6);
+    CHECK_INT(es.stack + 0, 60);
+    CHECK_STR(es.stack + 1, "two");
+    CHECK(es.stack[2].tid == ES_NIL);
+    CHECK_INT(es.stack + 3, 2);
+    CHECK_INT(es.stack + 4, 't');
+    CHECK_INT(es.stack + 5, 5);
+
+    es_destruct_state(&es);
+}
+
+
+//*************************************************************************
+static void probing()
+{
+    es_allocator alloc;
+    es_construct_allocator(&alloc, es_default_alloc, NULL);
+
+    es_map map;
+    es_construct_map(&map, &alloc);
+
+    // negative keys stay out of the array part
+    enum { N = 5000 };
+    for(i64 i = 1; i <= N; ++i)
+    {
+        es_value k = intkey(-i), v = intkey(i);
+        es_mapset(&map, &k, &v);
+    }
+
+    CHECK(map.size == N);
+    CHECK((map.table.capacity & (map.table.capacity - 1)) == 0);
+
+    int found = 1;
+    for(i64 i = 1; i <= N; ++i)
+    {
+        es_value k = intkey(-i);
+        es_value *v = es_mapget(&map, &k);
+        found &= v && v->i == i;
+    }
+    CHECK(found);
+
+    es_value missing = intkey(-N - 1);
+    CHECK(es_mapget(&map, &missing) == NULL);
+
+    // churn at a steady size reuses tombstones instead of growing
+    es_mapreserve(&map, 0);
+    size_t capacity = map.table.capacity;
+
+    for(i64 round = 0; round < 20; ++round)
+    {
+        for(i64 i = 1; i <= N; i += 2)
+        {
+            es_value k = intkey(-i);
+            es_maperase(&map, &k);
+        }
+        for(i64 i = 1; i <= N; i += 2)
+        {
+            es_value k = intkey(-i), v = intkey(i + round);
+            es_mapset(&map, &k, &v);
+        }
+    }
+
+    es_mapreserve(&map, 0);
+    CHECK(map.size == N);
+    CHECK(map.table.capacity <= capacity * 2);
+
+    es_value k = intkey(-(N - 1));
+    CHECK(es_mapget(&map, &k) && es_mapget(&map, &k)->i == N - 1 + 19);
+
+    es_destroy_map(&map);
+    CHECK(alloc.live == 0);
+    es_destroy_allocator(&alloc);
+}
+
+
+//*************************************************************************
+static void incremental()
+{
+    es_allocator alloc;
+    es_construct_allocator(&alloc, es_default_alloc, NULL);
+
+    es_map map;
+    es_construct_map(&map, &alloc);
+
+    // large tables grow a few slots per insert, both are searched meanwhile
+    int migrating = 0, found = 1, erased = 1;
+    i64 readded = 0;
+
+    for(i64 i = 1; i <= 20000; ++i)
+    {
+        es_value k = intkey(-i), v = intkey(i);
+        es_mapset(&map, &k, &v);
+
+        if(map.old.capacity > 0 && !migrating)
+        {
+            migrating = 1;
+
+            for(i64 j = 1; j <= i; ++j)
+            {
+                es_value kj = intkey(-j);
+                es_value *vj = es_mapget(&map, &kj);
+                found &= vj && vj->i == j;
+            }
+
+            // erasing a key still in the old table
+            es_value first = intkey(-1);
+            es_maperase(&map, &first);
+            erased &= es_mapget(&map, &first) == NULL && map.size == (size_t) i - 1;
+            es_mapset(&map, &first, &v);
+            readded = i;
+        }
+    }
+
+    CHECK(migrating && found && erased);
+
+    // drained by later inserts, nothing lost
+    CHECK(map.old.capacity == 0);
+    CHECK(map.size == 20000);
+
+    es_value k = intkey(-1);
+    CHECK(es_mapget(&map, &k) && es_mapget(&map, &k)->i == readded);
+
+    es_destroy_map(&map);
+    CHECK(alloc.live == 0);
+    es_destroy_allocator(&alloc);
+}
+
+
+//*************************************************************************
+static void arraypart()
+{
+    es_allocator alloc;
+    es_construct_allocator(&alloc, es_default_alloc, NULL);
+
+    es_map map;
+    es_construct_map(&map, &alloc);
+
+    // dense int keys end up unboxed in the array part
+    for(i64 i = 0; i < 1000; ++i)
+    {
+        es_value k = intkey(i), v = intkey(i * 2);
+        es_mapset(&map, &k, &v);
+    }
+
+    CHECK(map.asize >= 1000 && map.acount == 1000);
+    CHECK(map.table.size == 0);
+
+    // sparse and negative ones don't
+    es_value far = intkey(1 << 20), neg = intkey(-5), v = intkey(1);
+    es_mapset(&map, &far, &v);
+    es_mapset(&map, &neg, &v);
+    CHECK(map.acount == 1000 && map.size == 1002);
+
+    // array keys come first when iterating, in order
+    size_t iter = 0;
+    es_value key, *value;
+    int ordered = 1;
+    for(i64 i = 0; i < 1000; ++i)
+    {
+        value = es_mapnext(&map, &iter, &key);
+        ordered &= value && key.tid == ES_INT && key.i == i && value->i == i * 2;
+    }
+    CHECK(ordered);
+
+    int rest = 0;
+    while(es_mapnext(&map, &iter, &key)) ++rest;
+    CHECK(rest == 2);
+
+    // a mostly empty array part gives its keys back to the hash part
+    for(i64 i = 0; i < 1000; ++i)
+    {
+        if(i % 10 == 0) continue;
+        es_value k = intkey(i);
+        es_maperase(&map, &k);
+    }
+
+    CHECK(map.size == 102);
+    CHECK(map.asize < 1000);
+
+    int found = 1;
+    for(i64 i = 0; i < 1000; i += 10)
+    {
+        es_value k = intkey(i);
+        es_value *f = es_mapget(&map, &k);
+        found &= f && f->i == i * 2;
+    }
+    CHECK(found);
+
+    es_destroy_map(&map);
+    CHECK(alloc.live == 0);
+    es_destroy_allocator(&alloc);
+}
+
+
+//*************************************************************************
+static void batches()
+{
+    es_allocator alloc;
+    es_construct_allocator(&alloc, es_default_alloc, NULL);
+
+    // large enough for the prefetching pass, and not a multiple of a batch
+    enum { N = 40007 };
+
+    static es_value keys[N], values[N];
+    static es_value *out[N];
+
+    for(size_t n = 0; n < 2; ++n)
+    {
+        size_t count = n ? N : 37;
+
+        es_map map;
+        es_construct_map(&map, &alloc);
+
+        for(size_t i = 0; i < count; ++i)
+        {
+            keys[i] = intkey(-(i64) i * 3 - 1);
+            values[i] = intkey((i64) i);
+        }
+
+        CHECK(es_mapset_batch(&map, keys, values, count) == count);
+        CHECK(map.size == count);
+
+        // the same answers as one at a time, misses included
+        for(size_t i = 0; i < count; ++i)
+            if(i % 2) keys[i].i += 1;
+
+        es_mapget_batch(&map, keys, out, count);
+
+        int same = 1;
+        for(size_t i = 0; i < count; ++i)
+        {
+            es_value *single = es_mapget(&map, keys + i);
+            same &= out[i] == single && (i % 2 ? single == NULL : single && single->i == (i64) i);
+        }
+        CHECK(same);
+
+        es_destroy_map(&map);
+    }
+
+    CHECK(alloc.live == 0);
+    es_destroy_allocator(&alloc);
+}
+
+
+//*************************************************************************
+static void ordered()
+{
+    es_allocator alloc;
+    es_construct_allocator(&alloc, es_default_alloc, NULL);
+
+    es_map map;
+    es_construct_map(&map, &alloc);
+
+    // scrambled keys come back in the order they went in
+    enum { N = 3000 };
+    for(i64 i = 0; i < N; ++i)
+    {
+        es_value k = intkey(-((i * 7919) % N) - 1), v = intkey(i);
+        es_mapset(&map, &k, &v);
+
+        if(i == 10) CHECK(map.table.width == 1);
+    }
+
+    CHECK(map.table.width >= 2);
+
+    // erase every third, then add some, the survivors keep their order
+    // and the new ones follow through however many compactions
+    for(i64 i = 0; i < N; i += 3)
+    {
+        es_value k = intkey(-((i * 7919) % N) - 1);
+        es_maperase(&map, &k);
+    }
+    for(i64 i = N; i < 2 * N; ++i)
+    {
+        es_value k = intkey(-i - 1), v = intkey(i);
+        es_mapset(&map, &k, &v);
+    }
+
+    size_t iter = 0;
+    es_value key, *value;
+    i64 last = -1;
+    int inorder = 1;
+    size_t count = 0;
+
+    while((value = es_mapnext(&map, &iter, &key)))
+    {
+        inorder &= value->i > last && (value->i >= N || value->i % 3 != 0);
+        last = value->i;
+        ++count;
+    }
+
+    CHECK(inorder);
+    CHECK(count == map.size && count == N - (N + 2) / 3 + N);
+
+    es_destroy_map(&map);
+    CHECK(alloc.live == 0);
+    es_destroy_allocator(&alloc);
+}
+
+
+//*************************************************************************
+int main()
+{
+    script();
+    probing();
+    incremental();
+    arraypart();
+    batches();
+    ordered();
+
+    return TEST_RESULT();
+}
@@ -0,0 +1,171 @@
+#include "test.h"
+
+
+//*************************************************************************
+static void pools()
+{
+    es_allocator alloc;
+    es_construct_allocator(&alloc, es_default_alloc, NULL);
+
+    // blocks are rounded up to their class, and counted while in use
+    void *a = es_pool_alloc(&alloc, 1);
+    void *b = es_pool_alloc(&alloc, 17);
+    void *c = es_pool_alloc(&alloc, ES_POOL_MAXBLOCK);
+    CHECK(a && b && c);
+    CHECK(alloc.live == ES_POOL_GRANULE + 2 * ES_POOL_GRANULE + ES_POOL_MAXBLOCK);
+
+    // granule aligned
+    CHECK(((size_t) a % ES_POOL_GRANULE) == 0);
+    CHECK(((size_t) b % ES_POOL_GRANULE) == 0);
+
+    // a freed block is the next one handed out for its class
+    es_pool_free(&alloc, b, 17);
+    void *d = es_pool_alloc(&alloc, 32);
+    CHECK(d == b);
+
+    // sizes past the largest class go to the hook
+    void *big = es_pool_alloc(&alloc, ES_POOL_MAXBLOCK + 1);
+    CHECK(big != NULL);
+    CHECK(alloc.live == ES_POOL_GRANULE + 2 * ES_POOL_GRANULE + 2 * ES_POOL_MAXBLOCK + 1);
+    es_pool_free(&alloc, big, ES_POOL_MAXBLOCK + 1);
+
+    es_pool_free(&alloc, a, 1);
+    es_pool_free(&alloc, c, ES_POOL_MAXBLOCK);
+    es_pool_free(&alloc, d, 32);
+    CHECK(alloc.live == 0);
+
+    es_destroy_allocator(&alloc);
+}
+
+
+//*************************************************************************
+static void slabs()
+{
+    es_allocator alloc;
+    es_construct_allocator(&alloc, es_default_alloc, NULL);
+
+    // enough blocks of one class to span several slabs, all distinct
+    enum { COUNT = 1000 };
+    static void *blocks[COUNT];
+
+    for(int i = 0; i < COUNT; ++i)
+    {
+        blocks[i] = es_pool_alloc(&alloc, 24);
+        memset(blocks[i], i & 0xff, 24);
+    }
+
+    int slabs = 0;
+    for(es_pool_slab *s = alloc.pool.slabs; s; s = s->next) ++slabs;
+    CHECK(slabs > 1);
+
+    int intact = 1;
+    for(int i = 0; i < COUNT; ++i)
+        intact &= ((unsigned char*) blocks[i])[23] == (i & 0xff);
+    CHECK(intact);
+
+    for(int i = 0; i < COUNT; ++i)
+        es_pool_free(&alloc, blocks[i], 24);
+
+    CHECK(alloc.live == 0);
+    CHECK(alloc.peak >= COUNT * 2 * ES_POOL_GRANULE);
+
+    // blocks still in use go with their slab
+    es_pool_alloc(&alloc, 8);
+    es_destroy_allocator(&alloc);
+    CHECK(alloc.pool.slabs == NULL);
+}
+
+
+//*************************************************************************
+static int hookcalls = 0;
+
+static void *counting(void *ud, void *ptr, size_t oldsize, size_t newsize)
+{
+    hookcalls += 1;
+    return es_default_alloc(ud, ptr, oldsize, newsize);
+}
+
+
+//*************************************************************************
+static void hooks()
+{
+    // every allocation of a state goes through its hook
+    es_state es;
+    es_construct_state_alloc(&es, counting, NULL);
+
+    int calls = hookcalls;
+    int rets = run(&es,
+        "func main()\n"
+        "    var s = \"a\" + \"b\"\n"
+        "    return s\n");
+
+    CHECK(rets == 1);
+    CHECK_STR(es.stack + 0, "ab");
+    CHECK(hookcalls > calls);
+    CHECK(es.alloc.peak >= es.alloc.live);
+
+    es_destruct_state(&es);
+}
+
+
+//*************************************************************************
+static void limits()
+{
+    es_allocator alloc;
+    es_construct_allocator(&alloc, es_default_alloc, NULL);
+
+    // refused past the limit, and the refusal is remembered
+    alloc.limit = 1000;
+    void *a = es_malloc(&alloc, 600);
+    void *b = es_malloc(&alloc, 600);
+    CHECK(a && !b);
+    CHECK(alloc.overlimit && alloc.live == 600);
+
+    // shrinking is always allowed
+    a = es_realloc(&alloc, a, 600, 100);
+    CHECK(a && alloc.live == 100);
+
+    es_free(&alloc, a, 100);
+    CHECK(alloc.live == 0);
+    es_destroy_allocator(&alloc);
+}
+
+
+//*************************************************************************
+static void scriptlimit()
+{
+    // a string growing without end stops with a runtime error
+    es_state es;
+    es_construct_state(&es);
+
+    const char *src =
+        "func grow(var s, n)\n"
+        "    if n < 1\n"
+        "        return s\n"
+        "    return grow(s + s, n - 1)\n"
+        "func main()\n"
+        "    return grow(\"0123456789abcdef\", 40)\n";
+
+    CHECK(es_compile(&es, src, strlen(src)) == 0);
+
+    es_set_memlimit(&es, es.alloc.live + 64 * 1024);
+    es_call(&es, "main");
+
+    CHECK(es.alloc.overlimit);
+    CHECK(es.alloc.live <= es.alloc.limit);
+
+    es_destruct_state(&es);
+}
+
+
+//*************************************************************************
+int main()
+{
+    pools();
+    slabs();
+    hooks();
+    limits();
+    scriptlimit();
+
+    return TEST_RESULT();
+}
@@ -0,0 +1,157 @@
+#include "test.h"
+#include "numarray.h"
+#include "kernels.h"
+
+
+//*************************************************************************
+static void kernels()
+{
+    // whichever instruction set was picked agrees with a plain loop on
+    // every size, the vector bodies and the scalar tails
+    const es_kernels *k = es_get_kernels();
+
+    enum { N = 67 };
+    f64 a[N], b[N], c[N];
+    i64 ia[N], ib[N];
+    u8 bytes[N], mask[N];
+
+    for(size_t i = 0; i < N; ++i)
+    {
+        // small integers so float sums are exact in any order
+        a[i] = (f64)((i * 7) % 13) - 6.0;
+        b[i] = (f64)((i * 5) % 11) - 3.0;
+        ia[i] = (i64)(i * i) - 100;
+        ib[i] = (i64) i;
+        bytes[i] = (u8)(200 + i);
+    }
+
+    int ok = 1;
+    for(size_t n = 1; n <= N; ++n)
+    {
+        f64 sum = 0, dot = 0, mn = a[0], mx = a[0];
+        i64 isum = 0;
+        u64 bsum = 0;
+
+        for(size_t i = 0; i < n; ++i)
+        {
+            sum += a[i];
+            dot += a[i] * b[i];
+            if(a[i] < mn) mn = a[i];
+            if(a[i] > mx) mx = a[i];
+            isum += ia[i];
+            bsum += bytes[i];
+        }
+
+        ok &= k->sumf(a, n) == sum;
+        ok &= k->dotf(a, b, n) == dot;
+        ok &= k->minf(a, n) == mn;
+        ok &= k->maxf(a, n) == mx;
+        ok &= k->sumi(ia, n) == isum;
+        ok &= k->sumb(bytes, n) == bsum;
+
+        memcpy(c, a, sizeof(a));
+        k->scalef(c, 2.0, n);
+        k->addf(c, b, n);
+        k->maskf(mask, a, 0.0, n);
+
+        for(size_t i = 0; i < n; ++i)
+        {
+            ok &= c[i] == a[i] * 2.0 + b[i];
+            ok &= mask[i] == (a[i] < 0.0);
+        }
+
+        // past n nothing is written
+        ok &= c[n - 1 + (n < N)] == (n < N ? a[n] : c[n - 1]);
+
+        i64 ic[N];
+        memcpy(ic, ia, sizeof(ia));
+        k->addi(ic, ib, n);
+        for(size_t i = 0; i < n; ++i)
+            ok &= ic[i] == ia[i] + ib[i];
+    }
+
+    if(!ok) printf("kernels : %s\n", k->isa);
+    CHECK(ok);
+}
+
+
+//*************************************************************************
+static void arrays()
+{
+    es_allocator alloc;
+    es_construct_allocator(&alloc, es_default_alloc, NULL);
+
+    // zero filled, elements unboxed at their natural size
+    es_numarray arr;
+    arr.obj.alloc = &alloc;
+
+    CHECK(es_construct_numarray(&arr, ES_ELEM_BYTE, 100));
+    CHECK(arr.size == 100 && arr.data.b[0] == 0 && arr.data.b[99] == 0);
+    CHECK(alloc.live == 100 * es_elemsize(ES_ELEM_BYTE));
+    es_destroy_numarray(&arr);
+
+    CHECK(es_construct_numarray(&arr, ES_ELEM_FLOAT, 10));
+    CHECK(alloc.live == 10 * sizeof(f64) && arr.data.f[9] == 0.0);
+    es_destroy_numarray(&arr);
+
+    CHECK(alloc.live == 0);
+    es_destroy_allocator(&alloc);
+}
+
+
+//*************************************************************************
+static void script()
+{
+    // ints are stored into float arrays converted
+    es_state es;
+    es_construct_state(&es);
+
+    int rets = run(&es,
+        "func main()\n"
+        "    var a = floats(4)\n"
+        "    var b = floats(4)\n"
+        "    a[0] = 1\n"
+        "    a[1] = 3\n"
+        "    a[2] = 4\n"
+        "    a[3] = 8\n"
+        "    b[0] = 2\n"
+        "    b[1] = 2\n"
+        "    b[2] = 2\n"
+        "    b[3] = 2\n"
+        "    var d = dot(a, b)\n"
+        "    scale(b, 3)\n"
+        "    accum(a, b)\n"
+        "    var i = ints(3)\n"
+        "    i[1] = 40\n"
+        "    i[2] = 2\n"
+        "    var m = mask(a, 10)\n"
+        "    var s = sum(a)\n"
+        "    var lo = min(a)\n"
+        "    var hi = max(i)\n"
+        "    var n = sum(m)\n"
+        "    var l = len(i)\n"
+        "    var e = a[3]\n"
+        "    return d, s, lo, hi, n, l, e\n");
+
+    CHECK(rets == 7);
+    CHECK(es.stack[0].tid == ES_FLOAT && es.stack[0].f == 32.0);
+    CHECK(es.stack[1].tid == ES_FLOAT && es.stack[1].f == 40.0);
+    CHECK(es.stack[2].tid == ES_FLOAT && es.stack[2].f == 7.0);
+    CHECK_INT(es.stack + 3, 40);
+    CHECK_INT(es.stack + 4, 2);
+    CHECK_INT(es.stack + 5, 3);
+    CHECK(es.stack[6].tid == ES_FLOAT && es.stack[6].f == 14.0);
+
+    es_destruct_state(&es);
+}
+
+
+//*************************************************************************
+int main()
+{
+    kernels();
+    arrays();
+    script();
+
+    return TEST_RESULT();
+}
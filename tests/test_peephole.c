@@ -0,0 +1,140 @@
+#include "test.h"
+#include "ir.h"
+
+
+//*************************************************************************
+static void addfunc(es_state *es, const char *name, es_instruction *ip, size_t size)
+{
+    size_t n = strlen(name);
+    char *copy = (char*) es_malloc(&es->alloc, n + 1);
+    memcpy(copy, name, n + 1);
+
+    CHECK(es_arrpush(es_function, es->funcs));
+
+    es_function *f = &es_arrback(es->funcs);
+    memset(f, 0, sizeof(es_function));
+    f->name    = copy;
+    f->returns = 1;
+    f->ip      = ip;
+    f->size    = size;
+    f->maxregs = 2;
+}
+
+
+//*************************************************************************
+static void *noshrink(void *ud, void *ptr, size_t oldsize, size_t newsize)
+{
+    // fails to shrink a block while *ud is set
+    if(*(int*) ud && newsize > 0 && newsize < oldsize) return NULL;
+    return es_default_alloc(NULL, ptr, oldsize, newsize);
+}
+
+
+//*************************************************************************
+static void windows(int failshrink)
+{
+    int fail = 0;
+
+    es_state es;
+    es_construct_state_alloc(&es, noshrink, &fail);
+
+    size_t k = es_addk_int(&es, 1);
+
+    es_instruction code[] =
+    {
+        // a
+        INS_OAY(OP_MOV, 1, 1 << 1),                     // self move
+        INS_OAY(OP_MOVI, 0, 5),                         // overwritten right away
+        INS_OAY(OP_MOVI, 0, 6),
+        INS_OX(OP_RET, 1),
+
+        // b
+        INS_OAY(OP_JMP, 0, 0),                          // to the next instruction
+        INS_OAY(OP_MOV, 1, 0 << 1),                     // forwarded into the add
+        INS_OABC(OP_ADD, 1, 1 << 1, (u32) ASK(k)),
+        INS_OAY(OP_MOV, 0, 1 << 1),
+        INS_OX(OP_RET, 1),
+    };
+
+    es_code chunk;
+    chunk.size = sizeof(code) / sizeof(*code);
+    chunk.instructions = (es_instruction*) es_malloc(&es.alloc, sizeof(code));
+    memcpy(chunk.instructions, code, sizeof(code));
+
+    addfunc(&es, "a", chunk.instructions, 4);
+    addfunc(&es, "b", chunk.instructions + 4, 5);
+
+    fail = failshrink;
+
+    es_peepstats st;
+    CHECK(es_peephole(&es, &chunk, &st) == 4);
+
+    fail = 0;
+
+    CHECK(st.selfmoves == 1 && st.deadstores == 1 && st.jumps == 1 && st.forwarded == 1);
+    CHECK(st.removed == 4);
+
+    // a chunk that couldn't shrink keeps its size, the tail just returns
+    if(failshrink)
+        CHECK(chunk.size == 9 && chunk.instructions[5] == INS_OX(OP_RET, 0));
+    else
+        CHECK(chunk.size == 5);
+
+    // functions are moved along with what's left of them
+    es_function *a = es.funcs.data + es.funcs.size - 2;
+    es_function *b = es.funcs.data + es.funcs.size - 1;
+
+    CHECK(a->ip == chunk.instructions && a->size == 2);
+    CHECK(b->ip == chunk.instructions + 2 && b->size == 3);
+
+    CHECK(a->ip[0] == INS_OAY(OP_MOVI, 0, 6));
+    CHECK(b->ip[0] == INS_OABC(OP_ADD, 1, 0 << 1, (u32) ASK(k)));
+
+    CHECK(es_call(&es, "a") == 1);
+    CHECK_INT(es.stack + 0, 6);
+
+    es_free(&es.alloc, chunk.instructions, chunk.size * sizeof(es_instruction));
+    es_destruct_state(&es);
+}
+
+
+//*************************************************************************
+static void script()
+{
+    // compiled code goes through it too and still runs the same
+    es_state es;
+    es_construct_state(&es);
+
+    int rets = run(&es,
+        "func f(var n)\n"
+        "    if n < 1\n"
+        "        return n\n"
+        "    var m = n - 1\n"
+        "    var r = f(m)\n"
+        "    var s = r + n\n"
+        "    return s\n"
+        "func main()\n"
+        "    var r = f(10)\n"
+        "    return r\n");
+
+    CHECK(rets == 1);
+    CHECK_INT(es.stack + 0, 55);
+
+    // what it did to the chunk is left for the host, jumps to jumps are
+    // counted but remove nothing
+    es_peepstats *st = &es.peepstats;
+    CHECK(st->removed <= st->selfmoves + st->forwarded + st->deadstores + st->jumps);
+
+    es_destruct_state(&es);
+}
+
+
+//*************************************************************************
+int main()
+{
+    windows(0);
+    windows(1);
+    script();
+
+    return TEST_RESULT();
+}
@@ -0,0 +1,179 @@
+#include "test.h"
+#include "estring.h"
+
+
+//*************************************************************************
+static es_string *newstring(es_allocator *alloc, const char *s)
+{
+    es_string *str = (es_string*) ES_ALLOCATE_OBJ(alloc, es_string, ES_STRING);
+    es_construct_string(str, s, strlen(s));
+    return str;
+}
+
+
+//*************************************************************************
+static void freestring(es_string *str)
+{
+    es_destroy_string(str);
+    ES_FREE_OBJ(str, es_string);
+}
+
+
+//*************************************************************************
+static void appends()
+{
+    es_allocator alloc;
+    es_construct_allocator(&alloc, es_default_alloc, NULL);
+
+    es_string *s = newstring(&alloc, "ab");
+
+    // capacity at least doubles, so 1000 appends only grow it a few times
+    int grows = 0;
+    for(int i = 0; i < 1000; ++i)
+    {
+        size_t capacity = s->capacity;
+        es_strappendn(s, "xyz", 3);
+        grows += s->capacity != capacity;
+    }
+
+    CHECK(s->size == 3002);
+    CHECK(s->data[s->size] == '\0');
+    CHECK(memcmp(s->data, "abxyzxyz", 8) == 0);
+    CHECK(grows <= 12);
+
+    // appending a string to itself reads from before the move
+    es_string *t = newstring(&alloc, "abc");
+    es_strappend(t, t);
+    CHECK(t->size == 6 && strcmp(t->data, "abcabc") == 0);
+
+    freestring(s);
+    freestring(t);
+
+    CHECK(alloc.live == 0);
+    es_destroy_allocator(&alloc);
+}
+
+
+//*************************************************************************
+static void concats()
+{
+    es_allocator alloc;
+    es_construct_allocator(&alloc, es_default_alloc, NULL);
+
+    es_string *a = newstring(&alloc, "con");
+    es_string *b = newstring(&alloc, "cat");
+    es_string *c = newstring(&alloc, "");
+
+    const es_string *strs[] = {a, c, b, a};
+    es_string *n = es_strconcatn(&alloc, strs, 4);
+    es_string *two = es_strconcat(&alloc, a, b);
+
+    CHECK(n->size == 9 && strcmp(n->data, "concatcon") == 0);
+
+    // sized once, exactly
+    CHECK(n->capacity == 10);
+    CHECK(two->size == 6 && strcmp(two->data, "concat") == 0);
+
+    freestring(a);
+    freestring(b);
+    freestring(c);
+    freestring(n);
+    freestring(two);
+
+    CHECK(alloc.live == 0);
+    es_destroy_allocator(&alloc);
+}
+
+
+//*************************************************************************
+static void substrings()
+{
+    es_allocator alloc;
+    es_construct_allocator(&alloc, es_default_alloc, NULL);
+
+    es_string *s = newstring(&alloc, "hello world");
+
+    es_string *sub = (es_string*) ES_ALLOCATE_OBJ(&alloc, es_string, ES_STRING);
+    es_construct_substring(sub, s, 6, 5);
+
+    // a view into the parent's buffer, nothing copied
+    CHECK(sub->parent == s);
+    CHECK(sub->data == s->data + 6 && sub->size == 5);
+
+    // views of views reference the owner, bounds are clamped
+    es_string *subsub = (es_string*) ES_ALLOCATE_OBJ(&alloc, es_string, ES_STRING);
+    es_construct_substring(subsub, sub, 1, 100);
+    CHECK(subsub->parent == s);
+    CHECK(subsub->size == 4 && memcmp(subsub->data, "orld", 4) == 0);
+
+    // compared by size, the view isn't null terminated
+    es_string *world = newstring(&alloc, "world");
+    es_string *worlds = newstring(&alloc, "worlds");
+    CHECK(es_cmp_strings(sub, world) == 0);
+    CHECK(es_cmp_strings(sub, worlds) < 0);
+
+    // asking for a c string makes a private copy
+    const char *c = es_strcstr(sub);
+    CHECK(strcmp(c, "world") == 0);
+    CHECK(sub->parent == NULL && sub->data != s->data + 6);
+
+    freestring(subsub);
+    freestring(sub);
+    freestring(s);
+    freestring(world);
+    freestring(worlds);
+
+    CHECK(alloc.live == 0);
+    es_destroy_allocator(&alloc);
+}
+
+
+//*************************************************************************
+static void script()
+{
+    // a two operand '+' of strings and a chain lowered to one concat
+    es_state es;
+    es_construct_state(&es);
+
+    int rets = run(&es,
+        "func main()\n"
+        "    var a = \"ab\"\n"
+        "    var b = \"cd\"\n"
+        "    var c = a + b\n"
+        "    var d = a + \"-\" + b + \"!\"\n"
+        "    return c, d\n");
+
+    CHECK(rets == 2);
+    CHECK_STR(es.stack + 0, "abcd");
+    CHECK_STR(es.stack + 1, "ab-cd!");
+
+    es_destruct_state(&es);
+
+    // substr and len through the builtins
+    es_construct_state(&es);
+
+    rets = run(&es,
+        "func main()\n"
+        "    var s = \"substring\"\n"
+        "    var t = substr(s, 3, 3)\n"
+        "    var n = len(t)\n"
+        "    return t, n\n");
+
+    CHECK(rets == 2);
+    CHECK_STR(es.stack + 0, "str");
+    CHECK_INT(es.stack + 1, 3);
+
+    es_destruct_state(&es);
+}
+
+
+//*************************************************************************
+int main()
+{
+    appends();
+    concats();
+    substrings();
+    script();
+
+    return TEST_RESULT();
+}
@@ -0,0 +1,98 @@
+#include "test.h"
+#include "struct.h"
+
+
+//*************************************************************************
+static void script()
+{
+    es_state es;
+    es_construct_state(&es);
+
+    // one site seeing two shapes with 'x' in different slots has to look it
+    // up again whenever its cache holds the other one
+    int rets = run(&es,
+        "struct A\n"
+        "    x, y\n"
+        "struct B\n"
+        "    w, x, inner\n"
+        "func getx(var s) return s.x\n"
+        "func main()\n"
+        "    var a = A(1, 2)\n"
+        "    var b = B(3, 4)\n"
+        "    b.inner = A(5)\n"
+        "    b.inner.y = a.x + b.x\n"
+        "    var t = getx(a) + getx(b) * 10 + getx(a) * 100 + getx(b) * 1000\n"
+        "    var y = b.inner.y\n"
+        "    var ay = a.y\n"
+        "    var n = b.inner\n"
+        "    return t, y, ay, n\n");
+
+    CHECK(rets == 4);
+    CHECK_INT(es.stack + 0, 1 + 40 + 100 + 4000);
+    CHECK_INT(es.stack + 1, 5);
+    CHECK_INT(es.stack + 2, 2);
+    CHECK(es.stack[3].tid == ES_STRUCT);
+
+    // the nested object is reached from the stack, through b
+    if(es.stack[3].tid != ES_STRUCT) return;
+
+    es_gc_collect(&es.gc);
+    es_structobject *inner = AS_STRUCT((es.stack + 3));
+    CHECK(inner->shape == es_find_shape(&es, "A", 1));
+    CHECK_INT(inner->slots + 0, 5);
+    CHECK_INT(inner->slots + 1, 5);
+
+    // fields are found by name through the constant table
+    es_shape *b = es_find_shape(&es, "B", 1);
+    CHECK(b && b->size == 3);
+
+    es_value name;
+    name.tid = ES_STRING;
+    name.obj = es.kst.data[b->fields[1]].obj;
+    CHECK(es_structfield(b, es.kst.data, &name) == 1);
+    CHECK(es_structfield(inner->shape, es.kst.data, &name) == 0);
+    CHECK(es_find_shape(&es, "C", 1) == NULL);
+
+    es_destruct_state(&es);
+}
+
+
+//*************************************************************************
+static void errors()
+{
+    es_state es;
+    es_construct_state(&es);
+
+    // a field the object's shape doesn't have stops the script, variables
+    // aren't typed so it's only known when run
+    run(&es,
+        "struct P\n"
+        "    x, y\n"
+        "func main()\n"
+        "    var p = P(1, 2)\n"
+        "    return p.z\n");
+
+    CHECK(es.stack[0].tid == ES_STRUCT);
+
+    es_destruct_state(&es);
+    es_construct_state(&es);
+
+    // a field declared twice doesn't compile
+    CHECK(run(&es,
+        "struct Q\n"
+        "    x, x\n"
+        "func main()\n"
+        "    return 0\n") == -1);
+
+    es_destruct_state(&es);
+}
+
+
+//*************************************************************************
+int main()
+{
+    script();
+    errors();
+
+    return TEST_RESULT();
+}